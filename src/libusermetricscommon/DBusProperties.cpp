@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricscommon/DBusPaths.h>
+#include <libusermetricscommon/DBusProperties.h>
+
+#include <QtDBus/QDBusArgument>
+#include <QtDBus/QDBusMessage>
+
+using namespace UserMetricsCommon;
+
+QDBusPendingCall DBusProperties::getAll(const QDBusConnection &connection,
+		const QString &path, const QString &interface) {
+	QDBusMessage message(
+			QDBusMessage::createMethodCall(DBusPaths::serviceName(), path,
+					"org.freedesktop.DBus.Properties", "GetAll"));
+	message << interface;
+	return connection.asyncCall(message);
+}
+
+/**
+ * Containers nested inside a variant are handed to us as un-parsed
+ * QDBusArguments, so unpack the whole tree into plain maps and lists.
+ */
+QVariant DBusProperties::demarshall(const QVariant &variant) {
+	if (variant.userType() != qMetaTypeId<QDBusArgument>()) {
+		return variant;
+	}
+
+	const QDBusArgument argument(variant.value<QDBusArgument>());
+
+	switch (argument.currentType()) {
+	case QDBusArgument::MapType: {
+		QVariantMap map;
+		argument >> map;
+		for (auto it(map.begin()); it != map.end(); ++it) {
+			*it = demarshall(*it);
+		}
+		return map;
+	}
+	case QDBusArgument::ArrayType: {
+		QVariantList list;
+		argument >> list;
+		for (auto it(list.begin()); it != list.end(); ++it) {
+			*it = demarshall(*it);
+		}
+		return list;
+	}
+	default:
+		return variant;
+	}
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSCOMMON_DBUSPROPERTIES_H_
+#define USERMETRICSCOMMON_DBUSPROPERTIES_H_
+
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusPendingCall>
+
+namespace UserMetricsCommon {
+
+class DBusProperties {
+public:
+	static QDBusPendingCall getAll(const QDBusConnection &connection,
+			const QString &path, const QString &interface);
+
+	static QVariant demarshall(const QVariant &variant);
+};
+
+}
+
+#endif // USERMETRICSCOMMON_DBUSPROPERTIES_H_
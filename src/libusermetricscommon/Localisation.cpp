@@ -17,86 +17,303 @@
  */
 
 #include <libusermetricscommon/Localisation.h>
-#include <QtCore/QDebug>
-#include <QtCore/QProcess>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QtEndian>
+
+#include <cstring>
 
 namespace {
-static QWeakPointer<ExternalGettext> instance;
+static QWeakPointer<Gettext> instance;
+
+static const quint32 MO_MAGIC(0x950412de);
+
+static const quint32 MO_MAGIC_SWAPPED(0xde120495);
+
+static const int HEADER_SIZE(28);
+
+static const int MAXIMUM_CACHED_TRANSLATIONS(512);
+
+static const qint64 CATALOG_TIMEOUT(30000);
+}
+
+GettextCatalog::GettextCatalog() :
+		m_swapped(false), m_count(0), m_originals(0), m_translations(0), m_size(
+				0) {
+}
+
+GettextCatalog::Ptr GettextCatalog::load(const QString &path) {
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return Ptr();
+	}
+
+	const QFileInfo info(file);
+
+	Ptr catalog(new GettextCatalog);
+	catalog->m_lastModified = info.lastModified();
+	catalog->m_size = info.size();
+	catalog->m_data = file.readAll();
+	if (!catalog->readHeader()) {
+		return Ptr();
+	}
+	return catalog;
+}
+
+bool GettextCatalog::changed(const QString &path) const {
+	const QFileInfo info(path);
+	return !info.exists() || info.lastModified() != m_lastModified
+			|| info.size() != m_size;
+}
+
+quint32 GettextCatalog::read(quint32 offset) const {
+	quint32 value;
+	memcpy(&value, m_data.constData() + offset, sizeof(value));
+	return m_swapped ? qbswap(value) : value;
 }
 
-class ExternalGettext::Priv: public QObject {
-Q_OBJECT
+bool GettextCatalog::readHeader() {
+	if (m_data.size() < HEADER_SIZE) {
+		return false;
+	}
+
+	quint32 magic;
+	memcpy(&magic, m_data.constData(), sizeof(magic));
+	if (magic == MO_MAGIC_SWAPPED) {
+		m_swapped = true;
+	} else if (magic != MO_MAGIC) {
+		return false;
+	}
+
+	m_count = read(8);
+	m_originals = read(12);
+	m_translations = read(16);
+
+	// both tables hold a length and an offset for each string
+	const quint64 size(m_data.size());
+	const quint64 tableSize(quint64(m_count) * 8);
+	return m_originals + tableSize <= size
+			&& m_translations + tableSize <= size;
+}
+
+bool GettextCatalog::string(quint32 table, quint32 index, const char *&data,
+		quint32 &length) const {
+	const quint32 entry(table + index * 8);
+	length = read(entry);
+	const quint32 offset(read(entry + 4));
+	if (quint64(offset) + length >= quint64(m_data.size())) {
+		return false;
+	}
+	data = m_data.constData() + offset;
+	return true;
+}
 
-public Q_SLOTS:
-	void tr(GettextRequest::Ptr request) {
-		QProcess gettext;
+QString GettextCatalog::translate(const QByteArray &messageId) const {
+	// msgfmt sorts the original strings, so we can search them in place
+	quint32 low(0);
+	quint32 high(m_count);
+	while (low < high) {
+		const quint32 middle(low + (high - low) / 2);
 
-		if (!request->m_localeDir.isEmpty()) {
-			QProcessEnvironment env(QProcessEnvironment::systemEnvironment());
-			env.insert("TEXTDOMAINDIR", request->m_localeDir);
-			gettext.setProcessEnvironment(env);
+		const char *original;
+		quint32 length;
+		if (!string(m_originals, middle, original, length)) {
+			return QString();
 		}
 
-		gettext.setProcessChannelMode(QProcess::ForwardedErrorChannel);
-		gettext.start("gettext",
-				QStringList() << request->m_textDomain << request->m_messageId);
-		gettext.waitForReadyRead(200);
-		QByteArray ba(gettext.readAllStandardOutput());
-		gettext.waitForFinished(200);
+		const quint32 common(qMin(length, quint32(messageId.size())));
+		int comparison(memcmp(original, messageId.constData(), common));
+		if (comparison == 0) {
+			comparison = int(length > common) - int(messageId.size() > int(common));
+		}
 
-		Q_EMIT request->result(QString::fromUtf8(ba), request->m_requestId);
+		if (comparison < 0) {
+			low = middle + 1;
+		} else if (comparison > 0) {
+			high = middle;
+		} else {
+			const char *translation;
+			if (!string(m_translations, middle, translation, length)
+					|| length == 0) {
+				return QString();
+			}
+			// plural forms follow the first one after a NUL
+			return QString::fromUtf8(translation, qstrnlen(translation, length));
+		}
 	}
-};
 
-ExternalGettext::Ptr ExternalGettext::singletonInstance() {
-	ExternalGettext::Ptr result(instance);
+	return QString();
+}
+
+Gettext::Ptr Gettext::singletonInstance() {
+	Gettext::Ptr result(instance);
 
 	if (!result) {
-		qRegisterMetaType<GettextRequest::Ptr>("GettextRequest::Ptr");
-		result.reset(new ExternalGettext);
+		result.reset(new Gettext);
 		instance = result;
 	}
 	return result;
 }
 
-ExternalGettext::ExternalGettext() {
-	m_thread.start();
+Gettext::Gettext() :
+		Gettext(CATALOG_TIMEOUT) {
+}
 
-	p.reset(new Priv);
-	p->moveToThread(&m_thread);
+Gettext::Gettext(qint64 catalogTimeout) :
+		m_translations(MAXIMUM_CACHED_TRANSLATIONS), m_catalogTimeout(
+				catalogTimeout), m_lastChecked(0) {
+	m_clock.start();
+}
 
-	connect(this, SIGNAL(newRequest(GettextRequest::Ptr)),
-			p.data(), SLOT(tr(GettextRequest::Ptr)),
-			Qt::QueuedConnection);
+Gettext::~Gettext() {
 }
 
-ExternalGettext::~ExternalGettext() {
-	if (m_thread.isRunning()) {
-		m_thread.quit();
-		m_thread.wait();
+QStringList Gettext::languages() {
+	QStringList locales;
+
+	for (const QString &language : QString::fromUtf8(qgetenv("LANGUAGE")).split(
+			':', QString::SkipEmptyParts)) {
+		locales << language;
 	}
+
+	for (const char *variable : { "LC_ALL", "LC_MESSAGES", "LANG" }) {
+		const QString locale(QString::fromUtf8(qgetenv(variable)));
+		if (!locale.isEmpty()) {
+			locales << locale;
+			break;
+		}
+	}
+
+	// language_territory.codeset@modifier, then less and less specific
+	QStringList result;
+	for (const QString &locale : locales) {
+		if (locale == "C" || locale == "POSIX") {
+			continue;
+		}
+
+		QString name(locale);
+		QString modifier;
+		const int at(name.indexOf('@'));
+		if (at != -1) {
+			modifier = name.mid(at);
+			name.truncate(at);
+		}
+
+		QStringList variants;
+		variants << name + modifier;
+		const int dot(name.indexOf('.'));
+		if (dot != -1) {
+			name.truncate(dot);
+			variants << name + modifier;
+		}
+		variants << name;
+		const int underscore(name.indexOf('_'));
+		if (underscore != -1) {
+			name.truncate(underscore);
+			variants << name + modifier << name;
+		}
+
+		for (const QString &variant : variants) {
+			if (!result.contains(variant)) {
+				result << variant;
+			}
+		}
+	}
+
+	return result;
 }
 
-void ExternalGettext::tr(const QString &textDomain, const QString &messageId,
-		const QString &localeDir, const QObject *who,
-		const QString &requestId) {
+GettextCatalog::Ptr Gettext::catalog(const QString &path) {
+	auto it(m_catalogs.constFind(path));
+	if (it != m_catalogs.constEnd()) {
+		return *it;
+	}
 
-	GettextRequest::Ptr r(new GettextRequest);
+	// a package can install the catalog while we are running, so a miss
+	// is only believed for a little while
+	auto missing(m_missingCatalogs.constFind(path));
+	if (missing != m_missingCatalogs.constEnd()
+			&& m_clock.elapsed() - *missing < m_catalogTimeout) {
+		return GettextCatalog::Ptr();
+	}
 
-	r->m_textDomain = textDomain;
-	r->m_messageId = messageId;
-	r->m_localeDir = localeDir;
-	r->m_requestId = requestId;
+	GettextCatalog::Ptr catalog(GettextCatalog::load(path));
+	if (catalog) {
+		m_missingCatalogs.remove(path);
+		m_catalogs.insert(path, catalog);
+	} else {
+		m_missingCatalogs.insert(path, m_clock.elapsed());
+	}
+	return catalog;
+}
 
-	r->moveToThread(&m_thread);
+void Gettext::checkCatalogs() {
+	const qint64 now(m_clock.elapsed());
+	if (now - m_lastChecked < m_catalogTimeout) {
+		return;
+	}
+	m_lastChecked = now;
 
-	connect(r.data(),
-			SIGNAL(result(const QString &, const QString &)),
-			who,
-			SLOT(translationResult(const QString &, const QString &)),
-			Qt::QueuedConnection);
+	bool changed(false);
+	auto it(m_catalogs.begin());
+	while (it != m_catalogs.end()) {
+		if ((*it)->changed(it.key())) {
+			it = m_catalogs.erase(it);
+			changed = true;
+		} else {
+			++it;
+		}
+	}
 
-	Q_EMIT newRequest(r);
+	// we don't know which translations came from which catalog
+	if (changed) {
+		m_translations.clear();
+	}
 }
 
-#include "Localisation.moc"
+QString Gettext::tr(const QString &textDomain, const QString &messageId,
+		const QString &localeDir) {
+	if (textDomain.isEmpty() || messageId.isEmpty()) {
+		return messageId;
+	}
+
+	const QStringList languages(Gettext::languages());
+
+	QString key(textDomain);
+	key.append(QChar(0)).append(localeDir).append(QChar(0)).append(
+			languages.join(":")).append(QChar(0)).append(messageId);
+
+	QMutexLocker lock(&m_mutex);
+
+	// an upgrade can replace a catalog while we are running
+	checkCatalogs();
+
+	const QString *cached(m_translations.object(key));
+	if (cached) {
+		return *cached;
+	}
+
+	QString directory(localeDir);
+	if (directory.isEmpty()) {
+		directory = QString::fromUtf8(
+				bindtextdomain(textDomain.toUtf8().constData(), 0));
+	}
+
+	const QByteArray id(messageId.toUtf8());
+	for (const QString &language : languages) {
+		GettextCatalog::Ptr catalog(
+				this->catalog(
+						directory + "/" + language + "/LC_MESSAGES/"
+								+ textDomain + ".mo"));
+		if (catalog) {
+			const QString translation(catalog->translate(id));
+			if (!translation.isNull()) {
+				m_translations.insert(key, new QString(translation));
+				return translation;
+			}
+		}
+	}
+
+	return messageId;
+}
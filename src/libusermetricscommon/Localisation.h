@@ -20,9 +20,15 @@
 #define USERMETRICSCOMMON_LOCALISATION_H_
 
 #include <libintl.h>
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 #include <QtCore/QSharedPointer>
 #include <QtCore/QString>
-#include <QtCore/QThread>
+#include <QtCore/QStringList>
 
 inline char * _(const char *__msgid) {
 	return dgettext(GETTEXT_PACKAGE, __msgid);
@@ -42,49 +48,120 @@ inline char * _(const char *__msgid1,
 	return dcngettext(GETTEXT_PACKAGE, __msgid1, __msgid2, __n, __category);
 }
 
-class GettextRequest: public QObject {
-Q_OBJECT
-
+/**
+ * A compiled gettext message catalog (.mo file).
+ */
+class GettextCatalog {
 public:
-	typedef QSharedPointer<GettextRequest> Ptr;
+	typedef QSharedPointer<GettextCatalog> Ptr;
 
-	QString m_textDomain;
-	QString m_messageId;
-	QString m_localeDir;
-	QString m_requestId;
+	/**
+	 * Null if the file is missing or isn't a message catalog.
+	 */
+	static Ptr load(const QString &path);
 
-Q_SIGNALS:
-	void result(const QString &result, const QString &requestId);
-};
+	/**
+	 * Null if the catalog has no translation for the message.
+	 */
+	QString translate(const QByteArray &messageId) const;
+
+	/**
+	 * The file at path is no longer the one we loaded.
+	 */
+	bool changed(const QString &path) const;
+
+protected:
+	GettextCatalog();
+
+	bool readHeader();
+
+	quint32 read(quint32 offset) const;
+
+	bool string(quint32 table, quint32 index, const char *&data,
+			quint32 &length) const;
+
+	QByteArray m_data;
+
+	bool m_swapped;
+
+	quint32 m_count;
+
+	quint32 m_originals;
 
+	quint32 m_translations;
 
-class ExternalGettext: public QObject {
-Q_OBJECT
+	QDateTime m_lastModified;
 
+	qint64 m_size;
+};
+
+/**
+ * Looks up translations in the message catalogs directly, rather than
+ * through the process-wide libintl text domain bindings.
+ */
+class Gettext {
 public:
-	typedef QSharedPointer<ExternalGettext> Ptr;
+	typedef QSharedPointer<Gettext> Ptr;
 
 	static Ptr singletonInstance();
 
-	ExternalGettext();
+	Gettext();
 
-	~ExternalGettext();
+	/**
+	 * Catalogs found to be missing are looked for again, and the ones
+	 * we have are checked for upgrades, every catalogTimeout
+	 * milliseconds.
+	 */
+	explicit Gettext(qint64 catalogTimeout);
 
-public Q_SLOTS:
-	void tr(const QString &textDomain, const QString &messageId,
-			const QString &localeDir, const QObject *who,
-			const QString &requestId);
+	~Gettext();
 
-Q_SIGNALS:
-	void newRequest(GettextRequest::Ptr request);
+	/**
+	 * Translate messageId using the catalogs for textDomain under
+	 * localeDir. Falls back to the directory bound with bindtextdomain
+	 * when localeDir is empty.
+	 */
+	QString tr(const QString &textDomain, const QString &messageId,
+			const QString &localeDir);
+
+	/**
+	 * The catalogs to try, best first, following LANGUAGE and then the
+	 * first of LC_ALL, LC_MESSAGES and LANG.
+	 */
+	static QStringList languages();
 
 protected:
-	class Priv;
+	GettextCatalog::Ptr catalog(const QString &path);
 
-	QThread m_thread;
-	QSharedPointer<Priv> p;
-};
+	/**
+	 * Forget the catalogs that have changed on disk, along with anything
+	 * we translated while we had them.
+	 */
+	void checkCatalogs();
+
+	QMutex m_mutex;
 
-Q_DECLARE_METATYPE(GettextRequest::Ptr)
+	/**
+	 * Only messages we found a translation for, as the catalog for the
+	 * others might turn up later.
+	 */
+	QCache<QString, QString> m_translations;
+
+	QHash<QString, GettextCatalog::Ptr> m_catalogs;
+
+	/**
+	 * When we last found each of these catalogs missing.
+	 */
+	QHash<QString, qint64> m_missingCatalogs;
+
+	qint64 m_catalogTimeout;
+
+	/**
+	 * When we last checked m_catalogs for upgrades.
+	 */
+	qint64 m_lastChecked;
+
+	QElapsedTimer m_clock;
+};
 
 #endif // USERMETRICSCOMMON_LOCALISATION_H_
@@ -18,11 +18,51 @@
 
 #include <libusermetricsoutput/DataSet.h>
 
+#include <QtCore/qnumeric.h>
+
+#include <cstring>
+#include <limits>
+
 using namespace std;
 using namespace UserMetricsOutput;
 
+static double toValue(const QVariant &variant) {
+	// the service sends an empty string for days with no data
+	if (variant.isNull() || variant.type() == QVariant::String) {
+		return qQNaN();
+	}
+
+	bool ok(false);
+	double value(variant.toDouble(&ok));
+	return ok ? value : qQNaN();
+}
+
+/**
+ * No branches on the data, so the compiler is free to vectorise this.
+ * NaN fails every comparison, so days without data come out as NaN.
+ */
+static void scaleValues(const double *input, double *output, int size,
+		double minimum, double maximum) {
+	if (minimum == maximum) {
+		for (int i(0); i < size; ++i) {
+			output[i] = input[i] == input[i] ? 0.5 : input[i];
+		}
+		return;
+	}
+
+	const double range(maximum - minimum);
+	for (int i(0); i < size; ++i) {
+		double value(input[i]);
+		value = value > maximum ? maximum : value;
+		value = value < minimum ? minimum : value;
+		output[i] = (value - minimum) / range;
+	}
+}
+
 DataSet::DataSet(DataSourcePtr dataSource, QObject* parent) :
-		QObject(parent), m_dataSource(dataSource) {
+		QObject(parent), m_dataSource(dataSource), m_minimum(
+				numeric_limits<double>::max()), m_maximum(
+				numeric_limits<double>::lowest()), m_dataValid(true) {
 
 	connect(m_dataSource.data(), SIGNAL(optionsChanged(const QVariantMap &)),
 			this, SLOT(optionsChanged(const QVariantMap &)));
@@ -32,9 +72,26 @@ DataSet::~DataSet() {
 }
 
 const QVariantList & DataSet::data() const {
+	if (!m_dataValid) {
+		m_data.clear();
+		m_data.reserve(m_values.size());
+		for (double value : m_values) {
+			if (qIsNaN(value)) {
+				m_data << QVariant();
+			} else {
+				m_data << value;
+			}
+		}
+		m_dataValid = true;
+	}
+
 	return m_data;
 }
 
+const QVector<double> & DataSet::values() const {
+	return m_values;
+}
+
 const QDate & DataSet::lastUpdated() const {
 	return m_lastUpdated;
 }
@@ -43,75 +100,156 @@ const QVariant & DataSet::head() const {
 	return m_head;
 }
 
-void DataSet::setData(const QVariantList &data) {
-	m_originalData = data;
-	scaleData();
+void DataSet::scale(const QVector<double> &input,
+		QVector<double> &output) const {
+	double minimum, maximum;
+	scaleRange(minimum, maximum);
+
+	output.resize(input.size());
+	scaleValues(input.constData(), output.data(), input.size(), minimum,
+			maximum);
 }
 
-void DataSet::scaleData() {
-	m_data = m_originalData;
+void DataSet::requestRange(int fromDay, int toDay, const QDate &today) {
+	// all we have is what we hold
+	rangeReady(fromDay, toDay, range(fromDay, toDay, today));
+}
 
-	const QVariantMap &options(m_dataSource->options());
+QVariantList DataSet::range(int fromDay, int toDay, const QDate &today) const {
+	const int offset(m_lastUpdated.isValid() ? m_lastUpdated.daysTo(today) : 0);
+	const int last(qMin(toDay, offset + m_originalValues.size() - 1));
 
-	bool hasMinimum(options.contains("minimum"));
-	bool hasMaximum(options.contains("maximum"));
+	QVariantList result;
+	for (int day(fromDay); day <= last; ++day) {
+		const int i(day - offset);
+		if (i < 0 || qIsNaN(m_originalValues.at(i))) {
+			result << "";
+		} else {
+			result << m_originalValues.at(i);
+		}
+	}
 
-	double min(numeric_limits<double>::max());
-	double max(numeric_limits<double>::min());
+	return result;
+}
 
-	if (hasMinimum) {
-		min = options["minimum"].toDouble();
+QVariantList DataSet::originalData() const {
+	QVariantList result;
+	result.reserve(m_originalValues.size());
+	for (double value : m_originalValues) {
+		if (qIsNaN(value)) {
+			result << QVariant();
+		} else {
+			result << value;
+		}
 	}
-	if (hasMaximum) {
-		max = options["maximum"].toDouble();
+	return result;
+}
+
+void DataSet::setData(const QVariantList &data) {
+	QVector<double> originalValues(data.size());
+	double *output(originalValues.data());
+	for (const QVariant &variant : data) {
+		*output++ = toValue(variant);
 	}
 
-	// if we need to find either the max or the min
-	if (!hasMinimum || !hasMaximum) {
-		for (QVariant &variant : m_data) {
-			if (variant.type() == QVariant::String) {
-				variant = QVariant();
-			} else if (variant.type() == QVariant::Double) {
-				double value(variant.toDouble());
-				if (!hasMinimum && value < min) {
-					min = value;
-				}
-				if (!hasMaximum && value > max) {
-					max = value;
-				}
-			}
+	// most updates are just today's value going up, in which case we
+	// can avoid rescaling everything else
+	const bool headOnly(
+			!originalValues.isEmpty()
+					&& originalValues.size() == m_originalValues.size()
+					&& memcmp(originalValues.constData() + 1,
+							m_originalValues.constData() + 1,
+							(originalValues.size() - 1) * sizeof(double))
+							== 0);
+
+	const double oldHead(
+			m_originalValues.isEmpty() ? qQNaN() : m_originalValues.first());
+	m_originalValues.swap(originalValues);
+
+	if (!headOnly) {
+		findRange();
+		scaleData();
+		return;
+	}
+
+	const double head(m_originalValues.first());
+	const double oldMinimum(m_minimum);
+	const double oldMaximum(m_maximum);
+
+	if (oldHead == m_minimum || oldHead == m_maximum) {
+		// the old head might have been the only value on the edge
+		findRange();
+	} else {
+		if (head < m_minimum) {
+			m_minimum = head;
 		}
+		if (head > m_maximum) {
+			m_maximum = head;
+		}
+	}
+
+	if (m_minimum != oldMinimum || m_maximum != oldMaximum
+			|| m_values.size() != m_originalValues.size()) {
+		scaleData();
+		return;
 	}
 
+	double minimum, maximum;
+	scaleRange(minimum, maximum);
+	scaleValues(m_originalValues.constData(), m_values.data(), 1, minimum,
+			maximum);
+
+	valuesChanged();
+}
+
+void DataSet::findRange() {
+	m_minimum = numeric_limits<double>::max();
+	m_maximum = numeric_limits<double>::lowest();
+
+	for (double value : m_originalValues) {
+		if (value < m_minimum) {
+			m_minimum = value;
+		}
+		if (value > m_maximum) {
+			m_maximum = value;
+		}
+	}
+}
+
+void DataSet::scaleRange(double &minimum, double &maximum) const {
+	const QVariantMap &options(m_dataSource->options());
+
+	auto it(options.constFind("minimum"));
+	minimum = it == options.constEnd() ? m_minimum : it->toDouble();
+
+	it = options.constFind("maximum");
+	maximum = it == options.constEnd() ? m_maximum : it->toDouble();
+}
+
+void DataSet::scaleData() {
+	double minimum, maximum;
+	scaleRange(minimum, maximum);
+
+	m_values.resize(m_originalValues.size());
+	scaleValues(m_originalValues.constData(), m_values.data(),
+			m_originalValues.size(), minimum, maximum);
+
+	valuesChanged();
+}
+
+void DataSet::valuesChanged() {
+	m_dataValid = false;
+
 	QVariant head;
-	if (m_data.isEmpty()) {
-		head = QVariant();
-	} else {
-		head = m_data.first();
+	if (!m_originalValues.isEmpty() && !qIsNaN(m_originalValues.first())) {
+		head = m_originalValues.first();
 	}
 	if (m_head != head) {
 		m_head = head;
 		headChanged(m_head);
 	}
 
-	for (QVariant &variant : m_data) {
-		if (variant.type() == QVariant::Double) {
-			if (min != max) {
-				double value(variant.toDouble());
-				if (hasMaximum && value > max) {
-					value = max;
-				}
-				if (hasMinimum && value < min) {
-					value = min;
-				}
-				variant = (value - min) / (max - min);
-			} else {
-				variant = 0.5;
-			}
-		}
-	}
-
-	dataChanged(&m_data);
+	dataChanged(&m_values);
 }
 
 void DataSet::setLastUpdated(const QDate &lastUpdated) {
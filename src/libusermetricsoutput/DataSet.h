@@ -24,6 +24,7 @@
 
 #include <QtCore/QSharedPointer>
 #include <QtCore/QVariantList>
+#include <QtCore/QVector>
 #include <QtCore/QDate>
 
 namespace UserMetricsOutput {
@@ -48,10 +49,34 @@ public:
 
 	const QVariantList & data() const;
 
+	/**
+	 * The scaled data, newest first. Days with no data are NaN.
+	 */
+	const QVector<double> & values() const;
+
 	const QDate & lastUpdated() const;
 
 	const QVariant & head() const;
 
+	/**
+	 * Scale values from elsewhere in this data set's history the same way
+	 * as values().
+	 */
+	void scale(const QVector<double> &input, QVector<double> &output) const;
+
+	/**
+	 * Ask for the values from fromDay to toDay days before today,
+	 * inclusive. The answer comes back through rangeReady, and stops
+	 * early when the history runs out.
+	 */
+	virtual void requestRange(int fromDay, int toDay, const QDate &today);
+
+	/**
+	 * The part of a range that we hold ourselves, in the form rangeReady
+	 * gives it.
+	 */
+	QVariantList range(int fromDay, int toDay, const QDate &today) const;
+
 public Q_SLOTS:
 	void update(const uint lastUpdated, const QVariantList &data);
 
@@ -64,20 +89,54 @@ public Q_SLOTS:
 Q_SIGNALS:
 	void lastUpdatedChanged(const QDate &lastUpdated);
 
-	void dataChanged(const QVariantList *data);
+	void dataChanged(const QVector<double> *values);
 
 	void headChanged(const QVariant &head);
 
+	void rangeReady(int fromDay, int toDay, const QVariantList &data);
+
+	/**
+	 * The range couldn't be fetched this time, it can be asked for again.
+	 */
+	void rangeFailed(int fromDay, int toDay);
+
 protected:
 	void scaleData();
 
+	void findRange();
+
+	void scaleRange(double &minimum, double &maximum) const;
+
+	void valuesChanged();
+
+	QVariantList originalData() const;
+
 	DataSourcePtr m_dataSource;
 
 	QDate m_lastUpdated;
 
-	QVariantList m_data;
+	/**
+	 * The data as we were given it, with anything that isn't a number
+	 * stored as NaN.
+	 */
+	QVector<double> m_originalValues;
+
+	QVector<double> m_values;
+
+	/**
+	 * The range of the original values, kept up to date as the head
+	 * changes.
+	 */
+	double m_minimum;
+
+	double m_maximum;
+
+	/**
+	 * Only built when somebody asks for the data as variants.
+	 */
+	mutable QVariantList m_data;
 
-	QVariantList m_originalData;
+	mutable bool m_dataValid;
 
 	QVariant m_head;
 
@@ -23,7 +23,7 @@ using namespace UserMetricsOutput;
 DataSource::DataSource(const QString &localeDir, QObject *parent) :
 		QObject(parent), m_formatString(""), m_formatStringTr(""), m_emptyDataString(
 				""), m_emptyDataStringTr(""), m_textDomain(""), m_localeDir(
-				localeDir), m_type(USER), m_externalGettext(ExternalGettext::singletonInstance()) {
+				localeDir), m_type(USER), m_gettext(Gettext::singletonInstance()) {
 }
 
 DataSource::~DataSource() {
@@ -33,24 +33,13 @@ const QString & DataSource::formatString() const {
 	return m_formatStringTr;
 }
 
-void DataSource::translationResult(const QString &result, const QString &requestId)
-{
-	if (requestId == "format-string") {
-		if (result != m_formatStringTr) {
-			m_formatStringTr = result;
-			formatStringChanged (m_formatStringTr);
-		}
-	} else if (requestId == "empty-data-string") {
-		if (result != m_emptyDataStringTr) {
-			m_emptyDataStringTr = result;
-			emptyDataStringChanged(m_emptyDataStringTr);
-		}
-	}
-}
-
 void DataSource::updateFormatStringTranslation() {
-	m_externalGettext->tr(m_textDomain, m_formatString,
-			m_localeDir, this, "format-string");
+	const QString translation(
+			m_gettext->tr(m_textDomain, m_formatString, m_localeDir));
+	if (translation != m_formatStringTr) {
+		m_formatStringTr = translation;
+		formatStringChanged(m_formatStringTr);
+	}
 }
 
 void DataSource::setFormatString(const QString &formatString) {
@@ -61,8 +50,12 @@ void DataSource::setFormatString(const QString &formatString) {
 }
 
 void DataSource::updateEmptyDataStringTranslation() {
-	m_externalGettext->tr(m_textDomain, m_emptyDataString,
-				m_localeDir, this, "empty-data-string");
+	const QString translation(
+			m_gettext->tr(m_textDomain, m_emptyDataString, m_localeDir));
+	if (translation != m_emptyDataStringTr) {
+		m_emptyDataStringTr = translation;
+		emptyDataStringChanged(m_emptyDataStringTr);
+	}
 }
 
 const QString & DataSource::emptyDataString() const {
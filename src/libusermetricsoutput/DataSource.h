@@ -87,9 +87,6 @@ Q_SIGNALS:
 
 	void optionsChanged(const QVariantMap &options);
 
-protected Q_SLOTS:
-	void translationResult(const QString &result, const QString &requestId);
-
 protected:
 	void updateFormatStringTranslation();
 
@@ -111,7 +108,7 @@ protected:
 
 	QVariantMap m_options;
 
-	ExternalGettext::Ptr m_externalGettext;
+	Gettext::Ptr m_gettext;
 };
 
 }
@@ -22,7 +22,9 @@
 
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
+#include <QtCore/QDateTime>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QString>
 #include <QtCore/QVariant>
 
@@ -33,8 +35,22 @@ using namespace UserMetricsOutput;
 
 static const QString THEME_PATH("/libusermetrics/themes/");
 
+static qint64 lastModified(const QFileInfo &fileInfo) {
+	return fileInfo.lastModified().toMSecsSinceEpoch();
+}
+
 GSettingsColorThemeProvider::GSettingsColorThemeProvider(QObject *parent) :
 		ColorThemeProvider(parent) {
+	init();
+}
+
+GSettingsColorThemeProvider::GSettingsColorThemeProvider(
+		SnapshotCachePtr cache, QObject *parent) :
+		ColorThemeProvider(parent), m_cache(cache) {
+	init();
+}
+
+void GSettingsColorThemeProvider::init() {
 	if (qEnvironmentVariableIsSet("XDG_DATA_DIRS")) {
 		m_baseDirs = QString::fromUtf8(qgetenv("XDG_DATA_DIRS")).split(':');
 	}
@@ -46,12 +62,12 @@ GSettingsColorThemeProvider::GSettingsColorThemeProvider(QObject *parent) :
 	for (const QString &baseDir : m_baseDirs) {
 		QString schemaFile(QDir(baseDir).filePath("color-theme.xsd"));
 		if (QFile::exists(schemaFile)) {
-			m_schema.load(QUrl::fromLocalFile(schemaFile));
+			m_schemaFile = schemaFile;
 			break;
 		}
 	}
 
-	if (m_schema.isValid()) {
+	if (!m_schemaFile.isEmpty()) {
 		if (qEnvironmentVariableIsSet("USERMETRICS_NO_COLOR_SETTINGS")) {
 			loadXmlColors("default");
 		} else {
@@ -66,12 +82,61 @@ GSettingsColorThemeProvider::GSettingsColorThemeProvider(QObject *parent) :
 	} else {
 		loadBlankColors();
 	}
+
+	restoreAssignments();
 }
 
 GSettingsColorThemeProvider::~GSettingsColorThemeProvider() {
 }
 
+void GSettingsColorThemeProvider::restoreAssignments() {
+	if (m_cache.isNull()) {
+		return;
+	}
+
+	// keep everything the same colour it was last time, as long as the
+	// theme hasn't changed in the meantime
+	const QVariantMap cached(m_cache->section("colorThemes"));
+	if (cached.isEmpty() || cached["theme"].toString() != m_theme) {
+		return;
+	}
+
+	const QVariantMap assignments(cached["assignments"].toMap());
+	for (auto it(assignments.constBegin()); it != assignments.constEnd();
+			++it) {
+		int index(it.value().toInt());
+		if (index >= 0 && index < m_colorThemes.size()) {
+			m_colorThemeMap.insert(it.key(), m_colorThemes.at(index));
+		}
+	}
+
+	int next(cached["next"].toInt());
+	if (next >= 0 && next < m_colorThemes.size()) {
+		m_color = m_colorThemes.constBegin() + next;
+	}
+}
+
+void GSettingsColorThemeProvider::saveAssignments() {
+	if (m_cache.isNull()) {
+		return;
+	}
+
+	QVariantMap assignments;
+	for (map_const_iterator it(m_colorThemeMap.constBegin());
+			it != m_colorThemeMap.constEnd(); ++it) {
+		assignments[it.key()] = m_colorThemes.indexOf(*it);
+	}
+
+	QVariantMap cached;
+	cached["theme"] = m_theme;
+	cached["assignments"] = assignments;
+	cached["next"] = int(m_color - m_colorThemes.constBegin());
+
+	m_cache->setSection("colorThemes", cached);
+}
+
 void GSettingsColorThemeProvider::loadBlankColors() {
+	m_theme.clear();
 	ColorThemePtr blankTheme(
 			ColorThemePtr(new ColorThemeImpl(QColor(), QColor(), QColor())));
 	m_colorThemes << ColorThemePtrPair(blankTheme, blankTheme);
@@ -84,7 +149,7 @@ QString GSettingsColorThemeProvider::convertPath(const QString &base,
 }
 
 void GSettingsColorThemeProvider::loadXmlColors(const QString &theme) {
-	QXmlSchemaValidator validator(m_schema);
+	m_theme = theme;
 
 	QFile file;
 
@@ -103,13 +168,20 @@ void GSettingsColorThemeProvider::loadXmlColors(const QString &theme) {
 		return;
 	}
 
-	if (!validator.validate(&file, QUrl::fromLocalFile(file.fileName()))) {
+	const QFileInfo fileInfo(file);
+	if (loadCompiledColors(fileInfo)) {
+		m_color = m_colorThemes.begin();
+		return;
+	}
+
+	if (!validate(file)) {
 		loadBlankColors();
 		return;
 	}
 
 	file.reset();
 	QXmlStreamReader xml(&file);
+	QVariantList themes;
 
 	while (!xml.atEnd() && !xml.hasError()) {
 		QXmlStreamReader::TokenType token = xml.readNext();
@@ -126,23 +198,102 @@ void GSettingsColorThemeProvider::loadXmlColors(const QString &theme) {
 			}
 
 			if (xml.name() == "theme") {
-				parseTheme(xml);
+				parseTheme(xml, themes);
 			}
 		}
 	}
 
+	saveCompiledColors(fileInfo, themes);
+
 	m_color = m_colorThemes.begin();
 }
 
-void GSettingsColorThemeProvider::parseTheme(QXmlStreamReader & xml) {
+bool GSettingsColorThemeProvider::validate(QFile &file) {
+	if (m_schema.isNull()) {
+		m_schema.reset(new QXmlSchema);
+		m_schema->load(QUrl::fromLocalFile(m_schemaFile));
+	}
+
+	if (!m_schema->isValid()) {
+		return false;
+	}
+
+	QXmlSchemaValidator validator(*m_schema);
+	return validator.validate(&file, QUrl::fromLocalFile(file.fileName()));
+}
+
+bool GSettingsColorThemeProvider::loadCompiledColors(
+		const QFileInfo &fileInfo) {
+	if (m_cache.isNull()) {
+		return false;
+	}
+
+	const QVariantMap compiled(
+			m_cache->section("colorThemeFiles")[fileInfo.absoluteFilePath()].toMap());
+
+	// a change to the schema could change what's valid
+	if (compiled.isEmpty()
+			|| compiled["modified"].toLongLong() != lastModified(fileInfo)
+			|| compiled["size"].toLongLong() != fileInfo.size()
+			|| compiled["schema"].toString() != m_schemaFile
+			|| compiled["schemaModified"].toLongLong()
+					!= lastModified(QFileInfo(m_schemaFile))) {
+		return false;
+	}
+
+	const QVariantList themes(compiled["themes"].toList());
+	if (themes.isEmpty()) {
+		return false;
+	}
+
+	for (const QVariant &theme : themes) {
+		addTheme(theme.toStringList());
+	}
+	return true;
+}
+
+void GSettingsColorThemeProvider::saveCompiledColors(
+		const QFileInfo &fileInfo, const QVariantList &themes) {
+	if (m_cache.isNull()) {
+		return;
+	}
+
+	QVariantMap compiled;
+	compiled["modified"] = lastModified(fileInfo);
+	compiled["size"] = fileInfo.size();
+	compiled["schema"] = m_schemaFile;
+	compiled["schemaModified"] = lastModified(QFileInfo(m_schemaFile));
+	compiled["themes"] = themes;
+
+	QVariantMap files(m_cache->section("colorThemeFiles"));
+	files[fileInfo.absoluteFilePath()] = compiled;
+	m_cache->setSection("colorThemeFiles", files);
+}
+
+void GSettingsColorThemeProvider::addTheme(const QStringList &colors) {
+	if (colors.size() != 6) {
+		return;
+	}
+
+	ColorThemePtr foregroundTheme(
+			new ColorThemeImpl(QColor(colors.at(0)), QColor(colors.at(1)),
+					QColor(colors.at(2))));
+	ColorThemePtr backgroundTheme(
+			new ColorThemeImpl(QColor(colors.at(3)), QColor(colors.at(4)),
+					QColor(colors.at(5))));
+	m_colorThemes << ColorThemePtrPair(foregroundTheme, backgroundTheme);
+}
+
+void GSettingsColorThemeProvider::parseTheme(QXmlStreamReader & xml,
+		QVariantList &themes) {
 	/* Let's check that we're really getting a theme. */
 	if (xml.tokenType() != QXmlStreamReader::StartElement
 			&& xml.name() == "theme") {
 		return;
 	}
 
-	ColorThemePtr foregroundTheme;
-	ColorThemePtr backgroundTheme;
+	QStringList foregroundColors;
+	QStringList backgroundColors;
 
 	xml.readNext();
 
@@ -159,16 +310,15 @@ void GSettingsColorThemeProvider::parseTheme(QXmlStreamReader & xml) {
 					&& attributes.hasAttribute("main")
 					&& attributes.hasAttribute("end")) {
 
-				ColorThemePtr theme(
-						new ColorThemeImpl(
-								QColor(attributes.value("start").toString()),
-								QColor(attributes.value("main").toString()),
-								QColor(attributes.value("end").toString())));
+				QStringList colors;
+				colors << attributes.value("start").toString()
+						<< attributes.value("main").toString()
+						<< attributes.value("end").toString();
 
 				if (xml.name() == "foreground") {
-					foregroundTheme = theme;
+					foregroundColors = colors;
 				} else if (xml.name() == "background") {
-					backgroundTheme = theme;
+					backgroundColors = colors;
 				}
 			}
 
@@ -176,8 +326,10 @@ void GSettingsColorThemeProvider::parseTheme(QXmlStreamReader & xml) {
 		xml.readNext();
 	}
 
-	if (!foregroundTheme.isNull() && !backgroundTheme.isNull()) {
-		m_colorThemes << ColorThemePtrPair(foregroundTheme, backgroundTheme);
+	if (!foregroundColors.isEmpty() && !backgroundColors.isEmpty()) {
+		const QStringList colors(foregroundColors + backgroundColors);
+		addTheme(colors);
+		themes << colors;
 	}
 }
 
@@ -196,6 +348,7 @@ ColorThemePtrPair GSettingsColorThemeProvider::getColorTheme(
 		}
 
 		m_colorThemeMap.insert(dataSetId, result);
+		saveAssignments();
 	} else {
 		// there was a mapped value
 		result = *it;
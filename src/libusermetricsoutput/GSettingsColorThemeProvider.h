@@ -21,6 +21,7 @@
 
 #include <libusermetricsoutput/ColorTheme.h>
 #include <libusermetricsoutput/ColorThemeProvider.h>
+#include <libusermetricsoutput/SnapshotCache.h>
 
 #include <QtCore/QMap>
 #include <QtCore/QVector>
@@ -30,6 +31,9 @@
 #include <QGSettings/QGSettings>
 #include <QtXmlPatterns/QXmlSchema>
 
+class QFile;
+class QFileInfo;
+
 namespace UserMetricsOutput {
 
 class GSettingsColorThemeProvider: public ColorThemeProvider {
@@ -45,6 +49,8 @@ public:
 
 	GSettingsColorThemeProvider(QObject *parent = 0);
 
+	GSettingsColorThemeProvider(SnapshotCachePtr cache, QObject *parent = 0);
+
 	virtual ~GSettingsColorThemeProvider();
 
 	virtual ColorThemePtrPair getColorTheme(const QString& dataSetId);
@@ -53,17 +59,40 @@ protected Q_SLOTS:
 	void changed(const QString &key);
 
 protected:
+	void init();
+
+	void restoreAssignments();
+
+	void saveAssignments();
+
 	void loadXmlColors(const QString &theme);
 
 	void loadBlankColors();
 
-	void parseTheme(QXmlStreamReader & xml);
+	bool validate(QFile &file);
+
+	/**
+	 * Use the themes we parsed from this file last time, if it hasn't
+	 * changed since.
+	 */
+	bool loadCompiledColors(const QFileInfo &file);
+
+	void saveCompiledColors(const QFileInfo &file, const QVariantList &themes);
+
+	void addTheme(const QStringList &colors);
+
+	void parseTheme(QXmlStreamReader & xml, QVariantList &themes);
 
 	QString convertPath(const QString &base, const QString& theme);
 
 	QStringList m_baseDirs;
 
-	QXmlSchema m_schema;
+	QString m_schemaFile;
+
+	/**
+	 * Only loaded when a theme file needs validating.
+	 */
+	QScopedPointer<QXmlSchema> m_schema;
 
 	ColorThemeList m_colorThemes;
 
@@ -72,6 +101,10 @@ protected:
 	ColorThemeMap m_colorThemeMap;
 
 	QScopedPointer<QGSettings> m_settings;
+
+	QString m_theme;
+
+	SnapshotCachePtr m_cache;
 };
 
 }
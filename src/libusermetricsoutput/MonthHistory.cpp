@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricsoutput/MonthHistory.h>
+
+#include <QtCore/qnumeric.h>
+
+using namespace UserMetricsOutput;
+using namespace UserMetricsCommon;
+
+MonthHistory::MonthHistory(QSharedPointer<DateFactory> dateFactory,
+		DataSetPtr dataSet, QObject *parent) :
+		QAbstractListModel(parent), m_dateFactory(dateFactory), m_dataSet(
+				dataSet), m_today(m_dateFactory->currentDate()), m_rows(0), m_lastMonth(
+				-1), m_pages(DEFAULT_CACHE_SIZE) {
+	// data sets that already hold the answer give it straight away, so
+	// don't let it arrive while a view is still asking us for data
+	connect(m_dataSet.data(),
+			SIGNAL(rangeReady(int, int, const QVariantList &)), this,
+			SLOT(rangeReady(int, int, const QVariantList &)),
+			Qt::QueuedConnection);
+	connect(m_dataSet.data(), SIGNAL(rangeFailed(int, int)), this,
+			SLOT(rangeFailed(int, int)), Qt::QueuedConnection);
+	connect(m_dataSet.data(), SIGNAL(dataChanged(const QVector<double> *)),
+			this, SLOT(dataSetChanged()));
+}
+
+MonthHistory::~MonthHistory() {
+}
+
+void MonthHistory::setCacheSize(int months) {
+	m_pages.setMaxCost(qMax(1, months));
+}
+
+int MonthHistory::rowCount(const QModelIndex &parent) const {
+	if (parent.isValid()) {
+		return 0;
+	}
+	return m_rows;
+}
+
+QVariant MonthHistory::data(const QModelIndex &index, int role) const {
+	if (!index.isValid() || index.row() >= m_rows) {
+		return QVariant();
+	}
+
+	const int row(index.row());
+
+	switch (role) {
+	case MonthRole:
+		return month(row);
+	case LoadedRole:
+		return m_pages.contains(row);
+	case ValuesRole: {
+		const Page *page(m_pages.object(row));
+		if (!page) {
+			requestPage(row);
+			requestPage(row + 1);
+			return QVariant();
+		}
+
+		QVector<double> scaled;
+		m_dataSet->scale(*page, scaled);
+
+		QVariantList values;
+		values.reserve(scaled.size());
+		for (double value : scaled) {
+			if (qIsNaN(value)) {
+				values << QVariant();
+			} else {
+				values << value;
+			}
+		}
+		return values;
+	}
+	}
+
+	return QVariant();
+}
+
+QHash<int, QByteArray> MonthHistory::roleNames() const {
+	QHash<int, QByteArray> roles;
+	roles[MonthRole] = "month";
+	roles[ValuesRole] = "values";
+	roles[LoadedRole] = "loaded";
+	return roles;
+}
+
+bool MonthHistory::canFetchMore(const QModelIndex &parent) const {
+	if (parent.isValid()) {
+		return false;
+	}
+	if (m_lastMonth != -1 && m_rows > m_lastMonth) {
+		return false;
+	}
+	return !m_pending.contains(m_rows);
+}
+
+void MonthHistory::fetchMore(const QModelIndex &parent) {
+	if (!canFetchMore(parent)) {
+		return;
+	}
+
+	if (!m_pages.contains(m_rows)) {
+		// the row appears when its page does
+		requestPage(m_rows);
+		return;
+	}
+
+	// we already have it from prefetching
+	beginInsertRows(QModelIndex(), m_rows, m_rows);
+	++m_rows;
+	endInsertRows();
+
+	requestPage(m_rows);
+}
+
+QDate MonthHistory::month(int monthsAgo) const {
+	return QDate(m_today.year(), m_today.month(), 1).addMonths(-monthsAgo);
+}
+
+int MonthHistory::monthOfDay(int daysAgo) const {
+	const QDate first(m_today.addDays(-daysAgo));
+	return (m_today.year() - first.year()) * 12 + m_today.month()
+			- first.month();
+}
+
+MonthHistory::Page * MonthHistory::buildPage(int fromDay, int toDay,
+		const QVariantList &data) const {
+	const QDate first(m_today.addDays(-toDay));
+
+	Page *page(new Page(first.daysInMonth(), qQNaN()));
+	for (int i(0); i < data.size(); ++i) {
+		const QVariant &variant(data.at(i));
+		if (variant.type() != QVariant::String) {
+			const QDate date(m_today.addDays(-(fromDay + i)));
+			(*page)[date.day() - 1] = variant.toDouble();
+		}
+	}
+	return page;
+}
+
+void MonthHistory::requestPage(int monthsAgo) const {
+	if (m_pending.contains(monthsAgo) || m_pages.contains(monthsAgo)) {
+		return;
+	}
+	if (m_lastMonth != -1 && monthsAgo > m_lastMonth) {
+		return;
+	}
+
+	m_pending << monthsAgo;
+
+	const QDate first(month(monthsAgo));
+	QDate last(first.addDays(first.daysInMonth() - 1));
+	if (last > m_today) {
+		last = m_today;
+	}
+
+	m_dataSet->requestRange(last.daysTo(m_today), first.daysTo(m_today),
+			m_today);
+}
+
+void MonthHistory::rangeReady(int fromDay, int toDay,
+		const QVariantList &data) {
+	const int monthsAgo(monthOfDay(toDay));
+
+	if (!m_pending.remove(monthsAgo)) {
+		// not ours, or from before a reset
+		return;
+	}
+
+	Page *page(buildPage(fromDay, toDay, data));
+
+	// a short answer means the history ran out in this month
+	if (data.size() < toDay - fromDay + 1) {
+		const int lastMonth(
+				data.isEmpty() && monthsAgo > 0 ? monthsAgo - 1 : monthsAgo);
+		if (m_lastMonth == -1 || lastMonth < m_lastMonth) {
+			m_lastMonth = lastMonth;
+		}
+	}
+
+	if (m_lastMonth != -1 && monthsAgo > m_lastMonth) {
+		delete page;
+		return;
+	}
+
+	m_pages.insert(monthsAgo, page);
+
+	if (monthsAgo < m_rows) {
+		Q_EMIT dataChanged(index(monthsAgo), index(monthsAgo),
+				QVector<int>() << ValuesRole << LoadedRole);
+	} else if (monthsAgo == m_rows) {
+		beginInsertRows(QModelIndex(), m_rows, m_rows);
+		++m_rows;
+		endInsertRows();
+
+		// stay one page ahead
+		requestPage(m_rows);
+	}
+}
+
+void MonthHistory::rangeFailed(int fromDay, int toDay) {
+	Q_UNUSED(fromDay);
+
+	// nothing learnt about the history, so the month can be asked for
+	// again the next time somebody wants it
+	m_pending.remove(monthOfDay(toDay));
+}
+
+void MonthHistory::dataSetChanged() {
+	const QDate today(m_dateFactory->currentDate());
+
+	if (today != m_today) {
+		// every row has moved
+		beginResetModel();
+		m_today = today;
+		m_rows = 0;
+		m_lastMonth = -1;
+		m_pages.clear();
+		m_pending.clear();
+		endResetModel();
+		return;
+	}
+
+	// only this month's values can have changed, and the data set holds
+	// all of those itself, but the scale applies to every month
+	if (m_pages.contains(0)) {
+		const int toDay(month(0).daysTo(m_today));
+		m_pages.insert(0, buildPage(0, toDay, m_dataSet->range(0, toDay,
+				m_today)));
+	}
+	if (m_rows > 0) {
+		Q_EMIT dataChanged(index(0), index(m_rows - 1),
+				QVector<int>() << ValuesRole << LoadedRole);
+	}
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSOUTPUT_MONTHHISTORY_H_
+#define USERMETRICSOUTPUT_MONTHHISTORY_H_
+
+#include <libusermetricsoutput/DataSet.h>
+#include <libusermetricscommon/DateFactory.h>
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QCache>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+
+namespace UserMetricsOutput {
+
+/**
+ * A data set's history one calendar month per row, the current month
+ * first.
+ *
+ * Each month is a page fetched from the data set when it is first
+ * wanted, and the month after it is fetched at the same time so
+ * scrolling back finds it ready. Only a bounded number of pages are kept;
+ * a month that has been dropped is fetched again if it is looked at.
+ */
+class MonthHistory: public QAbstractListModel {
+Q_OBJECT
+
+public:
+	enum Roles {
+		MonthRole = Qt::UserRole + 1, ValuesRole, LoadedRole
+	};
+
+	static const int DEFAULT_CACHE_SIZE = 12;
+
+	MonthHistory(QSharedPointer<UserMetricsCommon::DateFactory> dateFactory,
+			DataSetPtr dataSet, QObject *parent = 0);
+
+	virtual ~MonthHistory();
+
+	void setCacheSize(int months);
+
+	virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+	virtual QVariant data(const QModelIndex &index, int role =
+			Qt::DisplayRole) const;
+
+	virtual QHash<int, QByteArray> roleNames() const;
+
+	virtual bool canFetchMore(const QModelIndex &parent) const;
+
+	virtual void fetchMore(const QModelIndex &parent);
+
+protected Q_SLOTS:
+	void rangeReady(int fromDay, int toDay, const QVariantList &data);
+
+	void rangeFailed(int fromDay, int toDay);
+
+	void dataSetChanged();
+
+protected:
+	/**
+	 * The raw values of one month, indexed by day of the month.
+	 */
+	typedef QVector<double> Page;
+
+	QDate month(int monthsAgo) const;
+
+	/**
+	 * How many months ago the day daysAgo days before today falls.
+	 */
+	int monthOfDay(int daysAgo) const;
+
+	Page * buildPage(int fromDay, int toDay, const QVariantList &data) const;
+
+	void requestPage(int monthsAgo) const;
+
+	QSharedPointer<UserMetricsCommon::DateFactory> m_dateFactory;
+
+	DataSetPtr m_dataSet;
+
+	QDate m_today;
+
+	int m_rows;
+
+	/**
+	 * The oldest month with any history, or -1 until we find it.
+	 */
+	int m_lastMonth;
+
+	mutable QCache<int, Page> m_pages;
+
+	/**
+	 * Months asked for but not yet answered.
+	 */
+	mutable QSet<int> m_pending;
+};
+
+}
+
+#endif // USERMETRICSOUTPUT_MONTHHISTORY_H_
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricsoutput/MonthModel.h>
+
+#include <QtCore/qnumeric.h>
+
+#include <algorithm>
+
+using namespace UserMetricsOutput;
+
+MonthModel::MonthModel(QObject *parent) :
+		QAbstractListModel(parent), m_daysInMonth(0), m_valid(0) {
+	std::fill(m_values, m_values + MAXIMUM_DAYS, 0.0);
+}
+
+MonthModel::~MonthModel() {
+}
+
+int MonthModel::rowCount(const QModelIndex &parent) const {
+	if (parent.isValid()) {
+		return 0;
+	}
+
+	return m_daysInMonth;
+}
+
+QVariant MonthModel::data(const QModelIndex &index, int role) const {
+	const int day(index.row());
+	if (day < 0 || day >= m_daysInMonth) {
+		return QVariant();
+	}
+
+	switch (role) {
+	case Qt::DisplayRole:
+		// the untyped role the calendar has always used
+		if (isNull(day)) {
+			return QVariant();
+		}
+		return m_values[day];
+	case ValueRole:
+		return m_values[day];
+	case IsNullRole:
+		return isNull(day);
+	case DateRole:
+		return QDate(m_month.year(), m_month.month(), day + 1);
+	}
+
+	return QVariant();
+}
+
+QHash<int, QByteArray> MonthModel::roleNames() const {
+	QHash<int, QByteArray> roles;
+	roles[Qt::DisplayRole] = "modelData";
+	roles[ValueRole] = "value";
+	roles[IsNullRole] = "isNull";
+	roles[DateRole] = "date";
+	return roles;
+}
+
+const QDate & MonthModel::month() const {
+	return m_month;
+}
+
+bool MonthModel::isNull(int day) const {
+	return !(m_valid & (1u << day));
+}
+
+double MonthModel::value(int day) const {
+	return m_values[day];
+}
+
+void MonthModel::update(const QDate &month, int dayOfMonth,
+		QVector<double>::const_iterator &dataIndex,
+		const QVector<double>::const_iterator &dataEnd) {
+	const int daysInMonth(month.daysInMonth());
+	dayOfMonth = qBound(0, dayOfMonth, daysInMonth);
+
+	double values[MAXIMUM_DAYS];
+	quint32 valid(0);
+	std::fill(values, values + MAXIMUM_DAYS, 0.0);
+
+	// the data is newest first, so we fill backwards from today
+	for (int day(dayOfMonth - 1); day >= 0 && dataIndex != dataEnd;
+			--day, ++dataIndex) {
+		if (!qIsNaN(*dataIndex)) {
+			values[day] = *dataIndex;
+			valid |= 1u << day;
+		}
+	}
+	// any days we ran out of data for are already null
+
+	const QDate firstDay(month.year(), month.month(), 1);
+	// every date moves if we're showing a different month
+	const bool moved(firstDay != m_month);
+
+	// drop the days this month doesn't have
+	if (daysInMonth < m_daysInMonth) {
+		beginRemoveRows(QModelIndex(), daysInMonth, m_daysInMonth - 1);
+		m_daysInMonth = daysInMonth;
+		endRemoveRows();
+	}
+
+	const int oldDaysInMonth(m_daysInMonth);
+	const quint32 oldValid(m_valid);
+	double oldValues[MAXIMUM_DAYS];
+	std::copy(m_values, m_values + MAXIMUM_DAYS, oldValues);
+
+	m_month = firstDay;
+	std::copy(values, values + MAXIMUM_DAYS, m_values);
+	m_valid = valid;
+
+	// only tell the views about the runs of days that actually changed,
+	// usually that's just today
+	int first(-1);
+	for (int day(0); day <= oldDaysInMonth; ++day) {
+		bool changed(false);
+		if (day < oldDaysInMonth) {
+			const quint32 bit(1u << day);
+			changed = moved || (oldValid & bit) != (valid & bit)
+					|| ((valid & bit) && oldValues[day] != values[day]);
+		}
+
+		if (changed && first < 0) {
+			first = day;
+		} else if (!changed && first >= 0) {
+			dataChanged(index(first), index(day - 1));
+			first = -1;
+		}
+	}
+
+	// and add the days the old month didn't have
+	if (daysInMonth > oldDaysInMonth) {
+		beginInsertRows(QModelIndex(), oldDaysInMonth, daysInMonth - 1);
+		m_daysInMonth = daysInMonth;
+		endInsertRows();
+	}
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSOUTPUT_MONTHMODEL_H_
+#define USERMETRICSOUTPUT_MONTHMODEL_H_
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QDate>
+#include <QtCore/QVector>
+
+namespace UserMetricsOutput {
+
+/**
+ * One calendar month of data, one row per day.
+ *
+ * The values live in a fixed size array with a bitmap marking which days
+ * have data, so filling the model doesn't allocate anything. Updates only
+ * signal the days that changed.
+ */
+class MonthModel: public QAbstractListModel {
+Q_OBJECT
+
+public:
+	enum Roles {
+		ValueRole = Qt::UserRole + 1, IsNullRole, DateRole
+	};
+
+	static const int MAXIMUM_DAYS = 31;
+
+	explicit MonthModel(QObject *parent = 0);
+
+	virtual ~MonthModel();
+
+	virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+	virtual QVariant data(const QModelIndex &index, int role =
+			Qt::DisplayRole) const;
+
+	virtual QHash<int, QByteArray> roleNames() const;
+
+	const QDate & month() const;
+
+	bool isNull(int day) const;
+
+	double value(int day) const;
+
+	/**
+	 * Fills the first dayOfMonth days of the given month from the data,
+	 * which is ordered newest first with NaN for days without data. The iterator is left pointing at the
+	 * first value that wasn't used, ready for the month before.
+	 */
+	void update(const QDate &month, int dayOfMonth,
+			QVector<double>::const_iterator &dataIndex,
+			const QVector<double>::const_iterator &dataEnd);
+
+protected:
+	QDate m_month;
+
+	int m_daysInMonth;
+
+	double m_values[MAXIMUM_DAYS];
+
+	quint32 m_valid;
+};
+
+}
+
+#endif // USERMETRICSOUTPUT_MONTHMODEL_H_
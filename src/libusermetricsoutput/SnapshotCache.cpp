@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricsoutput/SnapshotCache.h>
+#include <libusermetricscommon/Localisation.h>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+using namespace UserMetricsOutput;
+
+static const quint32 CACHE_MAGIC(0x554d5343);
+
+static const quint32 CACHE_VERSION(1);
+
+SnapshotCache::SnapshotCache(const QString &path, QObject *parent) :
+		QObject(parent), m_path(path) {
+	// writes are coalesced, as the state changes in bursts
+	m_saveTimer.setSingleShot(true);
+	m_saveTimer.setInterval(1000);
+	connect(&m_saveTimer, SIGNAL(timeout()), this, SLOT(save()));
+
+	load();
+}
+
+SnapshotCache::~SnapshotCache() {
+	if (m_saveTimer.isActive()) {
+		save();
+	}
+}
+
+QString SnapshotCache::defaultPath() {
+	return QDir(
+			QStandardPaths::writableLocation(
+					QStandardPaths::GenericCacheLocation)).filePath(
+			"libusermetrics/snapshot.cache");
+}
+
+QVariantMap SnapshotCache::section(const QString &name) const {
+	return m_sections[name].toMap();
+}
+
+void SnapshotCache::setSection(const QString &name, const QVariantMap &value) {
+	m_sections[name] = value;
+	m_saveTimer.start();
+}
+
+void SnapshotCache::load() {
+	QFile file(m_path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic, version;
+	stream >> magic >> version;
+	if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+		return;
+	}
+
+	QVariantMap sections;
+	stream >> sections;
+	if (stream.status() != QDataStream::Ok) {
+		qWarning() << _("Ignoring corrupt cache file") << " [" << m_path
+				<< "]";
+		return;
+	}
+
+	m_sections = sections;
+}
+
+void SnapshotCache::save() {
+	m_saveTimer.stop();
+
+	QDir().mkpath(QFileInfo(m_path).absolutePath());
+
+	QSaveFile file(m_path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << _("Cannot open cache file for writing") << " ["
+				<< m_path << "]";
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+	stream << CACHE_MAGIC << CACHE_VERSION << m_sections;
+
+	if (!file.commit()) {
+		qWarning() << _("Could not write cache file") << " [" << m_path
+				<< "]";
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSOUTPUT_SNAPSHOTCACHE_H_
+#define USERMETRICSOUTPUT_SNAPSHOTCACHE_H_
+
+#include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/QTimer>
+#include <QtCore/QVariantMap>
+
+namespace UserMetricsOutput {
+
+class SnapshotCache;
+
+typedef QSharedPointer<SnapshotCache> SnapshotCachePtr;
+
+/**
+ * Keeps the last known state on disk, so that it can be shown straight
+ * away next time, while the live data is still being fetched.
+ */
+class SnapshotCache: public QObject {
+Q_OBJECT
+
+public:
+	explicit SnapshotCache(const QString &path, QObject *parent = 0);
+
+	virtual ~SnapshotCache();
+
+	static QString defaultPath();
+
+	virtual QVariantMap section(const QString &name) const;
+
+	virtual void setSection(const QString &name, const QVariantMap &value);
+
+public Q_SLOTS:
+	void save();
+
+protected:
+	void load();
+
+	QString m_path;
+
+	QVariantMap m_sections;
+
+	QTimer m_saveTimer;
+};
+
+}
+
+#endif // USERMETRICSOUTPUT_SNAPSHOTCACHE_H_
@@ -17,18 +17,65 @@
  */
 
 #include <libusermetricsoutput/SyncedDataSet.h>
+#include <libusermetricscommon/Localisation.h>
+
+#include <QtCore/QDebug>
+#include <QtDBus/QDBusPendingReply>
 
 using namespace UserMetricsOutput;
 
 SyncedDataSet::SyncedDataSet(
 		QSharedPointer<com::canonical::usermetrics::DataSet> interface,
-		DataSourcePtr dataSource, QObject *parent) :
+		DataSourcePtr dataSource, const QVariantMap &properties,
+		QObject *parent) :
 		DataSet(dataSource, parent), m_interface(interface) {
 
 	connect(m_interface.data(), SIGNAL(updated(uint, const QVariantList &)),
 			this, SLOT(update(uint, const QVariantList &)));
-	update(m_interface->lastUpdated(), m_interface->data());
+	update(properties["lastUpdated"].toUInt(), properties["data"].toList());
 }
 
 SyncedDataSet::~SyncedDataSet() {
 }
+
+QString SyncedDataSet::path() const {
+	return m_interface->path();
+}
+
+QVariantMap SyncedDataSet::properties() const {
+	QVariantMap result;
+	result["lastUpdated"] = QDateTime(m_lastUpdated).toTime_t();
+	result["data"] = originalData();
+	return result;
+}
+
+void SyncedDataSet::requestRange(int fromDay, int toDay, const QDate &today) {
+	Q_UNUSED(today);
+
+	QDBusPendingCallWatcher *watcher(
+			new QDBusPendingCallWatcher(m_interface->dataRange(fromDay, toDay),
+					this));
+	watcher->setProperty("fromDay", fromDay);
+	watcher->setProperty("toDay", toDay);
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)), this,
+			SLOT(rangeFinished(QDBusPendingCallWatcher *)));
+}
+
+void SyncedDataSet::rangeFinished(QDBusPendingCallWatcher *watcher) {
+	watcher->deleteLater();
+
+	const int fromDay(watcher->property("fromDay").toInt());
+	const int toDay(watcher->property("toDay").toInt());
+
+	QDBusPendingReply<QVariantList> reply(*watcher);
+	if (reply.isError()) {
+		qWarning() << _("Failed to fetch data range:")
+				<< reply.error().message();
+		// not the same as an empty answer, which means the history ran out
+		rangeFailed(fromDay, toDay);
+		return;
+	}
+
+	// an empty answer tells the caller there is nothing more to have
+	rangeReady(fromDay, toDay, reply.value());
+}
@@ -22,6 +22,8 @@
 #include <libusermetricsoutput/DataSet.h>
 #include <libusermetricscommon/DataSetInterface.h>
 
+#include <QtDBus/QDBusPendingCallWatcher>
+
 namespace UserMetricsOutput {
 
 class SyncedDataSet: public DataSet {
@@ -30,10 +32,20 @@ Q_OBJECT
 public:
 	explicit SyncedDataSet(
 			QSharedPointer<com::canonical::usermetrics::DataSet> interface,
-			DataSourcePtr dataSource, QObject *parent = 0);
+			DataSourcePtr dataSource, const QVariantMap &properties,
+			QObject *parent = 0);
 
 	virtual ~SyncedDataSet();
 
+	QString path() const;
+
+	QVariantMap properties() const;
+
+	virtual void requestRange(int fromDay, int toDay, const QDate &today);
+
+protected Q_SLOTS:
+	void rangeFinished(QDBusPendingCallWatcher *watcher);
+
 protected:
 	QSharedPointer<com::canonical::usermetrics::DataSet> m_interface;
 };
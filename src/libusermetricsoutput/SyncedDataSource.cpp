@@ -22,9 +22,9 @@ using namespace UserMetricsOutput;
 
 SyncedDataSource::SyncedDataSource(
 		QSharedPointer<com::canonical::usermetrics::DataSource> interface,
-		QObject *parent) :
-		DataSource(interface->translationPath(), parent), m_interface(interface) {
-
+		const QVariantMap &properties, QObject *parent) :
+		DataSource(properties["translationPath"].toString(), parent), m_interface(
+				interface) {
 	connect(m_interface.data(), SIGNAL(formatStringChanged(const QString &)),
 			this, SLOT(setFormatString(const QString &)));
 	connect(m_interface.data(), SIGNAL(emptyDataStringChanged(const QString &)),
@@ -35,16 +35,32 @@ SyncedDataSource::SyncedDataSource(
 			SLOT(setTypeUint(uint)));
 	connect(m_interface.data(), SIGNAL(optionsChanged(const QVariantMap &)),
 			this, SLOT(setOptions(const QVariantMap &)));
-	setFormatString(m_interface->formatString());
-	setEmptyDataString(m_interface->emptyDataString());
-	setTextDomain(m_interface->textDomain());
-	setTypeUint(m_interface->metricType());
-	setOptions(m_interface->options());
+
+	update(properties);
 }
 
 SyncedDataSource::~SyncedDataSource() {
 }
 
+void SyncedDataSource::update(const QVariantMap &properties) {
+	setFormatString(properties["formatString"].toString());
+	setEmptyDataString(properties["emptyDataString"].toString());
+	setTextDomain(properties["textDomain"].toString());
+	setTypeUint(properties["metricType"].toUInt());
+	setOptions(properties["options"].toMap());
+}
+
+QVariantMap SyncedDataSource::properties() const {
+	QVariantMap result;
+	result["formatString"] = m_formatString;
+	result["emptyDataString"] = m_emptyDataString;
+	result["textDomain"] = m_textDomain;
+	result["metricType"] = uint(m_type);
+	result["options"] = m_options;
+	result["translationPath"] = m_localeDir;
+	return result;
+}
+
 void SyncedDataSource::setTypeUint(uint t) {
 	MetricType type(USER);
 	if (t == SYSTEM) {
@@ -30,10 +30,14 @@ Q_OBJECT
 public:
 	SyncedDataSource(
 			QSharedPointer<com::canonical::usermetrics::DataSource> interface,
-			QObject *parent = 0);
+			const QVariantMap &properties, QObject *parent = 0);
 
 	virtual ~SyncedDataSource();
 
+	void update(const QVariantMap &properties);
+
+	QVariantMap properties() const;
+
 protected Q_SLOTS:
 	void setTypeUint(uint type);
 
@@ -21,6 +21,10 @@
 #include <libusermetricsoutput/UserMetricsStore.h>
 #include <libusermetricscommon/DataSetInterface.h>
 #include <libusermetricscommon/DBusPaths.h>
+#include <libusermetricscommon/DBusProperties.h>
+#include <libusermetricscommon/Localisation.h>
+
+#include <QtCore/QDebug>
 
 using namespace com;
 using namespace UserMetricsCommon;
@@ -28,62 +32,132 @@ using namespace UserMetricsOutput;
 
 SyncedUserData::SyncedUserData(UserMetricsStore &userMetricsStore,
 		QSharedPointer<com::canonical::usermetrics::UserData> interface,
-		QObject *parent) :
-		UserData(userMetricsStore, parent) {
-	attachUserData(interface);
-}
-
-SyncedUserData::~SyncedUserData() {
-}
+		const QVariantMap &dataSets, QObject *parent) :
+		UserData(userMetricsStore, parent), m_interface(interface) {
 
-void SyncedUserData::attachUserData(
-		QSharedPointer<com::canonical::usermetrics::UserData> interface) {
-	if (m_userDatas.contains(interface)) {
-		return;
-	}
-
-	m_userDatas.insert(interface);
-
-	connect(interface.data(),
+	connect(m_interface.data(),
 	SIGNAL(dataSetAdded(const QDBusObjectPath &, const QDBusObjectPath &)),
 			this,
 			SLOT(addDataSet(const QDBusObjectPath &, const QDBusObjectPath &)));
 
-	connect(interface.data(),
+	connect(m_interface.data(),
 	SIGNAL(dataSetRemoved(const QDBusObjectPath &, const QDBusObjectPath &)),
 			this,
 			SLOT(removeDataSet(const QDBusObjectPath &, const QDBusObjectPath &)));
 
-	for (const QDBusObjectPath &path : interface->dataSets()) {
+	for (auto it(dataSets.constBegin()); it != dataSets.constEnd(); ++it) {
+		insertDataSet(it.key(), it.value().toMap());
+	}
+}
+
+SyncedUserData::~SyncedUserData() {
+}
+
+QString SyncedUserData::path() const {
+	return m_interface->path();
+}
+
+void SyncedUserData::update(const QVariantMap &dataSets) {
+	QMap<QString, QString> stale(m_dataSetPaths);
+
+	for (auto it(dataSets.constBegin()); it != dataSets.constEnd(); ++it) {
+		const QVariantMap properties(it.value().toMap());
+		const QString dataSourcePath(dataSourcePathOf(properties));
+
+		if (stale.take(dataSourcePath) == it.key()) {
+			DataSetPtr dataSet(m_dataSets.value(dataSourcePath));
+			dataSet->update(properties["lastUpdated"].toUInt(),
+					properties["data"].toList());
+		} else {
+			insertDataSet(it.key(), properties);
+		}
+	}
+
+	for (auto it(stale.constBegin()); it != stale.constEnd(); ++it) {
+		m_dataSetPaths.remove(it.key());
+		remove(it.key());
+	}
+}
 
-		QSharedPointer<canonical::usermetrics::DataSet> dataSet(
-				new canonical::usermetrics::DataSet(DBusPaths::serviceName(),
-						path.path(), interface->connection()));
+QVariantMap SyncedUserData::properties() const {
+	QVariantMap dataSets;
+	for (auto it(m_dataSetPaths.constBegin()); it != m_dataSetPaths.constEnd();
+			++it) {
+		SyncedDataSet *dataSet = qobject_cast<SyncedDataSet *>(
+				m_dataSets.value(it.key()).data());
+		if (!dataSet) {
+			continue;
+		}
+		QVariantMap properties(dataSet->properties());
+		properties["dataSource"] = it.key();
+		dataSets[it.value()] = properties;
+	}
+	return dataSets;
+}
 
-		QString dataSourcePath(dataSet->dataSource().path());
-		insert(dataSourcePath,
-				DataSetPtr(
-						new SyncedDataSet(dataSet,
-								m_userMetricsStore.dataSource(
-										dataSourcePath))));
+QString SyncedUserData::dataSourcePathOf(const QVariantMap &properties) {
+	// live data carries an object path, cached data a plain string
+	const QVariant &dataSource(properties["dataSource"]);
+	if (dataSource.userType() == qMetaTypeId<QDBusObjectPath>()) {
+		return dataSource.value<QDBusObjectPath>().path();
 	}
+	return dataSource.toString();
+}
+
+void SyncedUserData::insertDataSet(const QString &path,
+		const QVariantMap &properties) {
+	QString dataSourcePath(dataSourcePathOf(properties));
+
+	DataSourcePtr dataSource(m_userMetricsStore.dataSource(dataSourcePath));
+	if (dataSource.isNull()) {
+		qWarning() << _("Data source not found") << " [" << dataSourcePath
+				<< "]";
+		return;
+	}
+
+	QSharedPointer<canonical::usermetrics::DataSet> dataSet(
+			new canonical::usermetrics::DataSet(DBusPaths::serviceName(), path,
+					m_interface->connection()));
+
+	m_dataSetPaths.insert(dataSourcePath, path);
+	insert(dataSourcePath,
+			DataSetPtr(new SyncedDataSet(dataSet, dataSource, properties)));
 }
 
 void SyncedUserData::addDataSet(const QDBusObjectPath &dataSourcePath,
 		const QDBusObjectPath &path) {
-	QSharedPointer<canonical::usermetrics::DataSet> dataSet(
-			new canonical::usermetrics::DataSet(DBusPaths::serviceName(),
-					path.path(), (*m_userDatas.begin())->connection()));
-
-	insert(dataSourcePath.path(),
-			DataSetPtr(
-					new SyncedDataSet(dataSet,
-							m_userMetricsStore.dataSource(
-									dataSourcePath.path()))));
+	Q_UNUSED(dataSourcePath);
+
+	QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+			DBusProperties::getAll(m_interface->connection(),
+					path.path(),
+					canonical::usermetrics::DataSet::staticInterfaceName()),
+			this);
+	watcher->setProperty("path", path.path());
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)), this,
+			SLOT(dataSetPropertiesFinished(QDBusPendingCallWatcher *)));
+}
+
+void SyncedUserData::dataSetPropertiesFinished(
+		QDBusPendingCallWatcher *watcher) {
+	watcher->deleteLater();
+
+	const QString path(watcher->property("path").toString());
+
+	QDBusPendingReply<QVariantMap> reply(*watcher);
+	if (reply.isError()) {
+		qWarning() << _("Could not load data set") << ": [" << path << "] "
+				<< reply.error().message();
+		return;
+	}
+
+	insertDataSet(path,
+			DBusProperties::demarshall(QVariant(reply.value())).toMap());
 }
 
 void SyncedUserData::removeDataSet(const QDBusObjectPath &dataSourcePath,
 		const QDBusObjectPath &path) {
 	Q_UNUSED(path);
-	m_dataSets.remove(dataSourcePath.path());
+	m_dataSetPaths.remove(dataSourcePath.path());
+	remove(dataSourcePath.path());
 }
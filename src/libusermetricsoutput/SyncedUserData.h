@@ -19,10 +19,11 @@
 #ifndef USERMETRICSOUTPUT_SYNCEDUSERDATA_H_
 #define USERMETRICSOUTPUT_SYNCEDUSERDATA_H_
 
-#include <QSet>
 #include <libusermetricsoutput/UserData.h>
 #include <libusermetricscommon/UserDataInterface.h>
 
+#include <QtDBus/QDBusPendingCallWatcher>
+
 namespace UserMetricsOutput {
 
 class UserMetricsStore;
@@ -33,12 +34,15 @@ Q_OBJECT
 public:
 	explicit SyncedUserData(UserMetricsStore &userMetricsStore,
 			QSharedPointer<com::canonical::usermetrics::UserData> interface,
-			QObject *parent = 0);
+			const QVariantMap &dataSets, QObject *parent = 0);
 
 	virtual ~SyncedUserData();
 
-	void attachUserData(
-			QSharedPointer<com::canonical::usermetrics::UserData> interface);
+	QString path() const;
+
+	void update(const QVariantMap &dataSets);
+
+	QVariantMap properties() const;
 
 public Q_SLOTS:
 	void addDataSet(const QDBusObjectPath &dataSourcePath,
@@ -47,8 +51,21 @@ public Q_SLOTS:
 	void removeDataSet(const QDBusObjectPath &dataSourcePath,
 			const QDBusObjectPath &path);
 
+protected Q_SLOTS:
+	void dataSetPropertiesFinished(QDBusPendingCallWatcher *watcher);
+
 protected:
-	QSet<QSharedPointer<com::canonical::usermetrics::UserData>> m_userDatas;
+	static QString dataSourcePathOf(const QVariantMap &properties);
+
+	void insertDataSet(const QString &path, const QVariantMap &properties);
+
+	QSharedPointer<com::canonical::usermetrics::UserData> m_interface;
+
+	/**
+	 * Object paths of our own data sets, by data source path. Anything
+	 * else in the map has been shared with us.
+	 */
+	QMap<QString, QString> m_dataSetPaths;
 };
 
 }
@@ -22,6 +22,11 @@
 
 #include <libusermetricscommon/DataSourceInterface.h>
 #include <libusermetricscommon/DBusPaths.h>
+#include <libusermetricscommon/DBusProperties.h>
+#include <libusermetricscommon/Localisation.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
 
 using namespace com;
 using namespace UserMetricsCommon;
@@ -30,20 +35,34 @@ using namespace UserMetricsOutput;
 SyncedUserMetricsStore::SyncedUserMetricsStore(
 		const QDBusConnection &dbusConnection, QObject *parent) :
 		UserMetricsStore(parent), m_interface(DBusPaths::serviceName(),
-				DBusPaths::userMetrics(), dbusConnection) {
-	QTimer::singleShot(0, this, SLOT(sync()));
+				DBusPaths::userMetrics(), dbusConnection), m_serviceWatcher(
+				DBusPaths::serviceName(), dbusConnection,
+				QDBusServiceWatcher::WatchForRegistration), m_maximumResidentUsers(
+				3) {
+	init();
 }
 
-SyncedUserMetricsStore::~SyncedUserMetricsStore() {
+SyncedUserMetricsStore::SyncedUserMetricsStore(
+		const QDBusConnection &dbusConnection, SnapshotCachePtr cache,
+		QObject *parent) :
+		UserMetricsStore(parent), m_interface(DBusPaths::serviceName(),
+				DBusPaths::userMetrics(), dbusConnection), m_serviceWatcher(
+				DBusPaths::serviceName(), dbusConnection,
+				QDBusServiceWatcher::WatchForRegistration), m_maximumResidentUsers(
+				3), m_cache(cache) {
+	init();
 }
 
-void SyncedUserMetricsStore::sync() {
-	QDBusConnectionInterface* interface = m_interface.connection().interface();
-	if (!interface->isServiceRegistered(DBusPaths::serviceName())) {
-		QDBusReply<void> reply(
-				interface->startService(DBusPaths::serviceName()));
-	}
+void SyncedUserMetricsStore::init() {
+	m_cacheTimer.setSingleShot(true);
+	m_cacheTimer.setInterval(1000);
+	connect(&m_cacheTimer, SIGNAL(timeout()), this, SLOT(saveCache()));
 
+	// show whatever we had last time until the service answers
+	loadCache();
+
+	// connect up the change signals first, so nothing that happens while
+	// the snapshot is in flight gets lost
 	connect(&m_interface,
 	SIGNAL(dataSourceAdded(const QDBusObjectPath &)), this,
 	SLOT(addDataSource(const QDBusObjectPath &)));
@@ -60,56 +79,360 @@ void SyncedUserMetricsStore::sync() {
 	SIGNAL(userDataRemoved(const QString &, const QDBusObjectPath &)), this,
 	SLOT(removeUserData(const QString &, const QDBusObjectPath &)));
 
-	for (const QDBusObjectPath &path : m_interface.dataSources()) {
-		addDataSource(path);
+	// if the service (re)starts, pick up whatever it has
+	connect(&m_serviceWatcher, SIGNAL(serviceRegistered(const QString &)),
+			this, SLOT(sync()));
+
+	QTimer::singleShot(0, this, SLOT(sync()));
+}
+
+SyncedUserMetricsStore::~SyncedUserMetricsStore() {
+	if (m_cacheTimer.isActive()) {
+		saveCache();
+	}
+}
+
+void SyncedUserMetricsStore::loadCache() {
+	if (m_cache.isNull()) {
+		return;
+	}
+
+	const QVariantMap cached(m_cache->section("store"));
+	if (cached.isEmpty()) {
+		return;
 	}
 
-	QSharedPointer<canonical::usermetrics::UserData> systemData;
+	m_residentUsers = cached["residentUsers"].toStringList();
+	evictUserData();
+	applySnapshot(cached);
 
-	for (const QDBusObjectPath &path : m_interface.userDatas()) {
+	// nothing new to write back yet
+	m_cacheTimer.stop();
+}
 
-		QSharedPointer<canonical::usermetrics::UserData> userData(
+void SyncedUserMetricsStore::saveCache() {
+	if (m_cache.isNull()) {
+		return;
+	}
+
+	QVariantMap dataSources;
+	for (auto it(m_dataSources.constBegin()); it != m_dataSources.constEnd();
+			++it) {
+		SyncedDataSource *dataSource(
+				qobject_cast<SyncedDataSource *>(it->data()));
+		if (dataSource) {
+			dataSources[it.key()] = dataSource->properties();
+		}
+	}
+
+	QVariantMap userDatas;
+	SyncedUserData *systemData(
+			qobject_cast<SyncedUserData *>(m_systemData.data()));
+	if (systemData) {
+		QVariantMap properties;
+		properties["username"] = "";
+		properties["dataSets"] = systemData->properties();
+		userDatas[systemData->path()] = properties;
+	}
+
+	for (auto it(m_userData.constBegin()); it != m_userData.constEnd(); ++it) {
+		SyncedUserData *userData(qobject_cast<SyncedUserData *>(it->data()));
+		if (userData) {
+			QVariantMap properties;
+			properties["username"] = it.key();
+			properties["dataSets"] = userData->properties();
+			userDatas[userData->path()] = properties;
+		}
+	}
+
+	QVariantMap cached;
+	cached["dataSources"] = dataSources;
+	cached["userDatas"] = userDatas;
+	cached["residentUsers"] = m_residentUsers;
+
+	m_cache->setSection("store", cached);
+}
+
+void SyncedUserMetricsStore::setMaximumResidentUsers(
+		int maximumResidentUsers) {
+	m_maximumResidentUsers = qMax(1, maximumResidentUsers);
+	evictUserData();
+}
+
+void SyncedUserMetricsStore::sync() {
+	// only the system data and the users we have been asked for, the
+	// rest are loaded when somebody looks at them
+	QStringList usernames(m_residentUsers);
+	usernames << "";
+
+	// calling the method activates the service if it isn't running yet
+	QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+			m_interface.snapshot(usernames), this);
+	watcher->setProperty("usernames", usernames);
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)), this,
+			SLOT(snapshotFinished(QDBusPendingCallWatcher *)));
+}
+
+void SyncedUserMetricsStore::requestUserData(const QString &username) {
+	// the system data is not a user in its own right
+	if (username.isEmpty()) {
+		return;
+	}
+
+	const bool resident(m_residentUsers.removeOne(username));
+	m_residentUsers.prepend(username);
+
+	if (!resident) {
+		fetchUserData(QStringList() << username);
+	}
+
+	evictUserData();
+}
+
+void SyncedUserMetricsStore::retainUserData(const QString &username) {
+	if (username.isEmpty()) {
+		return;
+	}
+
+	++m_retainCounts[username];
+	requestUserData(username);
+}
+
+void SyncedUserMetricsStore::releaseUserData(const QString &username) {
+	auto it(m_retainCounts.find(username));
+	if (it == m_retainCounts.end()) {
+		return;
+	}
+
+	if (--(*it) == 0) {
+		m_retainCounts.erase(it);
+		evictUserData();
+	}
+}
+
+void SyncedUserMetricsStore::fetchUserData(const QStringList &usernames) {
+	QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+			m_interface.snapshot(usernames), this);
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)), this,
+			SLOT(userDataSnapshotFinished(QDBusPendingCallWatcher *)));
+}
+
+void SyncedUserMetricsStore::evictUserData() {
+	// least recently used first, skipping anybody still on show
+	for (int i(m_residentUsers.size() - 1);
+			i >= 0 && m_residentUsers.size() > m_maximumResidentUsers; --i) {
+		if (!m_retainCounts.contains(m_residentUsers.at(i))) {
+			m_userData.remove(m_residentUsers.takeAt(i));
+		}
+	}
+}
+
+void SyncedUserMetricsStore::snapshotFinished(
+		QDBusPendingCallWatcher *watcher) {
+	watcher->deleteLater();
+
+	QDBusPendingReply<QVariantMap> reply(*watcher);
+	if (reply.isError()) {
+		qWarning() << _("Could not load user metrics") << ": "
+				<< reply.error().message();
+		return;
+	}
+
+	const QVariantMap snapshot(
+			DBusProperties::demarshall(QVariant(reply.value())).toMap());
+
+	// this is everything the service has, so whatever we loaded from the
+	// cache that isn't in it has gone
+	removeMissing(snapshot, watcher->property("usernames").toStringList());
+	applySnapshot(snapshot);
+
+	connectionEstablished();
+}
+
+void SyncedUserMetricsStore::removeMissing(const QVariantMap &snapshot,
+		const QStringList &usernames) {
+	const QVariantMap dataSources(snapshot["dataSources"].toMap());
+	for (const QString &path : m_dataSources.keys()) {
+		if (!dataSources.contains(path)) {
+			removeDataSource(QDBusObjectPath(path));
+		}
+	}
+
+	QHash<QString, QString> paths;
+	const QVariantMap userDatas(snapshot["userDatas"].toMap());
+	for (auto it(userDatas.constBegin()); it != userDatas.constEnd(); ++it) {
+		paths.insert(it.value().toMap()["username"].toString(), it.key());
+	}
+
+	// only the users we asked about, anyone else became resident after
+	// the call went out
+	for (const QString &username : usernames) {
+		SyncedUserData *userData(
+				qobject_cast<SyncedUserData *>(
+						username.isEmpty() ?
+								m_systemData.data() :
+								m_userData.value(username).data()));
+		if (!userData) {
+			continue;
+		}
+
+		auto path(paths.constFind(username));
+		if (path == paths.constEnd()) {
+			removeUserData(username, QDBusObjectPath(userData->path()));
+		} else if (*path != userData->path()) {
+			// the service was reset and the user created again, so start
+			// over with the new path
+			if (username.isEmpty()) {
+				removeUserData(username, QDBusObjectPath(userData->path()));
+			} else {
+				m_userData.remove(username);
+			}
+		}
+	}
+}
+
+void SyncedUserMetricsStore::userDataSnapshotFinished(
+		QDBusPendingCallWatcher *watcher) {
+	watcher->deleteLater();
+
+	QDBusPendingReply<QVariantMap> reply(*watcher);
+	if (reply.isError()) {
+		qWarning() << _("Could not load user data") << ": "
+				<< reply.error().message();
+		return;
+	}
+
+	applySnapshot(DBusProperties::demarshall(QVariant(reply.value())).toMap());
+}
+
+void SyncedUserMetricsStore::applySnapshot(const QVariantMap &snapshot) {
+	const QVariantMap dataSources(snapshot["dataSources"].toMap());
+	for (auto it(dataSources.constBegin()); it != dataSources.constEnd();
+			++it) {
+		auto existing(m_dataSources.constFind(it.key()));
+		if (existing != m_dataSources.constEnd()) {
+			SyncedDataSource *dataSource(
+					qobject_cast<SyncedDataSource *>(existing->data()));
+			if (dataSource) {
+				dataSource->update(it.value().toMap());
+			}
+			continue;
+		}
+
+		QSharedPointer<canonical::usermetrics::DataSource> dataSource(
+				new canonical::usermetrics::DataSource(
+						DBusPaths::serviceName(), it.key(),
+						m_interface.connection()));
+
+		insert(it.key(),
+				DataSourcePtr(
+						new SyncedDataSource(dataSource, it.value().toMap())));
+	}
+
+	const QVariantMap userDatas(snapshot["userDatas"].toMap());
+
+	// the system data goes first, so that users can be handed its data sets
+	for (auto it(userDatas.constBegin()); it != userDatas.constEnd(); ++it) {
+		const QVariantMap properties(it.value().toMap());
+		if (properties["username"].toString() != "") {
+			continue;
+		}
+
+		if (!m_systemData.isNull()) {
+			SyncedUserData *systemData(
+					qobject_cast<SyncedUserData *>(m_systemData.data()));
+			if (systemData) {
+				systemData->update(properties["dataSets"].toMap());
+			}
+			continue;
+		}
+
+		QSharedPointer<canonical::usermetrics::UserData> systemData(
 				new canonical::usermetrics::UserData(DBusPaths::serviceName(),
-						path.path(), m_interface.connection()));
+						it.key(), m_interface.connection()));
 
-		QString username(userData->username());
-		if (username == "") {
-			systemData = userData;
+		m_systemData.reset(
+				new SyncedUserData(*this, systemData,
+						properties["dataSets"].toMap()));
+		connect(m_systemData.data(), SIGNAL(dataSetAdded(const QString &)),
+				this, SLOT(systemDataSetAdded(const QString &)));
+		connect(m_systemData.data(),
+				SIGNAL(dataSetRemoved(const QString &)), this,
+				SLOT(systemDataSetRemoved(const QString &)));
+
+		for (UserDataPtr userData : m_userData.values()) {
+			attachSystemData(userData);
+		}
+	}
+
+	for (auto it(userDatas.constBegin()); it != userDatas.constEnd(); ++it) {
+		const QVariantMap properties(it.value().toMap());
+
+		QString username(properties["username"].toString());
+		// a reply can arrive after its user has been evicted
+		if (username == "" || !m_residentUsers.contains(username)) {
 			continue;
 		}
-		insert(username, UserDataPtr(new SyncedUserData(*this, userData)));
+
+		auto existing(m_userData.constFind(username));
+		if (existing != m_userData.constEnd()) {
+			SyncedUserData *userData(
+					qobject_cast<SyncedUserData *>(existing->data()));
+			if (userData) {
+				userData->update(properties["dataSets"].toMap());
+			}
+			continue;
+		}
+
+		QSharedPointer<canonical::usermetrics::UserData> userData(
+				new canonical::usermetrics::UserData(DBusPaths::serviceName(),
+						it.key(), m_interface.connection()));
+
+		UserDataPtr syncedData(
+				new SyncedUserData(*this, userData,
+						properties["dataSets"].toMap()));
+		attachSystemData(syncedData);
+		insert(username, syncedData);
 	}
 
-	// if we have system data we must attach it to each of the user datas
-	if (!systemData.isNull()) {
-		attachSystemData(systemData);
+	if (!m_cache.isNull()) {
+		m_cacheTimer.start();
 	}
+}
 
-	connectionEstablished();
+void SyncedUserMetricsStore::attachSystemData(UserDataPtr userData) {
+	if (m_systemData.isNull()) {
+		return;
+	}
+
+	for (auto it(m_systemData->constBegin()); it != m_systemData->constEnd();
+			++it) {
+		userData->insert(it.key(), *it);
+	}
 }
 
-void SyncedUserMetricsStore::attachSystemData(
-		QSharedPointer<canonical::usermetrics::UserData> systemData) {
+void SyncedUserMetricsStore::systemDataSetAdded(
+		const QString &dataSourceName) {
+	DataSetPtr dataSet(*m_systemData->constFind(dataSourceName));
 	for (UserDataPtr userData : m_userData.values()) {
-		SyncedUserData *syncedData = qobject_cast<SyncedUserData *>(
-				userData.data());
-		syncedData->attachUserData(systemData);
+		userData->insert(dataSourceName, dataSet);
+	}
+}
+
+void SyncedUserMetricsStore::systemDataSetRemoved(
+		const QString &dataSourceName) {
+	for (UserDataPtr userData : m_userData.values()) {
+		userData->remove(dataSourceName);
 	}
 }
 
 void SyncedUserMetricsStore::addUserData(const QString &username,
 		const QDBusObjectPath &path) {
+	Q_UNUSED(path);
 
-	QSharedPointer<canonical::usermetrics::UserData> userData(
-			new canonical::usermetrics::UserData(DBusPaths::serviceName(),
-					path.path(), m_interface.connection()));
-
-	// if we're adding system data for the first time, we must attach it
-	// to all of the user datas
-	if (username == "") {
-		attachSystemData(userData);
-	} else {
-		insert(username, UserDataPtr(new SyncedUserData(*this, userData)));
+	// we only care about the system data and users we have been asked for
+	if (username == "" || m_residentUsers.contains(username)) {
+		fetchUserData(QStringList() << username);
 	}
 }
 
@@ -117,24 +440,59 @@ void SyncedUserMetricsStore::removeUserData(const QString &username,
 		const QDBusObjectPath &path) {
 	Q_UNUSED(path);
 
-	//FIXME Handle system user data being removed
 	if (username == "") {
+		if (!m_systemData.isNull()) {
+			for (auto it(m_systemData->constBegin());
+					it != m_systemData->constEnd(); ++it) {
+				systemDataSetRemoved(it.key());
+			}
+			m_systemData.reset();
+		}
 		return;
 	}
 
-	m_dataSources.remove(username);
+	// so that asking for them again fetches them again
+	m_residentUsers.removeOne(username);
+	m_userData.remove(username);
 }
 
 void SyncedUserMetricsStore::addDataSource(const QDBusObjectPath &path) {
+	QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+			DBusProperties::getAll(m_interface.connection(), path.path(),
+					canonical::usermetrics::DataSource::staticInterfaceName()),
+			this);
+	watcher->setProperty("path", path.path());
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)), this,
+			SLOT(dataSourcePropertiesFinished(QDBusPendingCallWatcher *)));
+}
+
+void SyncedUserMetricsStore::dataSourcePropertiesFinished(
+		QDBusPendingCallWatcher *watcher) {
+	watcher->deleteLater();
+
+	const QString path(watcher->property("path").toString());
+
+	QDBusPendingReply<QVariantMap> reply(*watcher);
+	if (reply.isError()) {
+		qWarning() << _("Could not load data source") << ": [" << path
+				<< "] " << reply.error().message();
+		return;
+	}
+
+	if (m_dataSources.contains(path)) {
+		return;
+	}
 
 	QSharedPointer<canonical::usermetrics::DataSource> dataSource(
 			new canonical::usermetrics::DataSource(DBusPaths::serviceName(),
-					path.path(), m_interface.connection()));
+					path, m_interface.connection()));
 
-	insert(path.path(),
-			DataSourcePtr(new SyncedDataSource(dataSource)));
+	insert(path,
+			DataSourcePtr(
+					new SyncedDataSource(dataSource,
+							DBusProperties::demarshall(QVariant(reply.value())).toMap())));
 }
 
 void SyncedUserMetricsStore::removeDataSource(const QDBusObjectPath &path) {
-	m_userData.remove(path.path());
+	m_dataSources.remove(path.path());
 }
@@ -19,10 +19,16 @@
 #ifndef USERMETRICSOUTPUT_SYNCEDUSERMETRICSSTORE_H_
 #define USERMETRICSOUTPUT_SYNCEDUSERMETRICSSTORE_H_
 
+#include <libusermetricsoutput/SnapshotCache.h>
 #include <libusermetricsoutput/UserMetricsStore.h>
 #include <libusermetricscommon/UserMetricsInterface.h>
 #include <libusermetricscommon/UserDataInterface.h>
 
+#include <QtCore/QHash>
+#include <QtCore/QTimer>
+#include <QtDBus/QDBusPendingCallWatcher>
+#include <QtDBus/QDBusServiceWatcher>
+
 namespace UserMetricsOutput {
 
 class SyncedUserMetricsStore: public UserMetricsStore {
@@ -32,8 +38,19 @@ public:
 	explicit SyncedUserMetricsStore(const QDBusConnection &dbusConnection,
 			QObject *parent = 0);
 
+	explicit SyncedUserMetricsStore(const QDBusConnection &dbusConnection,
+			SnapshotCachePtr cache, QObject *parent = 0);
+
 	virtual ~SyncedUserMetricsStore();
 
+	virtual void requestUserData(const QString &username);
+
+	virtual void retainUserData(const QString &username);
+
+	virtual void releaseUserData(const QString &username);
+
+	void setMaximumResidentUsers(int maximumResidentUsers);
+
 Q_SIGNALS:
 	void connectionEstablished();
 
@@ -48,11 +65,64 @@ public Q_SLOTS:
 
 	void sync();
 
+protected Q_SLOTS:
+	void snapshotFinished(QDBusPendingCallWatcher *watcher);
+
+	void userDataSnapshotFinished(QDBusPendingCallWatcher *watcher);
+
+	void dataSourcePropertiesFinished(QDBusPendingCallWatcher *watcher);
+
+	void systemDataSetAdded(const QString &dataSourceName);
+
+	void systemDataSetRemoved(const QString &dataSourceName);
+
+	void saveCache();
+
 protected:
-	void attachSystemData(
-			QSharedPointer<com::canonical::usermetrics::UserData> systemData);
+	void init();
+
+	void loadCache();
+
+	void fetchUserData(const QStringList &usernames);
+
+	void evictUserData();
+
+	/**
+	 * Drop the data sources and users that a full snapshot shows are no
+	 * longer there. usernames are the users the snapshot was asked for.
+	 */
+	void removeMissing(const QVariantMap &snapshot,
+			const QStringList &usernames);
+
+	void applySnapshot(const QVariantMap &snapshot);
+
+	void attachSystemData(UserDataPtr userData);
 
 	com::canonical::UserMetrics m_interface;
+
+	QDBusServiceWatcher m_serviceWatcher;
+
+	/**
+	 * Users we hold data for, most recently requested first.
+	 */
+	QStringList m_residentUsers;
+
+	int m_maximumResidentUsers;
+
+	/**
+	 * How many views are showing each user. These users are never
+	 * evicted.
+	 */
+	QHash<QString, int> m_retainCounts;
+
+	/**
+	 * The system data sets are loaded once and shared by every user.
+	 */
+	UserDataPtr m_systemData;
+
+	SnapshotCachePtr m_cache;
+
+	QTimer m_cacheTimer;
 }
 ;
 
@@ -36,6 +36,16 @@ UserData::const_iterator UserData::constEnd() const {
 	return m_dataSets.constEnd();
 }
 
+UserData::const_iterator UserData::constFind(
+		const QString &dataSourceName) const {
+	return m_dataSets.constFind(dataSourceName);
+}
+
+UserData::const_iterator UserData::constUpperBound(
+		const QString &dataSourceName) const {
+	return m_dataSets.upperBound(dataSourceName);
+}
+
 UserData::iterator UserData::insert(const QString &dataSourceName,
 		DataSetPtr dataSet) {
 	auto it(m_dataSets.insert(dataSourceName, dataSet));
@@ -45,3 +55,8 @@ UserData::iterator UserData::insert(const QString &dataSourceName,
 	return it;
 }
 
+void UserData::remove(const QString &dataSourceName) {
+	if (m_dataSets.remove(dataSourceName) > 0) {
+		dataSetRemoved(dataSourceName);
+	}
+}
@@ -48,11 +48,24 @@ public:
 
 	virtual const_iterator constEnd() const;
 
+	virtual const_iterator constFind(const QString &dataSourceName) const;
+
+	/**
+	 * The first data set after dataSourceName, whether or not there is
+	 * one called that.
+	 */
+	virtual const_iterator constUpperBound(
+			const QString &dataSourceName) const;
+
 	virtual iterator insert(const QString &dataSourceName, DataSetPtr dataSet);
 
+	virtual void remove(const QString &dataSourceName);
+
 Q_SIGNALS:
 	void dataSetAdded(const QString &dataSourceName);
 
+	void dataSetRemoved(const QString &dataSourceName);
+
 protected:
 	DataSetMap m_dataSets;
 
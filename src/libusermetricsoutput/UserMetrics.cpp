@@ -16,6 +16,7 @@
  * Author: Pete Woods <pete.woods@canonical.com>
  */
 
+#include <libusermetricsoutput/SnapshotCache.h>
 #include <libusermetricsoutput/SyncedUserMetricsStore.h>
 #include <libusermetricscommon/DateFactoryImpl.h>
 #include <libusermetricsoutput/GSettingsColorThemeProvider.h>
@@ -32,14 +33,60 @@ UserMetrics::UserMetrics(QObject *parent) :
 UserMetrics::~UserMetrics() {
 }
 
+QAbstractItemModel * UserMetrics::dataSets() const {
+	// not virtual, so the vtable is the same as it always was
+	const UserMetricsImpl *impl(qobject_cast<const UserMetricsImpl *>(this));
+	if (!impl) {
+		return 0;
+	}
+	return impl->dataSets();
+}
+
+namespace {
+
+/**
+ * Every view in the process shares these, so the sync and the colour
+ * themes are only paid for once. They go away with the last view.
+ */
+static QWeakPointer<SnapshotCache> sharedCache;
+static QWeakPointer<DateFactory> sharedDateFactory;
+static QWeakPointer<UserMetricsStore> sharedStore;
+static QWeakPointer<ColorThemeProvider> sharedColorThemeProvider;
+
+SnapshotCachePtr cacheInstance() {
+	SnapshotCachePtr cache(sharedCache);
+	if (!cache) {
+		cache.reset(new SnapshotCache(SnapshotCache::defaultPath()));
+		sharedCache = cache;
+	}
+	return cache;
+}
+
+}
+
 UserMetrics * UserMetrics::getInstance() {
-	QDBusConnection dbusConnection(QDBusConnection::connectToBus(
-		QDBusConnection::SystemBus, "libusermetricsoutput-systembus"));
-
-	return new UserMetricsImpl(
-			QSharedPointer<DateFactory>(new DateFactoryImpl()),
-			QSharedPointer<UserMetricsStore>(
-					new SyncedUserMetricsStore(dbusConnection)),
-			QSharedPointer<ColorThemeProvider>(
-					new GSettingsColorThemeProvider()));
+	QSharedPointer<DateFactory> dateFactory(sharedDateFactory);
+	if (!dateFactory) {
+		dateFactory.reset(new DateFactoryImpl());
+		sharedDateFactory = dateFactory;
+	}
+
+	QSharedPointer<UserMetricsStore> store(sharedStore);
+	if (!store) {
+		QDBusConnection dbusConnection(QDBusConnection::connectToBus(
+			QDBusConnection::SystemBus, "libusermetricsoutput-systembus"));
+
+		store.reset(new SyncedUserMetricsStore(dbusConnection, cacheInstance()));
+		sharedStore = store;
+	}
+
+	QSharedPointer<ColorThemeProvider> colorThemeProvider(
+			sharedColorThemeProvider);
+	if (!colorThemeProvider) {
+		colorThemeProvider.reset(
+				new GSettingsColorThemeProvider(cacheInstance()));
+		sharedColorThemeProvider = colorThemeProvider;
+	}
+
+	return new UserMetricsImpl(dateFactory, store, colorThemeProvider);
 }
@@ -95,6 +95,15 @@ Q_PROPERTY(QAbstractItemModel *secondMonth READ secondMonth NOTIFY secondMonthCh
  */
 Q_PROPERTY(int currentDay READ currentDay NOTIFY currentDayChanged FINAL)
 
+/**
+ * @brief Every data set of the current user, one row each.
+ *
+ * The roles are dataSource, label, firstColor, secondColor, firstMonth,
+ * secondMonth and history. history is a model with one row per calendar
+ * month, fetched from the service a page at a time as it is scrolled.
+ */
+Q_PROPERTY(QAbstractItemModel *dataSets READ dataSets CONSTANT FINAL)
+
 public:
 	/**
 	 * @brief Get a new instance of UserMetrics.
@@ -155,6 +164,14 @@ public:
 	 */
 	virtual QAbstractItemModel *secondMonth() const = 0;
 
+	/**
+	 * @brief Every data set of the current user, one row each.
+	 *
+	 * A row's months and colours are only worked out once a view asks
+	 * for them, so showing a few rows of a long list stays cheap.
+	 */
+	QAbstractItemModel *dataSets() const;
+
 Q_SIGNALS:
 	/**
 	 * @brief The label has changed
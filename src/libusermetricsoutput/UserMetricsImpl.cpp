@@ -23,7 +23,7 @@
 
 #include <QtCore/QDate>
 #include <QtCore/QString>
-#include <QtCore/QVariantList>
+#include <QtCore/QVector>
 #include <QtCore/QDebug>
 
 using namespace UserMetricsOutput;
@@ -35,9 +35,15 @@ UserMetricsImpl::UserMetricsImpl(QSharedPointer<DateFactory> dateFactory,
 		UserMetrics(parent), m_dateFactory(dateFactory), m_userMetricsStore(
 				userDataStore), m_colorThemeProvider(colorThemeProvider), m_firstColor(
 				new ColorThemeImpl(this)), m_firstMonth(
-				new QVariantListModel(this)), m_secondColor(
+				new MonthModel(this)), m_secondColor(
 				new ColorThemeImpl(this)), m_secondMonth(
-				new QVariantListModel(this)), m_currentDay(), m_noDataForUser(
+				new MonthModel(this)), m_nextFirstColor(
+				new ColorThemeImpl(this)), m_nextFirstMonth(
+				new MonthModel(this)), m_nextSecondColor(
+				new ColorThemeImpl(this)), m_nextSecondMonth(
+				new MonthModel(this)), m_dataSets(
+				new UserMetricsListModel(dateFactory, userDataStore,
+						colorThemeProvider, this)), m_swapPending(false), m_currentDay(), m_noDataForUser(
 				false), m_oldNoDataForUser(false) {
 	connect(this, SIGNAL(nextDataSource()), this, SLOT(nextDataSourceSlot()),
 			Qt::QueuedConnection);
@@ -54,6 +60,7 @@ UserMetricsImpl::UserMetricsImpl(QSharedPointer<DateFactory> dateFactory,
 }
 
 UserMetricsImpl::~UserMetricsImpl() {
+	m_userMetricsStore->releaseUserData(m_username);
 }
 
 void UserMetricsImpl::setLabel(const QString &label) {
@@ -98,47 +105,84 @@ void UserMetricsImpl::dataSetAdded(const QString &dataSourceName) {
 void UserMetricsImpl::checkForUserData() {
 	m_oldNoDataForUser = m_noDataForUser;
 
-	m_userDataIterator = m_userMetricsStore->constFind(m_username);
+	UserMetricsStore::const_iterator userDataIterator(
+			m_userMetricsStore->constFind(m_username));
 
 	// first check to see if there is UserData for this user
-	m_noDataForUser = m_userDataIterator == m_userMetricsStore->constEnd();
+	m_noDataForUser = userDataIterator == m_userMetricsStore->constEnd();
 	if (!m_noDataForUser) {
 		// if there is a UserData container
-		m_userData = *m_userDataIterator;
-		m_dataSetIterator = m_userData->constBegin();
+		if (!m_userData.isNull()) {
+			disconnect(m_userData.data(),
+					SIGNAL(dataSetRemoved(const QString &)), this,
+					SLOT(dataSetRemoved(const QString &)));
+		}
+		m_userData = *userDataIterator;
+		connect(m_userData.data(), SIGNAL(dataSetRemoved(const QString &)),
+				this, SLOT(dataSetRemoved(const QString &)));
+
+		UserData::const_iterator dataSetIterator(m_userData->constBegin());
 
 		// now check to see if that container has any data in
-		m_noDataForUser = m_dataSetIterator == m_userData->constEnd();
+		m_noDataForUser = dataSetIterator == m_userData->constEnd();
 		if (m_noDataForUser) {
 			m_watchUser = m_username;
 			// set up a watch in-case some data sets are added
 			connect(m_userData.data(), SIGNAL(dataSetAdded(const QString &)),
 					this, SLOT(dataSetAdded(const QString &)));
 		} else {
-			m_dataSet = *m_dataSetIterator;
+			m_dataSourcePath = dataSetIterator.key();
+			m_dataSet = *dataSetIterator;
 		}
 	}
 }
 
+void UserMetricsImpl::dataSetRemoved(const QString &dataSourceName) {
+	// move on from a data set that has gone, rather than keep showing it
+	if (!m_noDataForUser && dataSourceName == m_dataSourcePath) {
+		nextDataSource();
+	}
+}
+
 void UserMetricsImpl::setUsernameInternal(const QString &username) {
+	// the store only loads users on demand, and keeps them while we
+	// are showing them
+	m_userMetricsStore->releaseUserData(m_username);
 	m_username = username;
+	m_userMetricsStore->retainUserData(m_username);
 
 	checkForUserData();
 
+	m_dataSets->setUsername(m_username);
+
 	prepareToLoadDataSource();
 
 	usernameChanged(m_username);
 }
 
 void UserMetricsImpl::prepareToLoadDataSource() {
-	if (!m_dataSet.isNull()) {
-		disconnect(m_dataSet.data(), SIGNAL(dataChanged(const QVariantList *)),
-				this, SLOT(updateCurrentDataSet(const QVariantList *)));
+	if (m_dataSetConnection) {
+		disconnect(m_dataSetConnection);
 	}
 	if (!m_userData.isNull() && m_watchUser != m_username) {
 		disconnect(m_userData.data(), SIGNAL(dataSetAdded(const QString &)),
 				this, SLOT(dataSetAdded(const QString &)));
 	}
+
+	// get the next data ready in the back buffers now, so that when the
+	// UI is ready for the change all we have to do is swap them over
+	m_swapPending = true;
+	m_nextLabel = m_label;
+	m_nextDate = m_dateFactory->currentDate();
+	if (!takeWarmFrame()) {
+		updateCurrentDataSet(0);
+	}
+	if (!m_noDataForUser) {
+		m_dataSetConnection = connect(m_dataSet.data(),
+				SIGNAL(dataChanged(const QVector<double> *)), this,
+				SLOT(updateCurrentDataSet(const QVector<double> *)));
+	}
+
 	if (m_oldNoDataForUser && !m_noDataForUser) {
 		dataAboutToAppear();
 		finishLoadingDataSource();
@@ -148,83 +192,262 @@ void UserMetricsImpl::prepareToLoadDataSource() {
 		dataAboutToChange();
 	}
 	// we emit no signal if the data has stayed empty
+
+	// get the frames after this one ready once we're off the critical path
+	QMetaObject::invokeMethod(this, "warmFrames", Qt::QueuedConnection);
 }
 
-void UserMetricsImpl::updateMonth(QVariantListModel &month,
-		const int dayOfMonth, const int daysInMonth,
-		QVariantList::const_iterator& index,
-		const QVariantList::const_iterator& end) {
+void UserMetricsImpl::finishLoadingDataSource() {
+	if (!m_swapPending) {
+		m_swapPending = true;
+		m_nextLabel = m_label;
+		m_nextDate = m_dateFactory->currentDate();
+		updateCurrentDataSet(0);
+	}
 
-	// Data for the month
-	QVariantList newData;
+	m_firstMonth.swap(m_nextFirstMonth);
+	m_secondMonth.swap(m_nextSecondMonth);
+	m_firstColor.swap(m_nextFirstColor);
+	m_secondColor.swap(m_nextSecondColor);
+	m_swapPending = false;
 
-	// Copy a number of data entries equal to the day of the month it is
-	for (int i(0); i < dayOfMonth; ++i) {
-		if (index == end) {
-			// when we run out of data, pad the remaining days to the
-			// start of the month
-			newData.prepend(QVariant());
-		} else {
-			// pop data from the from of the source
-			newData.prepend(*index);
-			++index;
-		}
-	}
+	firstMonthChanged(m_firstMonth.data());
+	secondMonthChanged(m_secondMonth.data());
+	firstColorChanged(m_firstColor.data());
+	secondColorChanged(m_secondColor.data());
+	setLabel(m_nextLabel);
+
+	// the day the months we just swapped in were built for
+	setCurrentDay(m_nextDate.day() - 1);
 
-	// Now fill the end of the month with empty data
-	while (newData.size() < daysInMonth) {
-		newData.append(QVariant());
+	if (m_oldNoDataForUser && !m_noDataForUser) {
+		dataAppeared();
+	} else if (!m_oldNoDataForUser && m_noDataForUser) {
+		dataDisappeared();
+	} else if (!m_oldNoDataForUser && !m_noDataForUser) {
+		dataChanged();
 	}
+	// we emit no signal if the data has stayed empty
+}
 
-	month.setVariantList(newData);
+void UserMetricsImpl::dataSourceStringsChanged() {
+	updateCurrentDataSet(0);
 }
 
-void UserMetricsImpl::finishLoadingDataSource() {
-	const QDate currentDate(m_dateFactory->currentDate());
+void UserMetricsImpl::updateCurrentDataSet(const QVector<double> *newData) {
+	Q_UNUSED(newData);
+
+	if (m_swapPending) {
+		// the UI hasn't swapped yet, so keep the back buffers up to date
+		updateBuffers(m_nextDate, *m_nextFirstMonth, *m_nextSecondMonth,
+				*m_nextFirstColor, *m_nextSecondColor, m_nextLabel);
+	} else {
+		QString label(m_label);
+		updateBuffers(m_dateFactory->currentDate(), *m_firstMonth,
+				*m_secondMonth, *m_firstColor, *m_secondColor, label);
+		setLabel(label);
+	}
+}
+
+void UserMetricsImpl::updateBuffers(const QDate &currentDate,
+		MonthModel &firstMonth, MonthModel &secondMonth,
+		ColorThemeImpl &firstColor, ColorThemeImpl &secondColor,
+		QString &label) {
+	QDate secondMonthDate(currentDate.addMonths(-1));
 
 	if (m_noDataForUser) {
-		QDate secondMonthDate(currentDate.addMonths(-1));
+		QVector<double> data;
+		QVector<double>::const_iterator dataIndex(data.constBegin());
+		QVector<double>::const_iterator end(data.constEnd());
 
-		QVariantList data;
-		QVariantList::const_iterator dataIndex(data.begin());
-		QVariantList::const_iterator end(data.end());
+		firstMonth.update(currentDate, 0, dataIndex, end);
+		secondMonth.update(secondMonthDate, 0, dataIndex, end);
 
-		updateMonth(*m_firstMonth, 0, currentDate.daysInMonth(), dataIndex,
-				end);
+		label = "";
+		return;
+	}
 
-		updateMonth(*m_secondMonth, 0, secondMonthDate.daysInMonth(), dataIndex,
-				end);
+	const QString &dataSourcePath(m_dataSourcePath);
 
-		setLabel("");
+	fillMonths(currentDate, *m_dataSet, firstMonth, secondMonth);
+
+	DataSourcePtr dataSource(m_userMetricsStore->dataSource(dataSourcePath));
+	watchDataSource(dataSource);
+	if (dataSource.isNull()) {
+		qWarning() << _("Data source not found") << " [" << dataSourcePath << "]";
+		// carry on showing the colours we have
+		firstColor.setColors(*m_firstColor);
+		secondColor.setColors(*m_secondColor);
 	} else {
-		updateCurrentDataSet(0);
-		connect(m_dataSet.data(), SIGNAL(dataChanged(const QVariantList *)),
-				this, SLOT(updateCurrentDataSet(const QVariantList *)));
+		ColorThemePtrPair colorTheme(
+				m_colorThemeProvider->getColorTheme(dataSourcePath));
+		if (!colorTheme.first.isNull() && !colorTheme.second.isNull()) {
+			firstColor.setColors(*colorTheme.first);
+			secondColor.setColors(*colorTheme.second);
+		}
+
+		label = formatLabel(currentDate, *m_dataSet, *dataSource,
+				dataSourcePath);
 	}
+}
 
-	setCurrentDay(currentDate.day() - 1);
+void UserMetricsImpl::watchDataSource(DataSourcePtr dataSource) {
+	if (m_dataSourceFormatStringConnection) {
+		disconnect(m_dataSourceFormatStringConnection);
+	}
+	if (m_dataSourceEmptyDataStringConnection) {
+		disconnect(m_dataSourceEmptyDataStringConnection);
+	}
+	m_dataSourceFormatStringConnection = connect(dataSource.data(), SIGNAL(formatStringChanged(const QString &)),
+			this, SLOT(dataSourceStringsChanged()));
+	m_dataSourceEmptyDataStringConnection = connect(dataSource.data(), SIGNAL(emptyDataStringChanged(const QString &)),
+			this, SLOT(dataSourceStringsChanged()));
+}
 
-	if (m_oldNoDataForUser && !m_noDataForUser) {
-		dataAppeared();
-	} else if (!m_oldNoDataForUser && m_noDataForUser) {
-		dataDisappeared();
-	} else if (!m_oldNoDataForUser && !m_noDataForUser) {
-		dataChanged();
+UserMetricsImpl::Frame::Frame(QObject *parent) :
+		m_firstColor(new ColorThemeImpl(parent)), m_firstMonth(
+				new MonthModel(parent)), m_secondColor(
+				new ColorThemeImpl(parent)), m_secondMonth(
+				new MonthModel(parent)), m_ready(false) {
+}
+
+UserMetricsImpl::Frame::~Frame() {
+	for (const QMetaObject::Connection &connection : m_connections) {
+		QObject::disconnect(connection);
 	}
-	// we emit no signal if the data has stayed empty
+
+	// these may have just been swapped out of the UI's hands
+	m_firstColor.take()->deleteLater();
+	m_firstMonth.take()->deleteLater();
+	m_secondColor.take()->deleteLater();
+	m_secondMonth.take()->deleteLater();
 }
 
-void UserMetricsImpl::dataSourceStringsChanged() {
-	updateCurrentDataSet(0);
+void UserMetricsImpl::warmFrames() {
+	QList<FramePtr> frames;
+
+	if (!m_noDataForUser && !m_userData.isNull()) {
+		UserData::const_iterator it(
+				m_userData->constUpperBound(m_dataSourcePath));
+		for (int i(0); i < WARM_FRAMES; ++i, ++it) {
+			if (it == m_userData->constEnd()) {
+				it = m_userData->constBegin();
+			}
+			if (it == m_userData->constEnd() || it.key() == m_dataSourcePath) {
+				// fewer data sets than frames
+				break;
+			}
+
+			// keep the frames we already have
+			FramePtr frame;
+			for (const FramePtr &warmFrame : m_warmFrames) {
+				if (warmFrame->m_dataSourcePath == it.key()
+						&& warmFrame->m_dataSet == *it) {
+					frame = warmFrame;
+					break;
+				}
+			}
+
+			if (frame.isNull()) {
+				frame.reset(new Frame(this));
+				frame->m_dataSourcePath = it.key();
+				frame->m_dataSet = *it;
+				frame->m_dataSource = m_userMetricsStore->dataSource(it.key());
+
+				frame->m_connections << connect(frame->m_dataSet.data(),
+						SIGNAL(dataChanged(const QVector<double> *)), this,
+						SLOT(warmFrameChanged()));
+				if (!frame->m_dataSource.isNull()) {
+					frame->m_connections << connect(
+							frame->m_dataSource.data(),
+							SIGNAL(formatStringChanged(const QString &)), this,
+							SLOT(warmFrameChanged()));
+					frame->m_connections << connect(
+							frame->m_dataSource.data(),
+							SIGNAL(emptyDataStringChanged(const QString &)),
+							this, SLOT(warmFrameChanged()));
+				}
+
+				buildFrame(*frame);
+			}
+
+			frames << frame;
+		}
+	}
+
+	m_warmFrames.swap(frames);
 }
 
-void UserMetricsImpl::updateCurrentDataSet(const QVariantList *newData) {
-	Q_UNUSED(newData);
+void UserMetricsImpl::warmFrameChanged() {
+	for (const FramePtr &frame : m_warmFrames) {
+		if (frame->m_dataSet.data() == sender()
+				|| frame->m_dataSource.data() == sender()) {
+			buildFrame(*frame);
+		}
+	}
+}
+
+void UserMetricsImpl::buildFrame(Frame &frame) {
+	frame.m_ready = false;
+
+	// without these we leave it to the slow path, which knows how to
+	// carry on from the frame before
+	if (frame.m_dataSource.isNull()) {
+		return;
+	}
+	ColorThemePtrPair colorTheme(
+			m_colorThemeProvider->getColorTheme(frame.m_dataSourcePath));
+	if (colorTheme.first.isNull() || colorTheme.second.isNull()) {
+		return;
+	}
 
 	const QDate currentDate(m_dateFactory->currentDate());
+	frame.m_date = currentDate;
+
+	fillMonths(currentDate, *frame.m_dataSet, *frame.m_firstMonth,
+			*frame.m_secondMonth);
+	frame.m_firstColor->setColors(*colorTheme.first);
+	frame.m_secondColor->setColors(*colorTheme.second);
+	frame.m_label = formatLabel(currentDate, *frame.m_dataSet,
+			*frame.m_dataSource, frame.m_dataSourcePath);
+
+	frame.m_ready = true;
+}
+
+bool UserMetricsImpl::takeWarmFrame() {
+	if (m_noDataForUser || m_warmFrames.isEmpty()) {
+		return false;
+	}
 
-	const QDate &lastUpdated(m_dataSet->lastUpdated());
+	FramePtr frame(m_warmFrames.first());
+	if (!frame->m_ready || frame->m_dataSourcePath != m_dataSourcePath
+			|| frame->m_dataSet != m_dataSet) {
+		return false;
+	}
+
+	// a frame built yesterday shows the wrong day
+	if (frame->m_date != m_nextDate) {
+		return false;
+	}
+
+	m_warmFrames.removeFirst();
+
+	m_nextFirstMonth.swap(frame->m_firstMonth);
+	m_nextSecondMonth.swap(frame->m_secondMonth);
+	m_nextFirstColor.swap(frame->m_firstColor);
+	m_nextSecondColor.swap(frame->m_secondColor);
+	m_nextLabel = frame->m_label;
+
+	watchDataSource(frame->m_dataSource);
+
+	return true;
+}
+
+void UserMetricsImpl::fillMonths(const QDate &currentDate,
+		const DataSet &dataSet, MonthModel &firstMonth,
+		MonthModel &secondMonth) {
 	QDate secondMonthDate(currentDate.addMonths(-1));
+	const QDate &lastUpdated(dataSet.lastUpdated());
 
 	int valuesToCopyForFirstMonth(0);
 	int valuesToCopyForSecondMonth(0);
@@ -242,58 +465,38 @@ void UserMetricsImpl::updateCurrentDataSet(const QVariantList *newData) {
 		// the data is out of date
 	}
 
-	const QString &dataSourcePath(m_dataSetIterator.key());
-	const QVariantList &data(m_dataSet->data());
-
-	QVariantList::const_iterator dataIndex(data.begin());
-	QVariantList::const_iterator end(data.end());
+	const QVector<double> &data(dataSet.values());
 
-	updateMonth(*m_firstMonth, valuesToCopyForFirstMonth,
-			currentDate.daysInMonth(), dataIndex, end);
+	QVector<double>::const_iterator dataIndex(data.constBegin());
+	QVector<double>::const_iterator end(data.constEnd());
 
-	updateMonth(*m_secondMonth, valuesToCopyForSecondMonth,
-			secondMonthDate.daysInMonth(), dataIndex, end);
+	firstMonth.update(currentDate, valuesToCopyForFirstMonth, dataIndex, end);
+	secondMonth.update(secondMonthDate, valuesToCopyForSecondMonth, dataIndex,
+			end);
+}
 
-	DataSourcePtr dataSource(m_userMetricsStore->dataSource(dataSourcePath));
-	if (m_dataSourceFormatStringConnection) {
-		disconnect(m_dataSourceFormatStringConnection);
-	}
-	if (m_dataSourceEmptyDataStringConnection) {
-		disconnect(m_dataSourceEmptyDataStringConnection);
-	}
-	m_dataSourceFormatStringConnection = connect(dataSource.data(), SIGNAL(formatStringChanged(const QString &)),
-			this, SLOT(dataSourceStringsChanged()));
-	m_dataSourceEmptyDataStringConnection = connect(dataSource.data(), SIGNAL(emptyDataStringChanged(const QString &)),
-			this, SLOT(dataSourceStringsChanged()));
-	if (dataSource.isNull()) {
-		qWarning() << _("Data source not found") << " [" << dataSourcePath << "]";
-	} else {
-		ColorThemePtrPair colorTheme(
-				m_colorThemeProvider->getColorTheme(dataSourcePath));
-		m_firstColor->setColors(*colorTheme.first);
-		m_secondColor->setColors(*colorTheme.second);
-
-		if (data.empty() || currentDate != lastUpdated
-				|| m_dataSet->head().isNull()) {
-			const QString &emptyDataString = dataSource->emptyDataString();
-			if (emptyDataString.isEmpty()) {
-				QString empty(_("No data for today"));
-				empty.append(" (");
-				empty.append(dataSourcePath);
-				empty.append(")");
-				setLabel(empty);
-			} else {
-				setLabel(emptyDataString);
-			}
+QString UserMetricsImpl::formatLabel(const QDate &currentDate,
+		const DataSet &dataSet, const DataSource &dataSource,
+		const QString &dataSourcePath) {
+	QString label;
+
+	if (dataSet.values().empty() || currentDate != dataSet.lastUpdated()
+			|| dataSet.head().isNull()) {
+		const QString &emptyDataString = dataSource.emptyDataString();
+		if (emptyDataString.isEmpty()) {
+			QString empty(_("No data for today"));
+			empty.append(" (");
+			empty.append(dataSourcePath);
+			empty.append(")");
+			label = empty;
 		} else {
-			QString label;
-			if (!dataSource->formatString().isEmpty()) {
-				label = dataSource->formatString().arg(
-						m_dataSet->head().toString());
-			}
-			setLabel(label);
+			label = emptyDataString;
 		}
+	} else if (!dataSource.formatString().isEmpty()) {
+		label = dataSource.formatString().arg(dataSet.head().toString());
 	}
+
+	return label;
 }
 
 QString UserMetricsImpl::label() const {
@@ -320,6 +523,10 @@ QAbstractItemModel * UserMetricsImpl::secondMonth() const {
 	return m_secondMonth.data();
 }
 
+QAbstractItemModel * UserMetricsImpl::dataSets() const {
+	return m_dataSets.data();
+}
+
 int UserMetricsImpl::currentDay() const {
 	return m_currentDay;
 }
@@ -329,13 +536,22 @@ void UserMetricsImpl::nextDataSourceSlot() {
 		// check again to see if there's data now
 		checkForUserData();
 	} else {
-		m_oldNoDataForUser = m_noDataForUser;
+		// go by name, as the data set we were showing may have been
+		// removed since
+		UserData::const_iterator it(
+				m_userData->constUpperBound(m_dataSourcePath));
+		if (it == m_userData->constEnd()) {
+			it = m_userData->constBegin();
+		}
 
-		++m_dataSetIterator;
-		if (m_dataSetIterator == m_userData->constEnd()) {
-			m_dataSetIterator = m_userData->constBegin();
+		if (it == m_userData->constEnd()) {
+			// there's nothing left to show
+			checkForUserData();
+		} else {
+			m_oldNoDataForUser = m_noDataForUser;
+			m_dataSourcePath = it.key();
+			m_dataSet = *it;
 		}
-		m_dataSet = *m_dataSetIterator;
 	}
 
 	prepareToLoadDataSource();
@@ -24,7 +24,8 @@
 #include <libusermetricscommon/DateFactory.h>
 #include <libusermetricsoutput/ColorThemeImpl.h>
 #include <libusermetricsoutput/ColorThemeProvider.h>
-#include <libusermetricsoutput/qvariantlistmodel.h>
+#include <libusermetricsoutput/MonthModel.h>
+#include <libusermetricsoutput/UserMetricsListModel.h>
 
 #include <QtCore/QSharedPointer>
 #include <QtCore/QScopedPointer>
@@ -62,30 +63,104 @@ public:
 
 	virtual QAbstractItemModel *secondMonth() const;
 
+	QAbstractItemModel *dataSets() const;
+
+	/**
+	 * Fill the two months from the data set, as seen on currentDate.
+	 */
+	static void fillMonths(const QDate &currentDate, const DataSet &dataSet,
+			MonthModel &firstMonth, MonthModel &secondMonth);
+
+	static QString formatLabel(const QDate &currentDate,
+			const DataSet &dataSet, const DataSource &dataSource,
+			const QString &dataSourcePath);
+
 public Q_SLOTS:
 	virtual void nextDataSourceSlot();
 
 	virtual void readyForDataChangeSlot();
 
 protected Q_SLOTS:
-	virtual void updateCurrentDataSet(const QVariantList *data);
+	virtual void updateCurrentDataSet(const QVector<double> *values);
 
 	virtual void userDataAdded(const QString &username, UserDataPtr userData);
 
 	virtual void dataSetAdded(const QString &dataSourceName);
 
+	virtual void dataSetRemoved(const QString &dataSourceName);
+
 	virtual void dataSourceStringsChanged();
 
+	/**
+	 * Prepare frames for the data sets coming up next in the rotation.
+	 */
+	virtual void warmFrames();
+
+	virtual void warmFrameChanged();
+
 protected:
+	/**
+	 * Everything needed to show one data set, built ahead of time.
+	 */
+	class Frame {
+	public:
+		explicit Frame(QObject *parent);
+
+		~Frame();
+
+		QString m_dataSourcePath;
+
+		DataSetPtr m_dataSet;
+
+		DataSourcePtr m_dataSource;
+
+		QScopedPointer<ColorThemeImpl> m_firstColor;
+
+		QScopedPointer<MonthModel> m_firstMonth;
+
+		QScopedPointer<ColorThemeImpl> m_secondColor;
+
+		QScopedPointer<MonthModel> m_secondMonth;
+
+		QString m_label;
+
+		/**
+		 * The day the frame was built for.
+		 */
+		QDate m_date;
+
+		bool m_ready;
+
+		QList<QMetaObject::Connection> m_connections;
+	};
+
+	typedef QSharedPointer<Frame> FramePtr;
+
+	/**
+	 * How many data sets ahead of the current one are kept ready.
+	 */
+	static const int WARM_FRAMES = 2;
+
+	virtual void buildFrame(Frame &frame);
+
+	/**
+	 * Move the next warm frame into the back buffers, if it is the one
+	 * we want.
+	 */
+	virtual bool takeWarmFrame();
+
+	virtual void watchDataSource(DataSourcePtr dataSource);
+
 	virtual void prepareToLoadDataSource();
 
 	virtual void finishLoadingDataSource();
 
 	virtual void setUsernameInternal(const QString &username);
 
-	virtual void updateMonth(QVariantListModel &month, const int dayOfMonth,
-			const int daysInMonth, QVariantList::const_iterator& index,
-			const QVariantList::const_iterator& end);
+	virtual void updateBuffers(const QDate &currentDate,
+			MonthModel &firstMonth, MonthModel &secondMonth,
+			ColorThemeImpl &firstColor, ColorThemeImpl &secondColor,
+			QString &label);
 
 	virtual void checkForUserData();
 
@@ -99,11 +174,35 @@ protected:
 
 	QScopedPointer<ColorThemeImpl> m_firstColor;
 
-	QScopedPointer<QVariantListModel> m_firstMonth;
+	QScopedPointer<MonthModel> m_firstMonth;
 
 	QScopedPointer<ColorThemeImpl> m_secondColor;
 
-	QScopedPointer<QVariantListModel> m_secondMonth;
+	QScopedPointer<MonthModel> m_secondMonth;
+
+	/**
+	 * Back buffers, the next data set is prepared in these while the UI
+	 * is still showing the current one.
+	 */
+	QScopedPointer<ColorThemeImpl> m_nextFirstColor;
+
+	QScopedPointer<MonthModel> m_nextFirstMonth;
+
+	QScopedPointer<ColorThemeImpl> m_nextSecondColor;
+
+	QScopedPointer<MonthModel> m_nextSecondMonth;
+
+	QString m_nextLabel;
+
+	/**
+	 * The day the back buffers were built for, so the day we show always
+	 * matches the months.
+	 */
+	QDate m_nextDate;
+
+	QScopedPointer<UserMetricsListModel> m_dataSets;
+
+	bool m_swapPending;
 
 	int m_currentDay;
 
@@ -115,17 +214,26 @@ protected:
 
 	QString m_watchUser;
 
-	UserMetricsStore::const_iterator m_userDataIterator;
-
 	UserDataPtr m_userData;
 
-	UserData::const_iterator m_dataSetIterator;
+	/**
+	 * The data set on show, by name rather than by iterator, as the
+	 * user data can change under us.
+	 */
+	QString m_dataSourcePath;
 
 	DataSetPtr m_dataSet;
 
+	QMetaObject::Connection m_dataSetConnection;
+
 	QMetaObject::Connection m_dataSourceFormatStringConnection;
 
 	QMetaObject::Connection m_dataSourceEmptyDataStringConnection;
+
+	/**
+	 * The next data sets in rotation order, ready to be shown.
+	 */
+	QList<FramePtr> m_warmFrames;
 };
 
 }
@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricsoutput/UserMetricsImpl.h>
+#include <libusermetricsoutput/UserMetricsListModel.h>
+
+using namespace UserMetricsOutput;
+using namespace UserMetricsCommon;
+
+UserMetricsListModel::Details::Details(
+		QSharedPointer<DateFactory> dateFactory, DataSetPtr dataSet,
+		QObject *parent) :
+		m_firstColor(new ColorThemeImpl(parent)), m_secondColor(
+				new ColorThemeImpl(parent)), m_firstMonth(
+				new MonthModel(parent)), m_secondMonth(new MonthModel(parent)), m_history(
+				new MonthHistory(dateFactory, dataSet, parent)) {
+}
+
+UserMetricsListModel::Details::~Details() {
+	// a view may still be holding these while the row goes away
+	m_firstColor.take()->deleteLater();
+	m_secondColor.take()->deleteLater();
+	m_firstMonth.take()->deleteLater();
+	m_secondMonth.take()->deleteLater();
+	m_history.take()->deleteLater();
+}
+
+UserMetricsListModel::UserMetricsListModel(
+		QSharedPointer<DateFactory> dateFactory,
+		QSharedPointer<UserMetricsStore> userMetricsStore,
+		QSharedPointer<ColorThemeProvider> colorThemeProvider,
+		QObject *parent) :
+		QAbstractListModel(parent), m_dateFactory(dateFactory), m_userMetricsStore(
+				userMetricsStore), m_colorThemeProvider(colorThemeProvider) {
+	connect(m_userMetricsStore.data(),
+			SIGNAL(userDataAdded(const QString &, UserDataPtr)), this,
+			SLOT(userDataAdded(const QString &, UserDataPtr)));
+}
+
+UserMetricsListModel::~UserMetricsListModel() {
+}
+
+const QString & UserMetricsListModel::username() const {
+	return m_username;
+}
+
+void UserMetricsListModel::setUsername(const QString &username) {
+	if (m_username == username && !m_userData.isNull()) {
+		return;
+	}
+	m_username = username;
+
+	UserMetricsStore::const_iterator it(
+			m_userMetricsStore->constFind(m_username));
+	if (it == m_userMetricsStore->constEnd()) {
+		setUserData(UserDataPtr());
+	} else {
+		setUserData(*it);
+	}
+}
+
+int UserMetricsListModel::rowCount(const QModelIndex &parent) const {
+	if (parent.isValid()) {
+		return 0;
+	}
+	return m_rows.size();
+}
+
+QVariant UserMetricsListModel::data(const QModelIndex &index, int role) const {
+	if (!index.isValid() || index.row() >= m_rows.size()) {
+		return QVariant();
+	}
+
+	if (role == DataSourceRole) {
+		return m_rows.at(index.row()).m_dataSource;
+	}
+
+	switch (role) {
+	case LabelRole:
+		return details(index.row()).m_label;
+	case FirstColorRole:
+		return QVariant::fromValue<QObject *>(
+				details(index.row()).m_firstColor.data());
+	case SecondColorRole:
+		return QVariant::fromValue<QObject *>(
+				details(index.row()).m_secondColor.data());
+	case FirstMonthRole:
+		return QVariant::fromValue<QObject *>(
+				details(index.row()).m_firstMonth.data());
+	case SecondMonthRole:
+		return QVariant::fromValue<QObject *>(
+				details(index.row()).m_secondMonth.data());
+	case HistoryRole:
+		return QVariant::fromValue<QObject *>(
+				details(index.row()).m_history.data());
+	}
+
+	return QVariant();
+}
+
+QHash<int, QByteArray> UserMetricsListModel::roleNames() const {
+	QHash<int, QByteArray> roles;
+	roles[DataSourceRole] = "dataSource";
+	roles[LabelRole] = "label";
+	roles[FirstColorRole] = "firstColor";
+	roles[SecondColorRole] = "secondColor";
+	roles[FirstMonthRole] = "firstMonth";
+	roles[SecondMonthRole] = "secondMonth";
+	roles[HistoryRole] = "history";
+	return roles;
+}
+
+void UserMetricsListModel::userDataAdded(const QString &username,
+		UserDataPtr userData) {
+	if (username == m_username && userData != m_userData) {
+		setUserData(userData);
+	}
+}
+
+void UserMetricsListModel::dataSetAdded(const QString &dataSourceName) {
+	UserData::const_iterator it(m_userData->constFind(dataSourceName));
+	if (it == m_userData->constEnd()) {
+		return;
+	}
+
+	// keep the same order as the user data
+	int row(0);
+	while (row < m_rows.size() && m_rows.at(row).m_dataSource < dataSourceName) {
+		++row;
+	}
+
+	if (row < m_rows.size() && m_rows.at(row).m_dataSource == dataSourceName) {
+		dataSetRemoved(dataSourceName);
+	}
+
+	beginInsertRows(QModelIndex(), row, row);
+	insertRow(row, dataSourceName, *it);
+	endInsertRows();
+}
+
+void UserMetricsListModel::dataSetRemoved(const QString &dataSourceName) {
+	for (int row(0); row < m_rows.size(); ++row) {
+		if (m_rows.at(row).m_dataSource == dataSourceName) {
+			beginRemoveRows(QModelIndex(), row, row);
+			disconnect(m_rows.at(row).m_dataSet.data(), 0, this, 0);
+			m_rows.removeAt(row);
+			endRemoveRows();
+			return;
+		}
+	}
+}
+
+void UserMetricsListModel::dataSetChanged() {
+	for (int row(0); row < m_rows.size(); ++row) {
+		if (m_rows.at(row).m_dataSet.data() == sender()) {
+			refreshRow(row);
+		}
+	}
+}
+
+void UserMetricsListModel::dataSourceChanged() {
+	for (int row(0); row < m_rows.size(); ++row) {
+		DataSourcePtr dataSource(
+				m_userMetricsStore->dataSource(m_rows.at(row).m_dataSource));
+		if (dataSource.data() == sender()) {
+			refreshRow(row);
+		}
+	}
+}
+
+void UserMetricsListModel::setUserData(UserDataPtr userData) {
+	beginResetModel();
+
+	if (!m_userData.isNull()) {
+		disconnect(m_userData.data(), 0, this, 0);
+	}
+	for (const Row &row : m_rows) {
+		disconnect(row.m_dataSet.data(), 0, this, 0);
+	}
+	m_rows.clear();
+
+	m_userData = userData;
+
+	if (!m_userData.isNull()) {
+		connect(m_userData.data(), SIGNAL(dataSetAdded(const QString &)), this,
+				SLOT(dataSetAdded(const QString &)));
+		connect(m_userData.data(), SIGNAL(dataSetRemoved(const QString &)),
+				this, SLOT(dataSetRemoved(const QString &)));
+
+		for (UserData::const_iterator it(m_userData->constBegin());
+				it != m_userData->constEnd(); ++it) {
+			insertRow(m_rows.size(), it.key(), *it);
+		}
+	}
+
+	endResetModel();
+}
+
+void UserMetricsListModel::insertRow(int row, const QString &dataSourceName,
+		DataSetPtr dataSet) {
+	Row newRow;
+	newRow.m_dataSource = dataSourceName;
+	newRow.m_dataSet = dataSet;
+	m_rows.insert(row, newRow);
+
+	connect(dataSet.data(), SIGNAL(dataChanged(const QVector<double> *)), this,
+			SLOT(dataSetChanged()));
+}
+
+UserMetricsListModel::Details & UserMetricsListModel::details(int row) const {
+	Row &current(m_rows[row]);
+
+	if (current.m_details.isNull()) {
+		UserMetricsListModel *self(const_cast<UserMetricsListModel *>(this));
+		current.m_details.reset(
+				new Details(m_dateFactory, current.m_dataSet, self));
+		updateDetails(current, *current.m_details);
+
+		DataSourcePtr dataSource(
+				m_userMetricsStore->dataSource(current.m_dataSource));
+		if (!dataSource.isNull()) {
+			connect(dataSource.data(),
+					SIGNAL(formatStringChanged(const QString &)), self,
+					SLOT(dataSourceChanged()), Qt::UniqueConnection);
+			connect(dataSource.data(),
+					SIGNAL(emptyDataStringChanged(const QString &)), self,
+					SLOT(dataSourceChanged()), Qt::UniqueConnection);
+		}
+	}
+
+	return *current.m_details;
+}
+
+void UserMetricsListModel::updateDetails(const Row &row,
+		Details &details) const {
+	const QDate currentDate(m_dateFactory->currentDate());
+
+	UserMetricsImpl::fillMonths(currentDate, *row.m_dataSet,
+			*details.m_firstMonth, *details.m_secondMonth);
+
+	DataSourcePtr dataSource(m_userMetricsStore->dataSource(row.m_dataSource));
+	if (dataSource.isNull()) {
+		details.m_label.clear();
+		return;
+	}
+
+	ColorThemePtrPair colorTheme(
+			m_colorThemeProvider->getColorTheme(row.m_dataSource));
+	if (!colorTheme.first.isNull() && !colorTheme.second.isNull()) {
+		details.m_firstColor->setColors(*colorTheme.first);
+		details.m_secondColor->setColors(*colorTheme.second);
+	}
+
+	details.m_label = UserMetricsImpl::formatLabel(currentDate,
+			*row.m_dataSet, *dataSource, row.m_dataSource);
+}
+
+void UserMetricsListModel::refreshRow(int row) {
+	const Row &current(m_rows.at(row));
+	if (current.m_details.isNull()) {
+		// nobody has looked at this row yet
+		return;
+	}
+
+	const QString oldLabel(current.m_details->m_label);
+	updateDetails(current, *current.m_details);
+
+	if (current.m_details->m_label != oldLabel) {
+		Q_EMIT dataChanged(index(row), index(row), QVector<int>() << LabelRole);
+	}
+}
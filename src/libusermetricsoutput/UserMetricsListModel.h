@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of version 3 of the GNU Lesser General Public License as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSOUTPUT_USERMETRICSLISTMODEL_H_
+#define USERMETRICSOUTPUT_USERMETRICSLISTMODEL_H_
+
+#include <libusermetricsoutput/ColorThemeImpl.h>
+#include <libusermetricsoutput/ColorThemeProvider.h>
+#include <libusermetricsoutput/MonthHistory.h>
+#include <libusermetricsoutput/MonthModel.h>
+#include <libusermetricsoutput/UserMetricsStore.h>
+#include <libusermetricscommon/DateFactory.h>
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QList>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QSharedPointer>
+
+namespace UserMetricsOutput {
+
+/**
+ * All of one user's data sets, one row each, ordered by data source.
+ *
+ * The months, colours and label of a row are only built the first time
+ * a view asks for them, and after that are kept up to date from the
+ * data set's own change signals.
+ */
+class UserMetricsListModel: public QAbstractListModel {
+Q_OBJECT
+
+public:
+	enum Roles {
+		DataSourceRole = Qt::UserRole + 1,
+		LabelRole,
+		FirstColorRole,
+		SecondColorRole,
+		FirstMonthRole,
+		SecondMonthRole,
+		HistoryRole
+	};
+
+	UserMetricsListModel(
+			QSharedPointer<UserMetricsCommon::DateFactory> dateFactory,
+			QSharedPointer<UserMetricsStore> userMetricsStore,
+			QSharedPointer<ColorThemeProvider> colorThemeProvider,
+			QObject *parent = 0);
+
+	virtual ~UserMetricsListModel();
+
+	const QString & username() const;
+
+	void setUsername(const QString &username);
+
+	virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+	virtual QVariant data(const QModelIndex &index, int role =
+			Qt::DisplayRole) const;
+
+	virtual QHash<int, QByteArray> roleNames() const;
+
+protected Q_SLOTS:
+	void userDataAdded(const QString &username, UserDataPtr userData);
+
+	void dataSetAdded(const QString &dataSourceName);
+
+	void dataSetRemoved(const QString &dataSourceName);
+
+	void dataSetChanged();
+
+	void dataSourceChanged();
+
+protected:
+	class Details {
+	public:
+		Details(QSharedPointer<UserMetricsCommon::DateFactory> dateFactory,
+				DataSetPtr dataSet, QObject *parent);
+
+		~Details();
+
+		QString m_label;
+
+		QScopedPointer<ColorThemeImpl> m_firstColor;
+
+		QScopedPointer<ColorThemeImpl> m_secondColor;
+
+		QScopedPointer<MonthModel> m_firstMonth;
+
+		QScopedPointer<MonthModel> m_secondMonth;
+
+		/**
+		 * Every month, fetched a page at a time as it is scrolled to.
+		 */
+		QScopedPointer<MonthHistory> m_history;
+	};
+
+	class Row {
+	public:
+		QString m_dataSource;
+
+		DataSetPtr m_dataSet;
+
+		/**
+		 * Null until a view asks for this row.
+		 */
+		QSharedPointer<Details> m_details;
+	};
+
+	void setUserData(UserDataPtr userData);
+
+	void insertRow(int row, const QString &dataSourceName,
+			DataSetPtr dataSet);
+
+	Details & details(int row) const;
+
+	void updateDetails(const Row &row, Details &details) const;
+
+	void refreshRow(int row);
+
+	QSharedPointer<UserMetricsCommon::DateFactory> m_dateFactory;
+
+	QSharedPointer<UserMetricsStore> m_userMetricsStore;
+
+	QSharedPointer<ColorThemeProvider> m_colorThemeProvider;
+
+	QString m_username;
+
+	UserDataPtr m_userData;
+
+	mutable QList<Row> m_rows;
+};
+
+}
+
+#endif // USERMETRICSOUTPUT_USERMETRICSLISTMODEL_H_
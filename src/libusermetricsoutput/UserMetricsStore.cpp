@@ -47,6 +47,19 @@ DataSourcePtr UserMetricsStore::dataSource(const QString &path) {
 	return m_dataSources.value(path);
 }
 
+void UserMetricsStore::requestUserData(const QString &username) {
+	Q_UNUSED(username);
+}
+
+void UserMetricsStore::retainUserData(const QString &username) {
+	requestUserData(username);
+}
+
+void UserMetricsStore::releaseUserData(const QString &username) {
+	Q_UNUSED(username);
+}
+
 void UserMetricsStore::insert(const QString &name, DataSourcePtr dataSource) {
 	m_dataSources.insert(name, dataSource);
+	dataSourceAdded(name);
 }
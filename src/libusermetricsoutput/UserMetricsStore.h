@@ -52,9 +52,21 @@ public:
 
 	virtual DataSourcePtr dataSource(const QString &path);
 
+	virtual void requestUserData(const QString &username);
+
+	/**
+	 * Request the user's data and keep it loaded until every retain has
+	 * been matched by a release. Views hold on to the user they show.
+	 */
+	virtual void retainUserData(const QString &username);
+
+	virtual void releaseUserData(const QString &username);
+
 Q_SIGNALS:
 	void userDataAdded(const QString &username, UserDataPtr userData);
 
+	void dataSourceAdded(const QString &path);
+
 protected:
 	UserDataMap m_userData;
 
@@ -244,26 +244,49 @@ QVariantList QVariantListModel::variantList() const
 }
 
 /*!
- Sets the model's internal variant list to \a list. The model will
- notify any attached views that its underlying data has changed.
+ Sets the model's internal variant list to \a list. The model compares
+ the new contents with the old ones and only notifies attached views
+ about the rows that differ: changed rows are reported with the smallest
+ set of dataChanged() ranges, and a change in size is reported as rows
+ inserted or removed at the end of the list rather than a model reset.
 
- \sa dataChanged()
+ \sa dataChanged(), rowsInserted(), rowsRemoved()
  */
 void QVariantListModel::setVariantList(const QVariantList &list)
 {
-    int size = lst.size();
-    bool sameSize = list.size() == size;
-    if (!sameSize)
+    const int oldSize = lst.size();
+    const int newSize = list.size();
+
+    if (newSize < oldSize)
     {
-        beginResetModel();
+        beginRemoveRows(QModelIndex(), newSize, oldSize - 1);
+        lst.erase(lst.begin() + newSize, lst.end());
+        endRemoveRows();
     }
-    lst = list;
-    if (!sameSize)
+
+    const int common = lst.size();
+    int first = -1;
+    for (int row = 0; row <= common; ++row)
     {
-        endResetModel();
-    } else
+        const bool changed = row < common && lst.at(row) != list.at(row);
+        if (changed)
+        {
+            lst.replace(row, list.at(row));
+            if (first < 0)
+                first = row;
+        } else if (first >= 0)
+        {
+            dataChanged(QAbstractListModel::index(first),
+                    QAbstractListModel::index(row - 1));
+            first = -1;
+        }
+    }
+
+    if (newSize > oldSize)
     {
-        dataChanged(QAbstractListModel::index(0),
-                QAbstractListModel::index(size - 1));
+        beginInsertRows(QModelIndex(), oldSize, newSize - 1);
+        for (int row = oldSize; row < newSize; ++row)
+            lst.append(list.at(row));
+        endInsertRows();
     }
 }
@@ -17,9 +17,11 @@
 #include <QtQuick/QtQuick>
 #include <modules/UserMetrics/Components.h>
 #include <modules/UserMetrics/Metric.h>
+#include <modules/UserMetrics/MetricHistory.h>
 
 void Components::registerTypes(const char *uri) {
 	qmlRegisterType<Metric>(uri, 0, 1, "Metric");
+	qmlRegisterType<MetricHistory>(uri, 0, 1, "MetricHistory");
 }
 
 void Components::initializeEngine(QQmlEngine *engine, const char *uri) {
@@ -15,24 +15,41 @@
  */
 
 #include <modules/UserMetrics/Metric.h>
-#include <libusermetricscommon/Localisation.h>
 
-#include <stdexcept>
 #include <cmath>
 #include <cfloat>
-#include <QDebug>
+#include <QCoreApplication>
+
+/**
+ * How long increments and updates are held back, so bursts of them cost a
+ * single trip to the service.
+ */
+static const int SEND_INTERVAL = 500;
 
 Metric::Metric(QObject *parent) :
-		QObject(parent), m_componentComplete(false), m_minimum(NAN), m_maximum(
-		NAN) {
-	try {
-		m_metricManager.reset(UserMetricsInput::MetricManager::getInstance());
-	} catch (std::exception &e) {
-		qWarning() << _("Failed to connect to metrics service:") << e.what();
+		QObject(parent), m_dispatcher(MetricDispatcher::singletonInstance()), m_hasPendingValue(
+				false), m_pendingValue(0.0), m_pendingIncrement(0.0), m_componentComplete(
+				false), m_minimum(NAN), m_maximum(NAN) {
+	m_registrationTimer.setSingleShot(true);
+	m_registrationTimer.setInterval(0);
+	connect(&m_registrationTimer, SIGNAL(timeout()), this,
+			SLOT(sendRegistration()));
+
+	m_sendTimer.setSingleShot(true);
+	m_sendTimer.setInterval(SEND_INTERVAL);
+	connect(&m_sendTimer, SIGNAL(timeout()), this, SLOT(sendPendingData()));
+
+	if (QCoreApplication::instance()) {
+		connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this,
+				SLOT(flush()));
 	}
 }
 
 Metric::~Metric() {
+	if (m_registrationTimer.isActive()) {
+		sendRegistration();
+	}
+	sendPendingData();
 }
 
 QString Metric::name() const {
@@ -112,60 +129,84 @@ void Metric::registerMetric() {
 		return;
 	}
 
+	m_registrationTimer.start();
+}
+
+void Metric::sendRegistration() {
+	m_registrationTimer.stop();
+
 	if (m_name.isEmpty() || m_format.isEmpty()) {
 		return;
 	}
 
-	if (m_metricManager.isNull()) {
-		return;
-	}
+	// anything accumulated so far belongs to the previous registration
+	sendPendingData();
+
+	m_registeredName = m_name;
+	m_dispatcher->registerMetric(m_name, m_format, m_emptyFormat, m_domain,
+			m_minimum, m_maximum);
+}
 
-	try {
-		UserMetricsInput::MetricParameters parameters(m_name);
-		parameters.formatString(m_format);
+void Metric::sendPendingData() {
+	m_sendTimer.stop();
 
-		if (!m_emptyFormat.isEmpty()) {
-			parameters.emptyDataString(m_emptyFormat);
-		}
-		if (!m_domain.isEmpty()) {
-			parameters.textDomain(m_domain);
-		}
-		if (!std::isnan(m_minimum)) {
-			parameters.minimum(m_minimum);
+	if (!m_registeredName.isEmpty()) {
+		if (m_hasPendingValue) {
+			m_dispatcher->update(m_registeredName, m_pendingValue);
 		}
-		if (!std::isnan(m_maximum)) {
-			parameters.maximum(m_maximum);
+		if (m_pendingIncrement != 0.0) {
+			m_dispatcher->increment(m_registeredName, m_pendingIncrement);
 		}
-
-		m_metric = m_metricManager->add(parameters);
-	} catch (std::exception &e) {
-		qWarning() << _("Failed to register user metric:") << m_name << "\""
-				<< m_format << "\": " << e.what();
 	}
+
+	m_hasPendingValue = false;
+	m_pendingValue = 0.0;
+	m_pendingIncrement = 0.0;
 }
 
 void Metric::increment(double amount) {
-	if (m_metric.isNull()) {
+	// make sure the registration is queued ahead of us
+	if (m_registrationTimer.isActive()) {
+		sendRegistration();
+	}
+
+	if (m_registeredName.isEmpty()) {
 		return;
 	}
 
-	try {
-		m_metric->increment(amount);
-	} catch (std::exception &e) {
-		qWarning() << _("Failed to increment metric:") << e.what();
+	m_pendingIncrement += amount;
+
+	if (!m_sendTimer.isActive()) {
+		m_sendTimer.start();
 	}
 }
 
 void Metric::update(double value) {
-	if (m_metric.isNull()) {
+	if (m_registrationTimer.isActive()) {
+		sendRegistration();
+	}
+
+	if (m_registeredName.isEmpty()) {
 		return;
 	}
 
-	try {
-		m_metric->update(value);
-	} catch (std::exception &e) {
-		qWarning() << _("Failed to update metric:") << e.what();
+	// an update replaces whatever was accumulated before it
+	m_hasPendingValue = true;
+	m_pendingValue = value;
+	m_pendingIncrement = 0.0;
+
+	if (!m_sendTimer.isActive()) {
+		m_sendTimer.start();
+	}
+}
+
+void Metric::flush() {
+	if (m_registrationTimer.isActive()) {
+		sendRegistration();
 	}
+	sendPendingData();
+
+	m_dispatcher->flush();
 }
 
 void Metric::classBegin() {
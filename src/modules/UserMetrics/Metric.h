@@ -19,7 +19,8 @@
 
 #include <QObject>
 #include <QQmlParserStatus>
-#include <libusermetricsinput/MetricManager.h>
+#include <QTimer>
+#include <modules/UserMetrics/MetricWorker.h>
 
 class Metric: public QObject, public QQmlParserStatus {
 Q_OBJECT
@@ -71,6 +72,12 @@ public Q_SLOTS:
 
 	void update(double value);
 
+	/**
+	 * Send any pending registration and data, and wait until everything
+	 * this element has asked for has reached the service.
+	 */
+	void flush();
+
 Q_SIGNALS:
 	void nameChanged();
 
@@ -84,12 +91,39 @@ Q_SIGNALS:
 
 	void maximumChanged();
 
+protected Q_SLOTS:
+	void sendRegistration();
+
+	void sendPendingData();
+
 protected:
+	/**
+	 * Property changes made in the same event loop turn are coalesced
+	 * into a single registration.
+	 */
 	void registerMetric();
 
-	UserMetricsInput::MetricManagerPtr m_metricManager;
+	MetricDispatcher::Ptr m_dispatcher;
+
+	QTimer m_registrationTimer;
+
+	/**
+	 * The name of the metric last sent for registration; updates are
+	 * directed here.
+	 */
+	QString m_registeredName;
+
+	/**
+	 * Increments and updates are accumulated here and sent in one go when
+	 * the timer fires.
+	 */
+	QTimer m_sendTimer;
+
+	bool m_hasPendingValue;
+
+	double m_pendingValue;
 
-	UserMetricsInput::MetricPtr m_metric;
+	double m_pendingIncrement;
 
 	bool m_componentComplete;
 
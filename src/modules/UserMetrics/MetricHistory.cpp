@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <modules/UserMetrics/MetricHistory.h>
+#include <libusermetricscommon/DateFactoryImpl.h>
+#include <libusermetricscommon/DBusPaths.h>
+#include <libusermetricscommon/Localisation.h>
+#include <libusermetricscommon/UserMetricsInterface.h>
+
+#include <QDateTime>
+#include <QDebug>
+#include <QtDBus/QDBusPendingReply>
+
+using namespace UserMetricsCommon;
+
+/**
+ * How many days are fetched at a time.
+ */
+static const int PAGE_SIZE = 14;
+
+MetricHistory::MetricHistory(QObject *parent) :
+		QAbstractListModel(parent), m_dbusConnection(
+				QDBusConnection::systemBus()), m_dateFactory(
+				new DateFactoryImpl()), m_componentComplete(false), m_username(
+				QString::fromUtf8(qgetenv("USER"))), m_generation(0), m_fetching(false), m_exhausted(
+				false) {
+}
+
+MetricHistory::~MetricHistory() {
+}
+
+QString MetricHistory::name() const {
+	return m_name;
+}
+
+void MetricHistory::setName(const QString &name) {
+	if (name != m_name) {
+		m_name = name;
+		Q_EMIT nameChanged();
+		reset();
+		find();
+	}
+}
+
+QString MetricHistory::username() const {
+	return m_username;
+}
+
+void MetricHistory::setUsername(const QString &username) {
+	if (username != m_username) {
+		m_username = username;
+		Q_EMIT usernameChanged();
+		reset();
+		find();
+	}
+}
+
+int MetricHistory::count() const {
+	return m_values.size();
+}
+
+bool MetricHistory::ready() const {
+	return !m_dataSet.isNull();
+}
+
+int MetricHistory::rowCount(const QModelIndex &parent) const {
+	if (parent.isValid()) {
+		return 0;
+	}
+	return m_values.size();
+}
+
+QVariant MetricHistory::data(const QModelIndex &index, int role) const {
+	if (!index.isValid() || index.row() >= m_values.size()) {
+		return QVariant();
+	}
+
+	switch (role) {
+	case DayRole:
+		return index.row();
+	case DateRole:
+		return m_today.addDays(-index.row());
+	case ValueRole:
+		return m_values.at(index.row());
+	}
+
+	return QVariant();
+}
+
+QHash<int, QByteArray> MetricHistory::roleNames() const {
+	QHash<int, QByteArray> roles;
+	roles[DayRole] = "day";
+	roles[DateRole] = "date";
+	roles[ValueRole] = "value";
+	return roles;
+}
+
+QVariantMap MetricHistory::get(int row) const {
+	QVariantMap result;
+	if (row < 0 || row >= m_values.size()) {
+		return result;
+	}
+
+	const QHash<int, QByteArray> roles(roleNames());
+	for (auto it(roles.constBegin()); it != roles.constEnd(); ++it) {
+		result[it.value()] = data(index(row), it.key());
+	}
+	return result;
+}
+
+bool MetricHistory::canFetchMore(const QModelIndex &parent) const {
+	return !parent.isValid() && !m_dataSet.isNull() && !m_fetching
+			&& !m_exhausted;
+}
+
+void MetricHistory::fetchMore(const QModelIndex &parent) {
+	if (!canFetchMore(parent)) {
+		return;
+	}
+
+	m_fetching = true;
+
+	const int fromDay(m_values.size());
+	QDBusPendingCallWatcher *watcher(
+			new QDBusPendingCallWatcher(
+					m_dataSet->dataRange(fromDay, fromDay + PAGE_SIZE - 1),
+					this));
+	watcher->setProperty("generation", m_generation);
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)), this,
+			SLOT(pageFinished(QDBusPendingCallWatcher *)));
+}
+
+void MetricHistory::classBegin() {
+}
+
+void MetricHistory::componentComplete() {
+	m_componentComplete = true;
+	find();
+}
+
+void MetricHistory::reset() {
+	const bool wasReady(ready());
+
+	beginResetModel();
+	m_values.clear();
+	m_dataSet.reset();
+	++m_generation;
+	m_fetching = false;
+	m_exhausted = false;
+	endResetModel();
+
+	Q_EMIT countChanged();
+	if (wasReady) {
+		Q_EMIT readyChanged();
+	}
+}
+
+void MetricHistory::find() {
+	if (!m_componentComplete || m_name.isEmpty()) {
+		return;
+	}
+
+	com::canonical::UserMetrics userMetrics(DBusPaths::serviceName(),
+			DBusPaths::userMetrics(), m_dbusConnection);
+
+	QDBusPendingCallWatcher *watcher(
+			new QDBusPendingCallWatcher(
+					userMetrics.findDataSet(m_username, m_name), this));
+	watcher->setProperty("generation", m_generation);
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)), this,
+			SLOT(findFinished(QDBusPendingCallWatcher *)));
+}
+
+void MetricHistory::findFinished(QDBusPendingCallWatcher *watcher) {
+	watcher->deleteLater();
+
+	if (watcher->property("generation").toInt() != m_generation) {
+		return;
+	}
+
+	QDBusPendingReply<QDBusObjectPath> reply(*watcher);
+	if (reply.isError()) {
+		qWarning() << _("Failed to find metric history:") << m_name
+				<< reply.error().message();
+		return;
+	}
+
+	m_dataSet.reset(
+			new com::canonical::usermetrics::DataSet(DBusPaths::serviceName(),
+					reply.value().path(), m_dbusConnection));
+	connect(m_dataSet.data(), SIGNAL(updated(uint, const QVariantList &)),
+			this, SLOT(updated(uint, const QVariantList &)));
+
+	m_today = m_dateFactory->currentDate();
+	Q_EMIT readyChanged();
+
+	// the first page is always wanted, later ones only when a view asks
+	fetchMore(QModelIndex());
+}
+
+void MetricHistory::pageFinished(QDBusPendingCallWatcher *watcher) {
+	watcher->deleteLater();
+
+	if (watcher->property("generation").toInt() != m_generation) {
+		return;
+	}
+
+	m_fetching = false;
+
+	QDBusPendingReply<QVariantList> reply(*watcher);
+	if (reply.isError()) {
+		qWarning() << _("Failed to fetch metric history:") << m_name
+				<< reply.error().message();
+		// only a short page means there is no more, this one can be
+		// asked for again
+		return;
+	}
+
+	const QVariantList &page(reply.value());
+	if (page.size() < PAGE_SIZE) {
+		m_exhausted = true;
+	}
+	if (page.isEmpty()) {
+		return;
+	}
+
+	beginInsertRows(QModelIndex(), m_values.size(),
+			m_values.size() + page.size() - 1);
+	for (const QVariant &variant : page) {
+		m_values << toValue(variant);
+	}
+	endInsertRows();
+
+	Q_EMIT countChanged();
+}
+
+void MetricHistory::updated(uint lastUpdated, const QVariantList &data) {
+	const QDate today(m_dateFactory->currentDate());
+
+	// a new day has started since we last looked
+	if (m_today.isValid() && m_today < today) {
+		const int newDays(m_today.daysTo(today));
+
+		// anything in flight was asked for by the old day numbers
+		if (m_fetching) {
+			++m_generation;
+			m_fetching = false;
+		}
+
+		beginInsertRows(QModelIndex(), 0, newDays - 1);
+		for (int i(0); i < newDays; ++i) {
+			m_values.prepend(QVariant());
+		}
+		m_today = today;
+		endInsertRows();
+
+		if (m_values.size() > newDays) {
+			Q_EMIT dataChanged(index(newDays), index(m_values.size() - 1),
+					QVector<int>() << DayRole);
+		}
+		Q_EMIT countChanged();
+	}
+
+	const int offset(QDateTime::fromTime_t(lastUpdated).date().daysTo(m_today));
+
+	int first(-1);
+	int last(-1);
+	for (int row(0); row < m_values.size(); ++row) {
+		const int i(row - offset);
+		QVariant value;
+		if (i >= 0 && i < data.size()) {
+			value = toValue(data.at(i));
+		}
+
+		if (value != m_values.at(row)) {
+			m_values[row] = value;
+			if (first == -1) {
+				first = row;
+			}
+			last = row;
+		}
+	}
+
+	if (first != -1) {
+		Q_EMIT dataChanged(index(first), index(last),
+				QVector<int>() << ValueRole);
+	}
+}
+
+QVariant MetricHistory::toValue(const QVariant &variant) {
+	// missing days come over as empty strings
+	if (variant.type() == QVariant::String) {
+		return QVariant();
+	}
+	return variant.toDouble();
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODULES_USERMETRICS_METRICHISTORY_H
+#define MODULES_USERMETRICS_METRICHISTORY_H
+
+#include <QAbstractListModel>
+#include <QDate>
+#include <QQmlParserStatus>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusPendingCallWatcher>
+#include <libusermetricscommon/DateFactory.h>
+#include <libusermetricscommon/DataSetInterface.h>
+
+/**
+ * One row per day of a single metric's history, today first. Nothing is
+ * fetched until a view asks for rows, and older days are paged in as the
+ * view scrolls to them.
+ */
+class MetricHistory: public QAbstractListModel, public QQmlParserStatus {
+Q_OBJECT
+
+Q_INTERFACES (QQmlParserStatus)
+
+Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
+Q_PROPERTY(QString username READ username WRITE setUsername NOTIFY usernameChanged)
+Q_PROPERTY(int count READ count NOTIFY countChanged)
+Q_PROPERTY(bool ready READ ready NOTIFY readyChanged)
+
+public:
+	enum Roles {
+		DayRole = Qt::UserRole + 1, DateRole, ValueRole
+	};
+
+	explicit MetricHistory(QObject *parent = 0);
+
+	virtual ~MetricHistory();
+
+	QString name() const;
+
+	void setName(const QString &name);
+
+	QString username() const;
+
+	void setUsername(const QString &username);
+
+	int count() const;
+
+	bool ready() const;
+
+	int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+	QHash<int, QByteArray> roleNames() const;
+
+	/**
+	 * The roles of a row as a map, for use from QML.
+	 */
+	Q_INVOKABLE QVariantMap get(int row) const;
+
+	bool canFetchMore(const QModelIndex &parent) const;
+
+	void fetchMore(const QModelIndex &parent);
+
+	void classBegin();
+
+	void componentComplete();
+
+Q_SIGNALS:
+	void nameChanged();
+
+	void usernameChanged();
+
+	void countChanged();
+
+	void readyChanged();
+
+protected Q_SLOTS:
+	void findFinished(QDBusPendingCallWatcher *watcher);
+
+	void pageFinished(QDBusPendingCallWatcher *watcher);
+
+	void updated(uint lastUpdated, const QVariantList &data);
+
+protected:
+	void reset();
+
+	void find();
+
+	static QVariant toValue(const QVariant &variant);
+
+	QDBusConnection m_dbusConnection;
+
+	QSharedPointer<UserMetricsCommon::DateFactory> m_dateFactory;
+
+	/**
+	 * The one data set we follow, once we have found it.
+	 */
+	QScopedPointer<com::canonical::usermetrics::DataSet> m_dataSet;
+
+	bool m_componentComplete;
+
+	QString m_name;
+
+	QString m_username;
+
+	/**
+	 * The day our first row stands for.
+	 */
+	QDate m_today;
+
+	QVariantList m_values;
+
+	/**
+	 * Bumped on every reset, so stale replies can be ignored.
+	 */
+	int m_generation;
+
+	bool m_fetching;
+
+	bool m_exhausted;
+};
+
+#endif // MODULES_USERMETRICS_METRICHISTORY_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <modules/UserMetrics/MetricWorker.h>
+#include <libusermetricscommon/Localisation.h>
+
+#include <stdexcept>
+#include <cmath>
+#include <QDebug>
+
+namespace {
+static QWeakPointer<MetricDispatcher> instance;
+}
+
+MetricWorker::MetricWorker(QObject *parent) :
+		QObject(parent), m_connectionFailed(false) {
+}
+
+MetricWorker::~MetricWorker() {
+}
+
+void MetricWorker::registerMetric(const QString &name, const QString &format,
+		const QString &emptyFormat, const QString &domain, double minimum,
+		double maximum) {
+	if (m_metricManager.isNull() && !m_connectionFailed) {
+		try {
+			m_metricManager.reset(
+					UserMetricsInput::MetricManager::getInstance());
+		} catch (std::exception &e) {
+			qWarning() << _("Failed to connect to metrics service:")
+					<< e.what();
+			m_connectionFailed = true;
+		}
+	}
+
+	if (m_metricManager.isNull()) {
+		return;
+	}
+
+	try {
+		UserMetricsInput::MetricParameters parameters(name);
+		parameters.formatString(format);
+
+		if (!emptyFormat.isEmpty()) {
+			parameters.emptyDataString(emptyFormat);
+		}
+		if (!domain.isEmpty()) {
+			parameters.textDomain(domain);
+		}
+		if (!std::isnan(minimum)) {
+			parameters.minimum(minimum);
+		}
+		if (!std::isnan(maximum)) {
+			parameters.maximum(maximum);
+		}
+
+		m_metrics.insert(name, m_metricManager->add(parameters));
+	} catch (std::exception &e) {
+		m_metrics.remove(name);
+		qWarning() << _("Failed to register user metric:") << name << "\""
+				<< format << "\": " << e.what();
+	}
+}
+
+void MetricWorker::increment(const QString &name, double amount) {
+	UserMetricsInput::MetricPtr metric(m_metrics.value(name));
+	if (metric.isNull()) {
+		return;
+	}
+
+	try {
+		metric->increment(amount);
+	} catch (std::exception &e) {
+		qWarning() << _("Failed to increment metric:") << e.what();
+	}
+}
+
+void MetricWorker::update(const QString &name, double value) {
+	UserMetricsInput::MetricPtr metric(m_metrics.value(name));
+	if (metric.isNull()) {
+		return;
+	}
+
+	try {
+		metric->update(value);
+	} catch (std::exception &e) {
+		qWarning() << _("Failed to update metric:") << e.what();
+	}
+}
+
+void MetricWorker::flush() {
+}
+
+MetricDispatcher::Ptr MetricDispatcher::singletonInstance() {
+	MetricDispatcher::Ptr result(instance);
+
+	if (!result) {
+		result.reset(new MetricDispatcher);
+		instance = result;
+	}
+	return result;
+}
+
+MetricDispatcher::MetricDispatcher() :
+		m_worker(new MetricWorker) {
+	m_worker->moveToThread(&m_thread);
+	connect(&m_thread, SIGNAL(finished()), m_worker, SLOT(deleteLater()));
+
+	connect(this,
+			SIGNAL(registerMetric(const QString &, const QString &, const QString &, const QString &, double, double)),
+			m_worker,
+			SLOT(registerMetric(const QString &, const QString &, const QString &, const QString &, double, double)),
+			Qt::QueuedConnection);
+	connect(this, SIGNAL(increment(const QString &, double)), m_worker,
+			SLOT(increment(const QString &, double)), Qt::QueuedConnection);
+	connect(this, SIGNAL(update(const QString &, double)), m_worker,
+			SLOT(update(const QString &, double)), Qt::QueuedConnection);
+
+	m_thread.start();
+}
+
+MetricDispatcher::~MetricDispatcher() {
+	// don't lose anything that hasn't been sent yet
+	flush();
+
+	m_thread.quit();
+	m_thread.wait();
+}
+
+void MetricDispatcher::flush() {
+	if (m_thread.isRunning()) {
+		QMetaObject::invokeMethod(m_worker, "flush",
+				Qt::BlockingQueuedConnection);
+	}
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODULES_USERMETRICS_METRICWORKER_H
+#define MODULES_USERMETRICS_METRICWORKER_H
+
+#include <QMap>
+#include <QObject>
+#include <QSharedPointer>
+#include <QThread>
+#include <libusermetricsinput/MetricManager.h>
+
+/**
+ * Talks to the metrics service on behalf of the QML elements, so their
+ * round trips happen away from the UI thread.
+ */
+class MetricWorker: public QObject {
+Q_OBJECT
+
+public:
+	explicit MetricWorker(QObject *parent = 0);
+
+	virtual ~MetricWorker();
+
+public Q_SLOTS:
+	void registerMetric(const QString &name, const QString &format,
+			const QString &emptyFormat, const QString &domain, double minimum,
+			double maximum);
+
+	void increment(const QString &name, double amount);
+
+	void update(const QString &name, double value);
+
+	/**
+	 * Does nothing, but by the time it runs everything queued before it
+	 * has been sent.
+	 */
+	void flush();
+
+protected:
+	UserMetricsInput::MetricManagerPtr m_metricManager;
+
+	QMap<QString, UserMetricsInput::MetricPtr> m_metrics;
+
+	bool m_connectionFailed;
+};
+
+/**
+ * Hands requests to a MetricWorker running on its own thread, shared by
+ * every QML element. Requests are carried out in the order they are made.
+ */
+class MetricDispatcher: public QObject {
+Q_OBJECT
+
+public:
+	typedef QSharedPointer<MetricDispatcher> Ptr;
+
+	static Ptr singletonInstance();
+
+	MetricDispatcher();
+
+	~MetricDispatcher();
+
+	/**
+	 * Wait until every request made so far has been carried out.
+	 */
+	void flush();
+
+Q_SIGNALS:
+	void registerMetric(const QString &name, const QString &format,
+			const QString &emptyFormat, const QString &domain, double minimum,
+			double maximum);
+
+	void increment(const QString &name, double amount);
+
+	void update(const QString &name, double value);
+
+protected:
+	QThread m_thread;
+
+	MetricWorker *m_worker;
+};
+
+#endif // MODULES_USERMETRICS_METRICWORKER_H
@@ -19,16 +19,99 @@
 #include <usermetricsservice/Authentication.h>
 
 #include <QtDBus/QDBusConnection>
-#include <QtDBus/QDBusConnectionInterface>
 #include <QtDBus/QDBusContext>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusReply>
 #include <pwd.h>
 #include <sys/apparmor.h>
 
 namespace UserMetricsService {
 
+namespace {
+
+static const int CREDENTIAL_THREADS(4);
+
+static const int MAXIMUM_LOOKUPS(256);
+
+static uint busLookup(const QDBusConnection &connection, const QString &method,
+		const QString &service) {
+	// ask the bus directly, as the connection's interface object
+	// belongs to the bus thread
+	QDBusMessage message(
+			QDBusMessage::createMethodCall("org.freedesktop.DBus",
+					"/org/freedesktop/DBus", "org.freedesktop.DBus", method));
+	message << service;
+	QDBusReply<uint> reply(connection.call(message));
+	return reply.value();
+}
+
+/**
+ * Holds on to a lookup while it is on the credential pool, so it can be
+ * forgotten about without pulling it out from under the pool.
+ */
+class RunLookup: public QRunnable {
+public:
+	explicit RunLookup(CredentialLookupPtr lookup) :
+			m_lookup(lookup) {
+	}
+
+	virtual void run() {
+		m_lookup->run();
+	}
+
+protected:
+	CredentialLookupPtr m_lookup;
+};
+
+}
+
+CredentialLookup::CredentialLookup(const Authentication &authentication,
+		const QDBusConnection &connection, const QString &service) :
+		m_authentication(authentication), m_connection(connection), m_service(
+				service), m_finished(false) {
+	setAutoDelete(false);
+}
+
+CredentialLookup::~CredentialLookup() {
+}
+
+void CredentialLookup::run() {
+	if (qEnvironmentVariableIsSet("USERMETRICS_NO_AUTH")) {
+		m_confinementContext = "unconfined";
+	} else {
+		m_username = m_authentication.lookupUsername(m_connection, m_service);
+		m_confinementContext = m_authentication.lookupConfinementContext(
+				m_connection, m_service);
+	}
+
+	QMetaObject::invokeMethod(this, "markFinished", Qt::QueuedConnection);
+}
+
+void CredentialLookup::markFinished() {
+	m_finished = true;
+	Q_EMIT finished();
+}
+
+bool CredentialLookup::isFinished() const {
+	return m_finished;
+}
+
+QString CredentialLookup::username() const {
+	return m_username;
+}
+
+QString CredentialLookup::confinementContext() const {
+	return m_confinementContext;
+}
+
 Authentication::Authentication() :
 		m_clickRegex(
 				"[a-z0-9][a-z0-9+.-]+_[a-zA-Z0-9+.-]+_[0-9][a-zA-Z0-9.+:~-]*") {
+	m_threadPool.setMaxThreadCount(CREDENTIAL_THREADS);
+
+	m_serviceWatcher.setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+	connect(&m_serviceWatcher, SIGNAL(serviceUnregistered(const QString &)),
+			this, SLOT(serviceUnregistered(const QString &)));
 }
 
 Authentication::~Authentication() {
@@ -41,9 +124,14 @@ QString Authentication::getConfinementContext(
 		return "unconfined";
 	}
 
-	const QDBusConnectionInterface &interface(
-			*context.connection().interface());
-	unsigned int servicePid = interface.servicePid(context.message().service());
+	return lookupConfinementContext(context.connection(),
+			context.message().service());
+}
+
+QString Authentication::lookupConfinementContext(
+		const QDBusConnection &connection, const QString &service) const {
+	unsigned int servicePid = busLookup(connection,
+			"GetConnectionUnixProcessID", service);
 
 	char *con(0);
 	aa_gettaskcon(servicePid, &con, 0);
@@ -61,9 +149,13 @@ QString Authentication::getUsername(const QDBusContext& context) const {
 		return "";
 	}
 
-	const QDBusConnectionInterface &interface(
-			*context.connection().interface());
-	unsigned int serviceUid = interface.serviceUid(context.message().service());
+	return lookupUsername(context.connection(), context.message().service());
+}
+
+QString Authentication::lookupUsername(const QDBusConnection &connection,
+		const QString &service) const {
+	unsigned int serviceUid = busLookup(connection, "GetConnectionUnixUser",
+			service);
 
 	struct passwd* pwd;
 	char x_buf[1024 * sizeof(*pwd)];
@@ -86,6 +178,55 @@ QString Authentication::getUsername(const QDBusContext& context) const {
 	return username;
 }
 
+CredentialLookupPtr Authentication::lookupCredentials(
+		const QDBusContext &context) const {
+	const QString service(context.message().service());
+
+	CredentialLookupPtr lookup(m_lookups.value(service));
+	if (!lookup.isNull()) {
+		return lookup;
+	}
+
+	if (m_lookups.size() >= MAXIMUM_LOOKUPS) {
+		// forget about clients that have been answered first, they are
+		// unlikely to still be around
+		for (const QString &key : m_lookups.keys()) {
+			if (m_lookups.value(key)->isFinished()) {
+				forgetLookup(key);
+			}
+		}
+	}
+	if (m_lookups.size() >= MAXIMUM_LOOKUPS) {
+		// then the ones that are stuck, the pool keeps them going
+		for (const QString &key : m_lookups.keys()) {
+			forgetLookup(key);
+		}
+	}
+
+	// the lookup belongs to the bus thread, wherever its last user lets
+	// go of it
+	lookup = CredentialLookupPtr(
+			new CredentialLookup(*this, context.connection(), service),
+			&QObject::deleteLater);
+	m_lookups.insert(service, lookup);
+
+	m_serviceWatcher.setConnection(context.connection());
+	m_serviceWatcher.addWatchedService(service);
+
+	m_threadPool.start(new RunLookup(lookup));
+
+	return lookup;
+}
+
+void Authentication::forgetLookup(const QString &service) const {
+	m_lookups.remove(service);
+	m_serviceWatcher.removeWatchedService(service);
+}
+
+void Authentication::serviceUnregistered(const QString &service) {
+	forgetLookup(service);
+}
+
 void Authentication::sendErrorReply(const QDBusContext &context,
 		QDBusError::ErrorType type, const QString &msg) const {
 	if (context.calledFromDBus()) {
@@ -95,7 +236,10 @@ void Authentication::sendErrorReply(const QDBusContext &context,
 
 void Authentication::canonicalizeConfinementContext(
 		QString &confinementContext) const {
-	if (m_clickRegex.exactMatch(confinementContext)) {
+	// matching changes the expression, and we are called from the
+	// credential pool
+	QRegExp clickRegex(m_clickRegex);
+	if (clickRegex.exactMatch(confinementContext)) {
 		QStringList split(confinementContext.split("_"));
 		confinementContext = split.first();
 	}
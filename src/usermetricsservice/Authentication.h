@@ -19,18 +19,77 @@
 #ifndef USERMETRICSSERVICE_AUTHENTICATION_H_
 #define USERMETRICSSERVICE_AUTHENTICATION_H_
 
-#include <QtCore/QString>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
 #include <QtCore/QRegExp>
+#include <QtCore/QRunnable>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/QThreadPool>
+#include <QtDBus/QDBusConnection>
 #include <QtDBus/QDBusError>
+#include <QtDBus/QDBusServiceWatcher>
 
 QT_BEGIN_NAMESPACE
-class QDBusConnection;
 class QDBusContext;
 QT_END_NAMESPACE
 
 namespace UserMetricsService {
 
-class Authentication {
+class Authentication;
+class CredentialLookup;
+
+typedef QSharedPointer<CredentialLookup> CredentialLookupPtr;
+
+/**
+ * Works out the username and confinement context of a bus client on the
+ * credential pool, as the directory and AppArmor can both be slow to
+ * answer.
+ */
+class CredentialLookup: public QObject, public QRunnable {
+Q_OBJECT
+
+public:
+	CredentialLookup(const Authentication &authentication,
+			const QDBusConnection &connection, const QString &service);
+
+	virtual ~CredentialLookup();
+
+	virtual void run();
+
+	bool isFinished() const;
+
+	QString username() const;
+
+	QString confinementContext() const;
+
+Q_SIGNALS:
+	void finished();
+
+protected Q_SLOTS:
+	void markFinished();
+
+protected:
+	const Authentication &m_authentication;
+
+	QDBusConnection m_connection;
+
+	QString m_service;
+
+	QString m_username;
+
+	QString m_confinementContext;
+
+	/**
+	 * Only touched on the bus thread, so nobody sees the lookup finish
+	 * between checking isFinished and connecting to finished.
+	 */
+	bool m_finished;
+};
+
+class Authentication: public QObject {
+Q_OBJECT
+
 public:
 	Authentication();
 
@@ -40,14 +99,55 @@ public:
 
 	virtual QString getUsername(const QDBusContext &context) const;
 
+	/**
+	 * Look up whoever sent the message being handled, without blocking.
+	 * Lookups for a client that are under way or done are shared, so
+	 * unlike getUsername and getConfinementContext the answer is worked
+	 * out once per connection rather than once per call. A client that
+	 * changes its confinement keeps its old answer until it reconnects.
+	 * The answer is forgotten when the client leaves the bus.
+	 */
+	virtual CredentialLookupPtr lookupCredentials(
+			const QDBusContext &context) const;
+
+	/**
+	 * These block, so are best left to the credential pool.
+	 */
+	QString lookupConfinementContext(const QDBusConnection &connection,
+			const QString &service) const;
+
+	QString lookupUsername(const QDBusConnection &connection,
+			const QString &service) const;
+
 	virtual void sendErrorReply(const QDBusContext &context,
 			QDBusError::ErrorType type, const QString &msg = QString()) const;
 
 	virtual void canonicalizeConfinementContext(
 			QString &confinementContext) const;
 
+protected Q_SLOTS:
+	void serviceUnregistered(const QString &service);
+
 protected:
+	void forgetLookup(const QString &service) const;
+
 	QRegExp m_clickRegex;
+
+	/**
+	 * Keyed by unique bus name, which is never handed out twice.
+	 */
+	mutable QHash<QString, CredentialLookupPtr> m_lookups;
+
+	/**
+	 * Watches the clients in m_lookups, so we hear when they go.
+	 */
+	mutable QDBusServiceWatcher m_serviceWatcher;
+
+	/**
+	 * Declared last so it has finished running lookups before anything
+	 * they use goes away.
+	 */
+	mutable QThreadPool m_threadPool;
 };
 
 }
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <usermetricsservice/ColumnarStore.h>
+
+#include <QtCore/QDateTime>
+#include <QtCore/qnumeric.h>
+
+#include <cstring>
+#include <limits>
+#include <new>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace UserMetricsService;
+
+static const int VECTOR_SIZE(2);
+
+static const size_t ALIGNMENT(16);
+
+QVariantMap ColumnarStore::Aggregates::toVariantMap(int column,
+		const QStringList &aggregations) const {
+	const int count(m_count.at(column));
+
+	QVariantMap result;
+	for (const QString &aggregation : aggregations) {
+		if (aggregation == "sum") {
+			result[aggregation] = m_sum.at(column);
+		} else if (aggregation == "count") {
+			result[aggregation] = count;
+		} else if (count == 0) {
+			continue;
+		} else if (aggregation == "mean") {
+			result[aggregation] = m_sum.at(column) / count;
+		} else if (aggregation == "min") {
+			result[aggregation] = m_minimum.at(column);
+		} else if (aggregation == "max") {
+			result[aggregation] = m_maximum.at(column);
+		}
+	}
+	return result;
+}
+
+ColumnarStore::ColumnarStore() :
+		m_data(0), m_stride(0), m_newest(0) {
+}
+
+ColumnarStore::~ColumnarStore() {
+	qFreeAligned(m_data);
+}
+
+bool ColumnarStore::isEnabled() {
+	return qEnvironmentVariableIsSet("USERMETRICS_COLUMNAR_STORE");
+}
+
+int ColumnarStore::columnCount() const {
+	return m_columns.size();
+}
+
+const QList<int> & ColumnarStore::columns() const {
+	return m_columns;
+}
+
+int ColumnarStore::column(int id) const {
+	return m_index.value(id, -1);
+}
+
+QDate ColumnarStore::lastUpdated() const {
+	if (m_newest == 0) {
+		return QDate();
+	}
+	return QDate::fromJulianDay(m_newest);
+}
+
+void ColumnarStore::reserve(int columns) {
+	const int stride(
+			(columns + VECTOR_SIZE - 1) / VECTOR_SIZE * VECTOR_SIZE);
+	if (stride <= m_stride) {
+		return;
+	}
+
+	double *data(
+			static_cast<double *>(qMallocAligned(
+					sizeof(double) * stride * DAYS, ALIGNMENT)));
+	if (!data) {
+		throw bad_alloc();
+	}
+
+	for (int i(0); i < stride * DAYS; ++i) {
+		data[i] = qQNaN();
+	}
+	for (int row(0); m_data && row < DAYS; ++row) {
+		memcpy(data + row * stride, m_data + row * m_stride,
+				sizeof(double) * m_stride);
+	}
+
+	qFreeAligned(m_data);
+	m_data = data;
+	m_stride = stride;
+}
+
+void ColumnarStore::advance(qint64 day) {
+	if (day <= m_newest) {
+		return;
+	}
+
+	const qint64 shift(m_newest == 0 ? DAYS : day - m_newest);
+	m_newest = day;
+
+	if (!m_data) {
+		return;
+	}
+
+	// the rows are contiguous, so moving every column down is one move
+	int blank(DAYS);
+	if (shift < DAYS) {
+		memmove(m_data + shift * m_stride, m_data,
+				sizeof(double) * m_stride * (DAYS - shift));
+		blank = shift;
+	}
+	for (int i(0); i < blank * m_stride; ++i) {
+		m_data[i] = qQNaN();
+	}
+}
+
+void ColumnarStore::setColumn(int id, const QDate &lastUpdated,
+		const QVariantList &data) {
+	int column(m_index.value(id, -1));
+	if (column == -1) {
+		column = m_columns.size();
+		reserve(column + 1);
+		m_columns << id;
+		m_index.insert(id, column);
+	}
+
+	if (lastUpdated.isValid()) {
+		advance(lastUpdated.toJulianDay());
+	}
+
+	for (int row(0); row < DAYS; ++row) {
+		m_data[row * m_stride + column] = qQNaN();
+	}
+
+	if (!lastUpdated.isValid()) {
+		return;
+	}
+
+	int row(m_newest - lastUpdated.toJulianDay());
+	for (auto it(data.constBegin()); it != data.constEnd() && row < DAYS;
+			++it, ++row) {
+		bool ok(false);
+		const double value(it->toDouble(&ok));
+		if (ok && it->type() != QVariant::String) {
+			m_data[row * m_stride + column] = value;
+		}
+	}
+}
+
+void ColumnarStore::removeColumn(int id) {
+	const int column(m_index.value(id, -1));
+	if (column == -1) {
+		return;
+	}
+
+	// move the last column into the gap
+	const int last(m_columns.size() - 1);
+	for (int row(0); row < DAYS; ++row) {
+		double *values(m_data + row * m_stride);
+		values[column] = values[last];
+		values[last] = qQNaN();
+	}
+
+	m_index.remove(id);
+	m_columns[column] = m_columns.at(last);
+	m_columns.removeLast();
+	if (column != last) {
+		m_index.insert(m_columns.at(column), column);
+	}
+}
+
+void ColumnarStore::clear() {
+	qFreeAligned(m_data);
+	m_data = 0;
+	m_stride = 0;
+	m_columns.clear();
+	m_index.clear();
+	m_newest = 0;
+}
+
+double ColumnarStore::value(int column, int row) const {
+	return m_data[row * m_stride + column];
+}
+
+void ColumnarStore::accumulate(const double *row, double *sum, double *count,
+		double *minimum, double *maximum, int size) {
+#ifdef __SSE2__
+	const __m128d one(_mm_set1_pd(1.0));
+	for (int i(0); i < size; i += VECTOR_SIZE) {
+		const __m128d value(_mm_load_pd(row + i));
+		// all ones where we have a value, all zeros for NaN
+		const __m128d valid(_mm_cmpord_pd(value, value));
+
+		_mm_storeu_pd(sum + i,
+				_mm_add_pd(_mm_loadu_pd(sum + i), _mm_and_pd(valid, value)));
+		_mm_storeu_pd(count + i,
+				_mm_add_pd(_mm_loadu_pd(count + i), _mm_and_pd(valid, one)));
+		// min and max hand back the second operand when either is NaN
+		_mm_storeu_pd(minimum + i,
+				_mm_min_pd(value, _mm_loadu_pd(minimum + i)));
+		_mm_storeu_pd(maximum + i,
+				_mm_max_pd(value, _mm_loadu_pd(maximum + i)));
+	}
+#else
+	for (int i(0); i < size; ++i) {
+		const double value(row[i]);
+		if (qIsNaN(value)) {
+			continue;
+		}
+		sum[i] += value;
+		count[i] += 1.0;
+		minimum[i] = qMin(minimum[i], value);
+		maximum[i] = qMax(maximum[i], value);
+	}
+#endif
+}
+
+void ColumnarStore::aggregate(const QDate &today, int fromDay, int toDay,
+		Aggregates &aggregates) const {
+	aggregates.m_sum.fill(0.0, m_stride);
+	aggregates.m_count.fill(0.0, m_stride);
+	aggregates.m_minimum.fill(numeric_limits<double>::infinity(), m_stride);
+	aggregates.m_maximum.fill(-numeric_limits<double>::infinity(), m_stride);
+
+	if (!m_data || m_newest == 0) {
+		return;
+	}
+
+	const int offset(today.toJulianDay() - m_newest);
+	const int first(qMax(0, fromDay - offset));
+	const int last(qMin(DAYS - 1, toDay - offset));
+
+	for (int row(first); row <= last; ++row) {
+		accumulate(m_data + row * m_stride, aggregates.m_sum.data(),
+				aggregates.m_count.data(), aggregates.m_minimum.data(),
+				aggregates.m_maximum.data(), m_stride);
+	}
+}
+
+QVariantMap ColumnarStore::toVariantMap() const {
+	const int columns(m_columns.size());
+
+	// leave off the empty rows at the end
+	int rows(m_data ? DAYS : 0);
+	for (; rows > 0; --rows) {
+		const double *values(m_data + (rows - 1) * m_stride);
+		bool empty(true);
+		for (int column(0); column < columns && empty; ++column) {
+			empty = qIsNaN(values[column]);
+		}
+		if (!empty) {
+			break;
+		}
+	}
+
+	QVariantList data;
+	data.reserve(rows * columns);
+	for (int row(0); row < rows; ++row) {
+		const double *values(m_data + row * m_stride);
+		for (int column(0); column < columns; ++column) {
+			const double value(values[column]);
+			if (qIsNaN(value)) {
+				data << QVariant("");
+			} else {
+				data << value;
+			}
+		}
+	}
+
+	QVariantMap result;
+	result["lastUpdated"] =
+			m_newest == 0 ? uint(0) : QDateTime(lastUpdated()).toTime_t();
+	result["columns"] = columns;
+	result["data"] = data;
+	return result;
+}
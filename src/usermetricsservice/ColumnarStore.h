@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSSERVICE_COLUMNARSTORE_H_
+#define USERMETRICSSERVICE_COLUMNARSTORE_H_
+
+#include <QtCore/QDate>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtCore/QVariantMap>
+#include <QtCore/QVector>
+
+namespace UserMetricsService {
+
+/**
+ * The data of many data sets held side by side in memory, one row per
+ * day and one column per data set, newest day first. Missing days are NaN.
+ *
+ * Rows are contiguous and aligned, so working something out for every
+ * data set at once is a vertical pass over whole rows.
+ */
+class ColumnarStore {
+public:
+	static const int DAYS = 62;
+
+	class Aggregates {
+	public:
+		QVariantMap toVariantMap(int column,
+				const QStringList &aggregations) const;
+
+		QVector<double> m_sum;
+
+		QVector<double> m_count;
+
+		QVector<double> m_minimum;
+
+		QVector<double> m_maximum;
+	};
+
+	ColumnarStore();
+
+	virtual ~ColumnarStore();
+
+	/**
+	 * Turned on by setting USERMETRICS_COLUMNAR_STORE.
+	 */
+	static bool isEnabled();
+
+	int columnCount() const;
+
+	/**
+	 * The data set IDs, in column order.
+	 */
+	const QList<int> & columns() const;
+
+	/**
+	 * The column holding data set id, or -1.
+	 */
+	int column(int id) const;
+
+	/**
+	 * The day of the first row.
+	 */
+	QDate lastUpdated() const;
+
+	/**
+	 * Replace the data set's column with its data, newest first, ending
+	 * on lastUpdated.
+	 */
+	void setColumn(int id, const QDate &lastUpdated, const QVariantList &data);
+
+	void removeColumn(int id);
+
+	void clear();
+
+	double value(int column, int row) const;
+
+	/**
+	 * Aggregate every column over the days from fromDay to toDay days
+	 * before today, inclusive. A reversed range has no days in it.
+	 */
+	void aggregate(const QDate &today, int fromDay, int toDay,
+			Aggregates &aggregates) const;
+
+	/**
+	 * Every row, each one columnCount() values long, from the newest down
+	 * to the oldest day anybody has data for.
+	 */
+	QVariantMap toVariantMap() const;
+
+protected:
+	void reserve(int columns);
+
+	void advance(qint64 day);
+
+	static void accumulate(const double *row, double *sum, double *count,
+			double *minimum, double *maximum, int size);
+
+	double *m_data;
+
+	/**
+	 * Row length in doubles, padded with NaN to a whole number of vectors.
+	 */
+	int m_stride;
+
+	QList<int> m_columns;
+
+	QHash<int, int> m_index;
+
+	qint64 m_newest;
+
+private:
+	Q_DISABLE_COPY(ColumnarStore)
+};
+
+}
+
+#endif // USERMETRICSSERVICE_COLUMNARSTORE_H_
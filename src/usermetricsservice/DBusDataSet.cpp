@@ -19,7 +19,9 @@
 #include <stdexcept>
 
 #include <usermetricsservice/database/DataSet.h>
+#include <usermetricsservice/database/DataSource.h>
 #include <usermetricsservice/Authentication.h>
+#include <usermetricsservice/ColumnarStore.h>
 #include <usermetricsservice/DBusDataSet.h>
 #include <usermetricsservice/DataSetAdaptor.h>
 #include <libusermetricscommon/DateFactory.h>
@@ -28,6 +30,10 @@
 
 #include <QtCore/QByteArray>
 #include <QtCore/QDataStream>
+#include <QtCore/QMetaType>
+#include <QtCore/qnumeric.h>
+
+#include <limits>
 
 #include <QDjangoQuerySet.h>
 
@@ -38,10 +44,11 @@ using namespace UserMetricsService;
 DBusDataSet::DBusDataSet(int id, const QString &dataSource,
 		QDBusConnection &dbusConnection,
 		QSharedPointer<DateFactory> dateFactory,
-		QSharedPointer<Authentication> authentication, QObject *parent) :
+		QSharedPointer<Authentication> authentication,
+		StorageWriterPtr storageWriter, QObject *parent) :
 		QObject(parent), m_dbusConnection(dbusConnection), m_adaptor(
 				new DataSetAdaptor(this)), m_dateFactory(dateFactory), m_authentication(
-				authentication), m_id(id), m_path(DBusPaths::dataSet(m_id)), m_dataSource(
+				authentication), m_storageWriter(storageWriter), m_id(id), m_path(DBusPaths::dataSet(m_id)), m_dataSource(
 				dataSource) {
 
 	// DBus setup
@@ -52,14 +59,91 @@ DBusDataSet::~DBusDataSet() {
 	m_dbusConnection.unregisterObject(m_path);
 }
 
-void DBusDataSet::getData(DataSet &dataSet, QVariantList &data) {
+DataSet & DBusDataSet::storedDataSet() const {
+	if (m_dataSet.isNull()) {
+		m_dataSet.reset(new DataSet());
+		DataSet::findByIdRelated(m_id, m_dataSet.data());
+	}
+	return *m_dataSet;
+}
+
+void DBusDataSet::getData(const DataSet &dataSet, QVariantList &data) {
 	QDataStream dataStream(dataSet.data());
 	dataStream >> data;
 }
 
+bool DBusDataSet::readValues(const QByteArray &byteArray,
+		QVector<double> &values) {
+	values.clear();
+
+	if (byteArray.isEmpty()) {
+		return true;
+	}
+
+	// walk the serialised QVariantList directly, all we expect to find
+	// are doubles and the empty strings that stand in for missing days
+	QDataStream dataStream(byteArray);
+
+	quint32 size(0);
+	dataStream >> size;
+	values.reserve(qMin(size, quint32(62)));
+
+	for (quint32 i(0); i < size && dataStream.status() == QDataStream::Ok;
+			++i) {
+		quint32 type(0);
+		qint8 isNull(0);
+		dataStream >> type >> isNull;
+
+		if (type == QMetaType::Double) {
+			double value(0.0);
+			dataStream >> value;
+			values << value;
+		} else if (type == QMetaType::QString) {
+			quint32 length(0);
+			dataStream >> length;
+			if (length != 0xffffffff) {
+				dataStream.skipRawData(length);
+			}
+			values << qQNaN();
+		} else {
+			return false;
+		}
+	}
+
+	return dataStream.status() == QDataStream::Ok;
+}
+
+void DBusDataSet::readAllValues(const DataSet &dataSet,
+		QVector<double> &values) {
+	if (readValues(dataSet.data(), values)) {
+		return;
+	}
+
+	// something we didn't write ourselves, do it the slow way
+	QVariantList data;
+	getData(dataSet, data);
+
+	values.clear();
+	for (const QVariant &variant : data) {
+		bool ok(false);
+		double value(variant.toDouble(&ok));
+		if (!ok || variant.type() == QVariant::String) {
+			value = qQNaN();
+		}
+		values << value;
+	}
+}
+
+int DBusDataSet::daysSinceUpdate(const DataSet &dataSet) const {
+	// the stored data starts on the last day it was updated
+	if (!dataSet.lastUpdated().isValid()) {
+		return 0;
+	}
+	return dataSet.lastUpdated().daysTo(m_dateFactory->currentDate());
+}
+
 QVariantList DBusDataSet::data() const {
-	DataSet dataSet;
-	DataSet::findById(m_id, &dataSet);
+	const DataSet &dataSet(storedDataSet());
 
 	QVariantList data;
 	getData(dataSet, data);
@@ -68,9 +152,11 @@ QVariantList DBusDataSet::data() const {
 }
 
 void DBusDataSet::internalUpdate(DataSet &dataSet, const QVariantList &oldData,
-		const QVariantList &data) {
+		const QVariantList &data, const QDBusMessage &message,
+		bool incremented) {
 	QDate currentDate(m_dateFactory->currentDate());
-	int daysSinceLastUpdate(dataSet.lastUpdated().daysTo(currentDate));
+	const QDate oldLastUpdated(dataSet.lastUpdated());
+	int daysSinceLastUpdate(oldLastUpdated.daysTo(currentDate));
 
 	QVariantList newData(data);
 
@@ -122,31 +208,148 @@ void DBusDataSet::internalUpdate(DataSet &dataSet, const QVariantList &oldData,
 
 	dataSet.setLastUpdated(currentDate);
 	dataSet.setData(byteArray);
-	if (!dataSet.save()) {
-		throw logic_error(_("Could not save data set"));
+
+	if (m_storageWriter.isNull()) {
+		if (!dataSet.save()) {
+			throw logic_error(_("Could not save data set"));
+		}
+		if (message.type() == QDBusMessage::MethodCallMessage) {
+			m_dbusConnection.send(message.createReply());
+		}
+	} else {
+		// answer the caller once the data is on disk, everybody else
+		// can see the new data straight away, and it is taken back if
+		// the write fails
+		m_storageWriter->write(m_id, currentDate, byteArray, message, this);
+	}
+
+	// an increment only moves today's value, so the windows can be
+	// adjusted rather than worked out again
+	if (incremented && m_aggregates.isValid()) {
+		m_aggregates.setHead(currentDate, newData.first().toDouble());
+	} else {
+		m_aggregates.reset(currentDate, newData);
 	}
 
 	QDateTime dateTime(currentDate);
 	m_adaptor->updated(dateTime.toTime_t(), newData);
+	m_adaptor->aggregatesUpdated(m_aggregates.toVariantMap());
+
+	Q_EMIT dataChanged(m_id, oldLastUpdated, oldData, currentDate, newData);
+}
+
+void DBusDataSet::writeFailed() {
+	if (m_dataSet.isNull()) {
+		return;
+	}
+
+	const QDate oldLastUpdated(m_dataSet->lastUpdated());
+	QVariantList oldData;
+	getData(*m_dataSet, oldData);
+
+	m_dataSet.reset();
+	m_aggregates.invalidate();
+
+	const DataSet &dataSet(storedDataSet());
+	QVariantList data;
+	getData(dataSet, data);
+
+	QDateTime dateTime(dataSet.lastUpdated());
+	m_adaptor->updated(dateTime.toTime_t(), data);
+	m_adaptor->aggregatesUpdated(aggregates());
+
+	Q_EMIT dataChanged(m_id, oldLastUpdated, oldData, dataSet.lastUpdated(),
+			data);
 }
 
 void DBusDataSet::update(const QVariantList &data) {
-	DataSet dataSet;
-	DataSet::findByIdRelated(m_id, &dataSet);
+	if (calledFromDBus()) {
+		queueChange(data, 0.0, false);
+		return;
+	}
+
+	applyUpdate(m_authentication->getUsername(*this),
+			m_authentication->getConfinementContext(*this), data,
+			QDBusMessage());
+}
+
+void DBusDataSet::increment(double amount) {
+	if (calledFromDBus()) {
+		queueChange(QVariantList(), amount, true);
+		return;
+	}
+
+	applyIncrement(m_authentication->getUsername(*this),
+			m_authentication->getConfinementContext(*this), amount,
+			QDBusMessage());
+}
+
+void DBusDataSet::queueChange(const QVariantList &data, double amount,
+		bool incremented) {
+	// looking up the caller can be slow, so answer them when we're done
+	// rather than holding up the bus
+	setDelayedReply(true);
+
+	PendingChange change;
+	change.m_message = message();
+	change.m_credentials = m_authentication->lookupCredentials(*this);
+	change.m_data = data;
+	change.m_amount = amount;
+	change.m_incremented = incremented;
+	m_pendingChanges << change;
+
+	connect(change.m_credentials.data(), SIGNAL(finished()), this,
+			SLOT(applyPendingChanges()), Qt::UniqueConnection);
+
+	applyPendingChanges();
+}
+
+void DBusDataSet::applyPendingChanges() {
+	while (!m_pendingChanges.isEmpty()
+			&& m_pendingChanges.first().m_credentials->isFinished()) {
+		const PendingChange change(m_pendingChanges.takeFirst());
+		const QString username(change.m_credentials->username());
+		const QString confinementContext(
+				change.m_credentials->confinementContext());
+
+		if (change.m_incremented) {
+			applyIncrement(username, confinementContext, change.m_amount,
+					change.m_message);
+		} else {
+			applyUpdate(username, confinementContext, change.m_data,
+					change.m_message);
+		}
+	}
+}
+
+void DBusDataSet::replyWithError(const QDBusMessage &message,
+		QDBusError::ErrorType type, const QString &msg) const {
+	if (message.type() == QDBusMessage::MethodCallMessage) {
+		m_dbusConnection.send(message.createErrorReply(type, msg));
+	} else {
+		m_authentication->sendErrorReply(*this, type, msg);
+	}
+}
+
+void DBusDataSet::applyUpdate(const QString &dbusUsername,
+		const QString &confinementContext, const QVariantList &data,
+		const QDBusMessage &message) {
+	DataSet &dataSet(storedDataSet());
 
-	QString dbusUsername(m_authentication->getUsername(*this));
 	const QString &username(dataSet.userData()->username());
 	if (!dbusUsername.isEmpty() && !username.isEmpty()
 			&& dbusUsername != username) {
-		m_authentication->sendErrorReply(*this, QDBusError::AccessDenied,
+		replyWithError(message, QDBusError::AccessDenied,
 				_("Attempt to update data owned by another user"));
 		return;
 	}
 
-	QString confinementContext(m_authentication->getConfinementContext(*this));
-	const QString &secret(dataSet.dataSource()->secret());
+	// the secret can be claimed after we were created, so look it up
+	DataSource dataSource;
+	DataSource::findById(dataSet.dataSource()->id(), &dataSource);
+	const QString &secret(dataSource.secret());
 	if (secret != "unconfined" && secret != confinementContext) {
-		m_authentication->sendErrorReply(*this, QDBusError::AccessDenied,
+		replyWithError(message, QDBusError::AccessDenied,
 				_("Attempt to update data owned by another application"));
 		return;
 	}
@@ -154,26 +357,28 @@ void DBusDataSet::update(const QVariantList &data) {
 	QVariantList oldData;
 	getData(dataSet, oldData);
 
-	internalUpdate(dataSet, oldData, data);
+	internalUpdate(dataSet, oldData, data, message);
 }
 
-void DBusDataSet::increment(double amount) {
-	DataSet dataSet;
-	DataSet::findByIdRelated(m_id, &dataSet);
+void DBusDataSet::applyIncrement(const QString &dbusUsername,
+		const QString &confinementContext, double amount,
+		const QDBusMessage &message) {
+	DataSet &dataSet(storedDataSet());
 
-	QString dbusUsername(m_authentication->getUsername(*this));
 	const QString &username(dataSet.userData()->username());
 	if (!dbusUsername.isEmpty() && !username.isEmpty()
 			&& dbusUsername != username) {
-		m_authentication->sendErrorReply(*this, QDBusError::AccessDenied,
+		replyWithError(message, QDBusError::AccessDenied,
 				_("Attempt to increment data owned by another user"));
 		return;
 	}
 
-	QString confinementContext(m_authentication->getConfinementContext(*this));
-	const QString &secret(dataSet.dataSource()->secret());
+	// the secret can be claimed after we were created, so look it up
+	DataSource dataSource;
+	DataSource::findById(dataSet.dataSource()->id(), &dataSource);
+	const QString &secret(dataSource.secret());
 	if (secret != "unconfined" && secret != confinementContext) {
-		m_authentication->sendErrorReply(*this, QDBusError::AccessDenied,
+		replyWithError(message, QDBusError::AccessDenied,
 				_("Attempt to increment data owned by another application"));
 		return;
 	}
@@ -192,7 +397,7 @@ void DBusDataSet::increment(double amount) {
 		data << amount;
 	}
 
-	internalUpdate(dataSet, oldData, data);
+	internalUpdate(dataSet, oldData, data, message, true);
 }
 
 uint DBusDataSet::lastUpdated() const {
@@ -202,8 +407,7 @@ uint DBusDataSet::lastUpdated() const {
 }
 
 QDate DBusDataSet::lastUpdatedDate() const {
-	DataSet dataSet;
-	DataSet::findById(m_id, &dataSet);
+	const DataSet &dataSet(storedDataSet());
 	return dataSet.lastUpdated();
 }
 
@@ -218,3 +422,115 @@ QString DBusDataSet::path() const {
 QDBusObjectPath DBusDataSet::dataSource() const {
 	return QDBusObjectPath(m_dataSource);
 }
+
+QVariantMap DBusDataSet::snapshot() const {
+	const DataSet &dataSet(storedDataSet());
+
+	QVariantList data;
+	getData(dataSet, data);
+
+	QVariantMap result;
+	result["dataSource"] = QVariant::fromValue(dataSource());
+	result["lastUpdated"] = QDateTime(dataSet.lastUpdated()).toTime_t();
+	result["data"] = data;
+	return result;
+}
+
+QVariantMap DBusDataSet::aggregates() const {
+	if (!m_aggregates.isValid()) {
+		const DataSet &dataSet(storedDataSet());
+
+		QVariantList data;
+		getData(dataSet, data);
+
+		m_aggregates.reset(dataSet.lastUpdated(), data);
+	}
+
+	// days might have dropped out since the last write
+	m_aggregates.advance(m_dateFactory->currentDate());
+
+	return m_aggregates.toVariantMap();
+}
+
+bool DBusDataSet::isValidAggregation(const QStringList &aggregations) {
+	static const QStringList VALID_AGGREGATIONS( { "sum", "mean", "min",
+			"max", "count" });
+
+	for (const QString &aggregation : aggregations) {
+		if (!VALID_AGGREGATIONS.contains(aggregation)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+QVariantMap DBusDataSet::query(int fromDay, int toDay,
+		const QStringList &aggregations) const {
+	if (fromDay < 0 || toDay < fromDay
+			|| !isValidAggregation(aggregations)) {
+		m_authentication->sendErrorReply(*this, QDBusError::InvalidArgs,
+				_("Invalid query"));
+		return QVariantMap();
+	}
+
+	return internalQuery(fromDay, toDay, aggregations);
+}
+
+QVariantMap DBusDataSet::internalQuery(int fromDay, int toDay,
+		const QStringList &aggregations) const {
+	const DataSet &dataSet(storedDataSet());
+
+	QVector<double> values;
+	readAllValues(dataSet, values);
+
+	const int offset(daysSinceUpdate(dataSet));
+
+	ColumnarStore::Aggregates aggregates;
+	aggregates.m_sum << 0.0;
+	aggregates.m_count << 0.0;
+	aggregates.m_minimum << numeric_limits<double>::max();
+	aggregates.m_maximum << numeric_limits<double>::lowest();
+
+	const int first(qMax(0, fromDay - offset));
+	const int last(qMin(values.size() - 1, toDay - offset));
+	for (int i(first); i <= last; ++i) {
+		const double value(values.at(i));
+		if (qIsNaN(value)) {
+			continue;
+		}
+		aggregates.m_sum[0] += value;
+		aggregates.m_count[0] += 1.0;
+		aggregates.m_minimum[0] = qMin(aggregates.m_minimum.at(0), value);
+		aggregates.m_maximum[0] = qMax(aggregates.m_maximum.at(0), value);
+	}
+
+	return aggregates.toVariantMap(0, aggregations);
+}
+
+QVariantList DBusDataSet::dataRange(int fromDay, int toDay) const {
+	if (fromDay < 0 || toDay < fromDay) {
+		m_authentication->sendErrorReply(*this, QDBusError::InvalidArgs,
+				_("Invalid data range"));
+		return QVariantList();
+	}
+
+	const DataSet &dataSet(storedDataSet());
+
+	QVector<double> values;
+	readAllValues(dataSet, values);
+
+	const int offset(daysSinceUpdate(dataSet));
+	const int last(qMin(toDay, offset + values.size() - 1));
+
+	QVariantList result;
+	for (int day(fromDay); day <= last; ++day) {
+		const int i(day - offset);
+		if (i < 0 || qIsNaN(values.at(i))) {
+			result << "";
+		} else {
+			result << values.at(i);
+		}
+	}
+
+	return result;
+}
@@ -19,12 +19,21 @@
 #ifndef USERMETRICSSERVICE_DBUSDATASET_H_
 #define USERMETRICSSERVICE_DBUSDATASET_H_
 
+#include <usermetricsservice/Authentication.h>
+#include <usermetricsservice/RollingAggregates.h>
+#include <usermetricsservice/StorageWriter.h>
+
 #include <QtCore/QObject>
 #include <QtCore/QDate>
+#include <QtCore/QList>
 #include <QtCore/QScopedPointer>
 #include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QVariantMap>
+#include <QtCore/QVector>
 #include <QtDBus/QDBusContext>
 #include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
 #include <QtDBus/QDBusObjectPath>
 
 class DataSetAdaptor;
@@ -35,7 +44,6 @@ class DateFactory;
 
 namespace UserMetricsService {
 
-class Authentication;
 class DataSet;
 class DBusDataSet;
 
@@ -50,11 +58,15 @@ Q_PROPERTY(uint lastUpdated READ lastUpdated)
 
 Q_PROPERTY(QDBusObjectPath dataSource READ dataSource)
 
+Q_PROPERTY(QVariantMap aggregates READ aggregates)
+
 public:
 	DBusDataSet(int id, const QString &dataSource,
 			QDBusConnection &dbusConnection,
 			QSharedPointer<UserMetricsCommon::DateFactory> dateFactory,
-			QSharedPointer<Authentication> authentication, QObject *parent = 0);
+			QSharedPointer<Authentication> authentication,
+			StorageWriterPtr storageWriter = StorageWriterPtr(),
+			QObject *parent = 0);
 
 	virtual ~DBusDataSet();
 
@@ -70,16 +82,113 @@ public:
 
 	QDate lastUpdatedDate() const;
 
+	QVariantMap snapshot() const;
+
+	QVariantMap aggregates() const;
+
+	/**
+	 * Query without checking the arguments, for callers that have already
+	 * done so.
+	 */
+	QVariantMap internalQuery(int fromDay, int toDay,
+			const QStringList &aggregations) const;
+
+	static bool isValidAggregation(const QStringList &aggregations);
+
+	static void getData(const DataSet &dataSet, QVariantList &data);
+
 public Q_SLOTS:
 	void update(const QVariantList &data);
 
 	void increment(double amount);
 
+	/**
+	 * Aggregate the days from fromDay to toDay days ago, inclusive, where
+	 * day 0 is today. Valid aggregations are sum, mean, min, max and count.
+	 * Like dataRange, toDay can't come before fromDay.
+	 */
+	QVariantMap query(int fromDay, int toDay,
+			const QStringList &aggregations) const;
+
+	/**
+	 * The values from fromDay to toDay days ago, inclusive, with missing
+	 * days as empty strings. The list stops early when the stored history
+	 * runs out.
+	 */
+	QVariantList dataRange(int fromDay, int toDay) const;
+
+Q_SIGNALS:
+	/**
+	 * Our stored data went from oldData to data.
+	 */
+	void dataChanged(int id, const QDate &oldLastUpdated,
+			const QVariantList &oldData, const QDate &lastUpdated,
+			const QVariantList &data);
+
+protected Q_SLOTS:
+	/**
+	 * Carry out the waiting changes whose callers we now know, in the
+	 * order they arrived.
+	 */
+	void applyPendingChanges();
+
+	/**
+	 * One of our writes didn't make it to disk, so go back to what did.
+	 * Called once the rest of our writes are done with.
+	 */
+	void writeFailed();
+
 protected:
-	static void getData(DataSet &dataSet, QVariantList &data);
+	/**
+	 * A change from the bus waiting for its caller's credentials.
+	 */
+	class PendingChange {
+	public:
+		QDBusMessage m_message;
+
+		CredentialLookupPtr m_credentials;
+
+		QVariantList m_data;
+
+		double m_amount;
+
+		bool m_incremented;
+	};
+
+	void queueChange(const QVariantList &data, double amount,
+			bool incremented);
+
+	void applyUpdate(const QString &dbusUsername,
+			const QString &confinementContext, const QVariantList &data,
+			const QDBusMessage &message);
+
+	void applyIncrement(const QString &dbusUsername,
+			const QString &confinementContext, double amount,
+			const QDBusMessage &message);
+
+	/**
+	 * Reply to message if there is one, otherwise to the call being
+	 * handled.
+	 */
+	void replyWithError(const QDBusMessage &message, QDBusError::ErrorType type,
+			const QString &msg) const;
+
+	/**
+	 * Our row from the database, read the first time it is needed and
+	 * then kept in step with our own writes.
+	 */
+	DataSet & storedDataSet() const;
+
+	static bool readValues(const QByteArray &byteArray,
+			QVector<double> &values);
+
+	static void readAllValues(const DataSet &dataSet, QVector<double> &values);
+
+	int daysSinceUpdate(const DataSet &dataSet) const;
 
 	void internalUpdate(DataSet &dataSet, const QVariantList &oldData,
-			const QVariantList &data);
+			const QVariantList &data, const QDBusMessage &message,
+			bool incremented = false);
 
 	QDBusConnection m_dbusConnection;
 
@@ -89,11 +198,25 @@ protected:
 
 	QSharedPointer<Authentication> m_authentication;
 
+	/**
+	 * Saves our writes off the bus thread, or null to save them in place.
+	 */
+	StorageWriterPtr m_storageWriter;
+
+	mutable QScopedPointer<DataSet> m_dataSet;
+
+	QList<PendingChange> m_pendingChanges;
+
 	int m_id;
 
 	QString m_path;
 
 	QString m_dataSource;
+
+	/**
+	 * Built from the stored data the first time anybody asks.
+	 */
+	mutable RollingAggregates m_aggregates;
 };
 
 }
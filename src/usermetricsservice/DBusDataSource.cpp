@@ -16,15 +16,21 @@
  * Author: Pete Woods <pete.woods@canonical.com>
  */
 
+#include <new>
 #include <stdexcept>
 
+#include <usermetricsservice/database/DataSet.h>
 #include <usermetricsservice/database/DataSource.h>
+#include <usermetricsservice/DBusDataSet.h>
 #include <usermetricsservice/DBusDataSource.h>
 #include <usermetricsservice/DataSourceAdaptor.h>
 #include <usermetricsservice/TranslationLocator.h>
 #include <libusermetricscommon/DBusPaths.h>
 #include <libusermetricscommon/Localisation.h>
 
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+
 #include <QDjangoQuerySet.h>
 
 using namespace std;
@@ -33,11 +39,13 @@ using namespace UserMetricsService;
 
 DBusDataSource::DBusDataSource(int id, const QString &name,
 		const QString &packageId, QDBusConnection &dbusConnection,
-		QSharedPointer<TranslationLocator> translationLocator, QObject *parent) :
+		QSharedPointer<TranslationLocator> translationLocator,
+		StorageWriterPtr storageWriter, QObject *parent) :
 		QObject(parent), m_dbusConnection(dbusConnection), m_adaptor(
 				new DataSourceAdaptor(this)), m_id(id), m_path(
 				DBusPaths::dataSource(m_id)), m_name(name), m_packageId(
-				packageId), m_translationLocator(translationLocator) {
+				packageId), m_translationLocator(translationLocator), m_storageWriter(
+				storageWriter) {
 
 	// DBus setup
 	m_dbusConnection.registerObject(m_path, this);
@@ -248,3 +256,143 @@ QVariantMap DBusDataSource::options() const {
 	DataSource::findById(m_id, &dataSource);
 	return generateOptions(dataSource);
 }
+
+QVariantMap DBusDataSource::snapshot() const {
+	DataSource dataSource;
+	DataSource::findById(m_id, &dataSource);
+
+	QVariantMap result;
+	result["name"] = m_name;
+	result["formatString"] = dataSource.formatString();
+	result["emptyDataString"] = dataSource.emptyDataString();
+	result["textDomain"] = dataSource.textDomain();
+	result["metricType"] = uint(dataSource.type());
+	result["options"] = generateOptions(dataSource);
+	result["translationPath"] = translationPath();
+	return result;
+}
+
+QVariantMap DBusDataSource::totals() const {
+	if (!m_totals.isValid()) {
+		m_totals.reset();
+
+		QDjangoQuerySet<DataSet> dataSets;
+		QDjangoQuerySet<DataSet> query(
+				dataSets.filter(
+						QDjangoWhere("dataSource_id", QDjangoWhere::Equals,
+								m_id)));
+		for (const DataSet &dataSet : query) {
+			QDate lastUpdated;
+			QVariantList data;
+			latestData(dataSet, lastUpdated, data);
+			m_totals.add(lastUpdated, data);
+		}
+	}
+
+	return m_totals.toVariantMap();
+}
+
+const ColumnarStore * DBusDataSource::columns() const {
+	if (m_columns.isNull() && ColumnarStore::isEnabled()) {
+		m_columns.reset(new ColumnarStore());
+		try {
+			loadColumns(*m_columns);
+		} catch (bad_alloc &) {
+			// the data sets can still be read one at a time
+			qWarning() << _("Could not load columnar store") << ": ["
+					<< m_name << "]";
+			m_columns.reset();
+		}
+	}
+	return m_columns.data();
+}
+
+void DBusDataSource::latestData(const DataSet &dataSet, QDate &lastUpdated,
+		QVariantList &data) const {
+	QByteArray byteArray;
+	if (m_storageWriter.isNull()
+			|| !m_storageWriter->unsaved(dataSet.id(), lastUpdated,
+					byteArray)) {
+		lastUpdated = dataSet.lastUpdated();
+		byteArray = dataSet.data();
+	}
+
+	QDataStream dataStream(byteArray);
+	dataStream >> data;
+}
+
+void DBusDataSource::loadColumns(ColumnarStore &columns) const {
+	QDjangoQuerySet<DataSet> dataSets;
+	QDjangoQuerySet<DataSet> query(
+			dataSets.filter(
+					QDjangoWhere("dataSource_id", QDjangoWhere::Equals, m_id)));
+	for (const DataSet &dataSet : query) {
+		QDate lastUpdated;
+		QVariantList data;
+		latestData(dataSet, lastUpdated, data);
+		columns.setColumn(dataSet.id(), lastUpdated, data);
+	}
+}
+
+QVariantMap DBusDataSource::exportData() const {
+	QVariantMap result;
+	QList<int> ids;
+
+	const ColumnarStore *store(columns());
+	if (store) {
+		result = store->toVariantMap();
+		ids = store->columns();
+	} else {
+		ColumnarStore temporary;
+		try {
+			loadColumns(temporary);
+		} catch (bad_alloc &) {
+			if (calledFromDBus()) {
+				sendErrorReply(QDBusError::NoMemory,
+						_("Could not export data source"));
+			}
+			return QVariantMap();
+		}
+		result = temporary.toVariantMap();
+		ids = temporary.columns();
+	}
+
+	QVariantList dataSets;
+	for (int id : ids) {
+		dataSets << QVariant::fromValue(QDBusObjectPath(DBusPaths::dataSet(id)));
+	}
+	result["dataSets"] = dataSets;
+
+	return result;
+}
+
+void DBusDataSource::dataSetUpdated(int id, const QDate &oldLastUpdated,
+		const QVariantList &oldData, const QDate &lastUpdated,
+		const QVariantList &data) {
+	if (!m_columns.isNull()) {
+		try {
+			m_columns->setColumn(id, lastUpdated, data);
+		} catch (bad_alloc &) {
+			// we are called from the event loop, so can't let this go;
+			// the store is rebuilt the next time somebody asks for it
+			qWarning() << _("Could not grow columnar store") << ": ["
+					<< m_name << "]";
+			m_columns.reset();
+		}
+	}
+
+	// nobody has asked yet, so it can all be worked out when they do
+	if (!m_totals.isValid()) {
+		return;
+	}
+
+	m_totals.remove(oldLastUpdated, oldData);
+	m_totals.add(lastUpdated, data);
+
+	m_adaptor->totalsUpdated(m_totals.toVariantMap());
+}
+
+void DBusDataSource::invalidateCaches() {
+	m_totals.invalidate();
+	m_columns.reset();
+}
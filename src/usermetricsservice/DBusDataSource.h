@@ -19,6 +19,10 @@
 #ifndef USERMETRICSSERVICE_DBUSDATASOURCE_H_
 #define USERMETRICSSERVICE_DBUSDATASOURCE_H_
 
+#include <usermetricsservice/ColumnarStore.h>
+#include <usermetricsservice/DataSourceTotals.h>
+#include <usermetricsservice/StorageWriter.h>
+
 #include <QtCore/QObject>
 #include <QtCore/QScopedPointer>
 #include <QtCore/QSharedPointer>
@@ -29,6 +33,7 @@ class DataSourceAdaptor;
 
 namespace UserMetricsService {
 
+class DataSet;
 class DataSource;
 class DBusDataSource;
 class TranslationLocator;
@@ -52,9 +57,12 @@ Q_PROPERTY(unsigned int metricType READ metricType WRITE setMetricType)
 
 Q_PROPERTY(QVariantMap options READ options)
 
+Q_PROPERTY(QVariantMap totals READ totals)
+
 public:
 	DBusDataSource(int id, const QString &name, const QString &packageId,
 			QDBusConnection &dbusConnection, QSharedPointer<TranslationLocator>,
+			StorageWriterPtr storageWriter = StorageWriterPtr(),
 			QObject *parent = 0);
 
 	virtual ~DBusDataSource();
@@ -101,11 +109,46 @@ public:
 
 	QVariantMap options() const;
 
+	QVariantMap snapshot() const;
+
+	/**
+	 * Every user's data for this source added together, day by day.
+	 */
+	QVariantMap totals() const;
+
+	/**
+	 * Every user's data for this source side by side, or null unless
+	 * USERMETRICS_COLUMNAR_STORE is set.
+	 */
+	const ColumnarStore * columns() const;
+
+public Q_SLOTS:
+	/**
+	 * Every user's data for this source in one go, a row of values per
+	 * day with the data sets in the order given by "dataSets".
+	 */
+	QVariantMap exportData() const;
+
+	void dataSetUpdated(int id, const QDate &oldLastUpdated,
+			const QVariantList &oldData, const QDate &lastUpdated,
+			const QVariantList &data);
+
+	void invalidateCaches();
+
 protected:
 	void lookupDataSource(DataSource *dataSource) const;
 
 	QVariantMap generateOptions(const DataSource &dataSource) const;
 
+	/**
+	 * What the data set holds, including any write the database hasn't
+	 * caught up with yet.
+	 */
+	void latestData(const DataSet &dataSet, QDate &lastUpdated,
+			QVariantList &data) const;
+
+	void loadColumns(ColumnarStore &columns) const;
+
 	QDBusConnection m_dbusConnection;
 
 	QScopedPointer<DataSourceAdaptor> m_adaptor;
@@ -121,6 +164,19 @@ protected:
 	QString m_packageId;
 
 	QSharedPointer<TranslationLocator> m_translationLocator;
+
+	/**
+	 * Asked for the writes still on their way to the database whenever we
+	 * read the data sets back from it.
+	 */
+	StorageWriterPtr m_storageWriter;
+
+	/**
+	 * Built from the stored data the first time anybody asks.
+	 */
+	mutable DataSourceTotals m_totals;
+
+	mutable QScopedPointer<ColumnarStore> m_columns;
 };
 
 }
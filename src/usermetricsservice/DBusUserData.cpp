@@ -40,10 +40,11 @@ using namespace UserMetricsService;
 DBusUserData::DBusUserData(int id, const QString &username,
 		DBusUserMetrics &userMetrics, QDBusConnection &dbusConnection,
 		QSharedPointer<DateFactory> dateFactory,
-		QSharedPointer<Authentication> authentication, QObject *parent) :
+		QSharedPointer<Authentication> authentication,
+		StorageWriterPtr storageWriter, QObject *parent) :
 		QObject(parent), m_dbusConnection(dbusConnection), m_adaptor(
 				new UserDataAdaptor(this)), m_dateFactory(dateFactory), m_authentication(
-				authentication), m_userMetrics(userMetrics), m_id(id), m_path(
+				authentication), m_storageWriter(storageWriter), m_userMetrics(userMetrics), m_id(id), m_path(
 				DBusPaths::userData(m_id)), m_username(username) {
 
 	// DBus setup
@@ -76,32 +77,80 @@ QList<QDBusObjectPath> DBusUserData::dataSets() const {
 }
 
 QDBusObjectPath DBusUserData::createDataSet(const QString &dataSourceName) {
+	if (calledFromDBus()) {
+		// looking up the caller can be slow, so answer them when we're
+		// done rather than holding up the bus
+		setDelayedReply(true);
+
+		PendingCreate create;
+		create.m_message = message();
+		create.m_credentials = m_authentication->lookupCredentials(*this);
+		create.m_dataSource = dataSourceName;
+		m_pendingCreates << create;
+
+		connect(create.m_credentials.data(), SIGNAL(finished()), this,
+				SLOT(applyPendingCreates()), Qt::UniqueConnection);
+
+		applyPendingCreates();
+		return QDBusObjectPath();
+	}
+
+	return applyCreateDataSet(m_authentication->getUsername(*this),
+			m_authentication->getConfinementContext(*this), dataSourceName,
+			QDBusMessage());
+}
+
+void DBusUserData::applyPendingCreates() {
+	while (!m_pendingCreates.isEmpty()
+			&& m_pendingCreates.first().m_credentials->isFinished()) {
+		const PendingCreate create(m_pendingCreates.takeFirst());
+		applyCreateDataSet(create.m_credentials->username(),
+				create.m_credentials->confinementContext(),
+				create.m_dataSource, create.m_message);
+	}
+}
+
+void DBusUserData::replyWithError(const QDBusMessage &message,
+		QDBusError::ErrorType type, const QString &msg) const {
+	if (message.type() == QDBusMessage::MethodCallMessage) {
+		m_dbusConnection.send(message.createErrorReply(type, msg));
+	} else {
+		m_authentication->sendErrorReply(*this, type, msg);
+	}
+}
+
+QDBusObjectPath DBusUserData::applyCreateDataSet(const QString &dbusUsername,
+		const QString &confinementContext, const QString &dataSourceName,
+		const QDBusMessage &message) {
 	if (!DataSource::exists(dataSourceName)) {
 		qWarning() << _("Unknown data source") << ": [" << dataSourceName
 				<< "]";
+		if (message.type() == QDBusMessage::MethodCallMessage) {
+			m_dbusConnection.send(
+					message.createErrorReply(QDBusError::InvalidArgs,
+							_("Unknown data source")));
+		}
 		return QDBusObjectPath();
 	}
 
-	QString dbusUsername(m_authentication->getUsername(*this));
 	if (!dbusUsername.isEmpty() && !m_username.isEmpty()
 			&& dbusUsername != m_username) {
-		m_authentication->sendErrorReply(*this, QDBusError::AccessDenied,
+		replyWithError(message, QDBusError::AccessDenied,
 				_("Attempt to create data set owned by another user"));
 		return QDBusObjectPath();
 	}
 
-	QString confinementContext(m_authentication->getConfinementContext(*this));
 	DataSource dataSource;
 	DataSource::findByNameAndSecret(dataSourceName, confinementContext,
 			&dataSource);
 	if (!dataSource.isValid()) {
-		m_authentication->sendErrorReply(*this, QDBusError::InternalError,
+		replyWithError(message, QDBusError::InternalError,
 				_("Could not locate user data"));
 		return QDBusObjectPath();
 	}
 	if (dataSource.secret() != "unconfined"
 			&& dataSource.secret() != confinementContext) {
-		m_authentication->sendErrorReply(*this, QDBusError::AccessDenied,
+		replyWithError(message, QDBusError::AccessDenied,
 				_("Attempt to create data set owned by another application"));
 		return QDBusObjectPath();
 	}
@@ -138,7 +187,12 @@ QDBusObjectPath DBusUserData::createDataSet(const QString &dataSourceName) {
 	if (dataSetPtr.isNull()) {
 		throw logic_error(_("New data set could not be found"));
 	}
-	return QDBusObjectPath(dataSetPtr->path());
+
+	const QDBusObjectPath path(dataSetPtr->path());
+	if (message.type() == QDBusMessage::MethodCallMessage) {
+		m_dbusConnection.send(message.createReply(QVariant::fromValue(path)));
+	}
+	return path;
 }
 
 void DBusUserData::syncDatabase() {
@@ -157,8 +211,17 @@ void DBusUserData::syncDatabase() {
 							dataSet.dataSource()->secret()));
 			DBusDataSetPtr dbusDataSet(
 					new DBusDataSet(id, dbusDataSource->path(),
-							m_dbusConnection, m_dateFactory, m_authentication));
+							m_dbusConnection, m_dateFactory, m_authentication,
+							m_storageWriter));
 			m_dataSets.insert(id, dbusDataSet);
+
+			// keep the cross-user data in step with our writes
+			connect(dbusDataSet.data(),
+					SIGNAL(dataChanged(int, const QDate &, const QVariantList &, const QDate &, const QVariantList &)),
+					dbusDataSource.data(),
+					SLOT(dataSetUpdated(int, const QDate &, const QVariantList &, const QDate &, const QVariantList &)));
+			connect(dbusDataSet.data(), SIGNAL(destroyed()),
+					dbusDataSource.data(), SLOT(invalidateCaches()));
 			m_adaptor->dataSetAdded(QDBusObjectPath(dbusDataSet->dataSource()),
 					QDBusObjectPath(dbusDataSet->path()));
 		}
@@ -183,3 +246,34 @@ DBusDataSetPtr DBusUserData::dataSet(const QString &dataSource) const {
 
 	return m_dataSets.value(dataSet->id());
 }
+
+DBusDataSetPtr DBusUserData::findDataSet(const QString &path) const {
+	for (DBusDataSetPtr dataSet : m_dataSets.values()) {
+		if (dataSet->path() == path) {
+			return dataSet;
+		}
+	}
+	return DBusDataSetPtr();
+}
+
+DBusDataSetPtr DBusUserData::findDataSetBySource(
+		const QString &dataSourcePath) const {
+	for (DBusDataSetPtr dataSet : m_dataSets.values()) {
+		if (dataSet->dataSource().path() == dataSourcePath) {
+			return dataSet;
+		}
+	}
+	return DBusDataSetPtr();
+}
+
+QVariantMap DBusUserData::snapshot() const {
+	QVariantMap dataSets;
+	for (DBusDataSetPtr dataSet : m_dataSets.values()) {
+		dataSets[dataSet->path()] = dataSet->snapshot();
+	}
+
+	QVariantMap result;
+	result["username"] = m_username;
+	result["dataSets"] = dataSets;
+	return result;
+}
@@ -19,12 +19,18 @@
 #ifndef USERMETRICSSERVICE_DBUSUSERDATA_H_
 #define USERMETRICSSERVICE_DBUSUSERDATA_H_
 
+#include <usermetricsservice/Authentication.h>
+#include <usermetricsservice/StorageWriter.h>
+
 #include <QtCore/QObject>
 #include <QtCore/QHash>
+#include <QtCore/QList>
 #include <QtCore/QScopedPointer>
 #include <QtCore/QSharedPointer>
+#include <QtCore/QVariantMap>
 #include <QtDBus/QDBusConnection>
 #include <QtDBus/QDBusContext>
+#include <QtDBus/QDBusMessage>
 #include <QtDBus/QDBusObjectPath>
 
 class UserDataAdaptor;
@@ -35,7 +41,6 @@ class DateFactory;
 
 namespace UserMetricsService {
 
-class Authentication;
 class UserData;
 class DBusDataSet;
 class DBusUserData;
@@ -54,7 +59,9 @@ public:
 	DBusUserData(int id, const QString &username, DBusUserMetrics &userMetrics,
 			QDBusConnection &dbusConnection,
 			QSharedPointer<UserMetricsCommon::DateFactory> dateFactory,
-			QSharedPointer<Authentication> authentication, QObject *parent = 0);
+			QSharedPointer<Authentication> authentication,
+			StorageWriterPtr storageWriter = StorageWriterPtr(),
+			QObject *parent = 0);
 
 	virtual ~DBusUserData();
 
@@ -68,7 +75,45 @@ public:
 
 	QSharedPointer<DBusDataSet> dataSet(const QString &dataSource) const;
 
+	QSharedPointer<DBusDataSet> findDataSet(const QString &path) const;
+
+	QSharedPointer<DBusDataSet> findDataSetBySource(
+			const QString &dataSourcePath) const;
+
+	QVariantMap snapshot() const;
+
+protected Q_SLOTS:
+	/**
+	 * Create the data sets whose callers we now know, in the order they
+	 * were asked for.
+	 */
+	void applyPendingCreates();
+
 protected:
+	/**
+	 * A createDataSet call from the bus waiting for its caller's
+	 * credentials.
+	 */
+	class PendingCreate {
+	public:
+		QDBusMessage m_message;
+
+		CredentialLookupPtr m_credentials;
+
+		QString m_dataSource;
+	};
+
+	QDBusObjectPath applyCreateDataSet(const QString &dbusUsername,
+			const QString &confinementContext, const QString &dataSource,
+			const QDBusMessage &message);
+
+	/**
+	 * Reply to message if there is one, otherwise to the call being
+	 * handled.
+	 */
+	void replyWithError(const QDBusMessage &message, QDBusError::ErrorType type,
+			const QString &msg) const;
+
 	void syncDatabase();
 
 	QDBusConnection m_dbusConnection;
@@ -79,6 +124,8 @@ protected:
 
 	QSharedPointer<Authentication> m_authentication;
 
+	StorageWriterPtr m_storageWriter;
+
 	DBusUserMetrics &m_userMetrics;
 
 	int m_id;
@@ -88,6 +135,8 @@ protected:
 	QString m_username;
 
 	QHash<int, QSharedPointer<DBusDataSet>> m_dataSets;
+
+	QList<PendingCreate> m_pendingCreates;
 };
 
 }
@@ -19,6 +19,8 @@
 #include <stdexcept>
 
 #include <usermetricsservice/Authentication.h>
+#include <usermetricsservice/ColumnarStore.h>
+#include <usermetricsservice/DBusDataSet.h>
 #include <usermetricsservice/DBusDataSource.h>
 #include <usermetricsservice/DBusUserMetrics.h>
 #include <usermetricsservice/DBusUserData.h>
@@ -30,6 +32,8 @@
 #include <libusermetricscommon/DBusPaths.h>
 #include <libusermetricscommon/Localisation.h>
 
+#include <QtDBus/QDBusArgument>
+
 #include <QDjango.h>
 #include <QDjangoQuerySet.h>
 
@@ -40,10 +44,12 @@ using namespace UserMetricsService;
 DBusUserMetrics::DBusUserMetrics(const QDBusConnection &dbusConnection,
 		QSharedPointer<DateFactory> dateFactory,
 		QSharedPointer<Authentication> authentication,
-		QSharedPointer<TranslationLocator> translationLocator, QObject *parent) :
+		QSharedPointer<TranslationLocator> translationLocator,
+		StorageWriterPtr storageWriter, QObject *parent) :
 		QObject(parent), m_dbusConnection(dbusConnection), m_adaptor(
 				new UserMetricsAdaptor(this)), m_dateFactory(dateFactory), m_authentication(
-				authentication), m_translationLocator(translationLocator) {
+				authentication), m_translationLocator(translationLocator), m_storageWriter(
+				storageWriter) {
 	// Database setup
 	QDjango::registerModel<DataSource>().createTable();
 	QDjango::registerModel<UserData>().createTable();
@@ -81,7 +87,8 @@ void DBusUserMetrics::syncDatabase() {
 			if (!m_dataSources.contains(id)) {
 				DBusDataSourcePtr dbusDataSource(
 						new DBusDataSource(id, dataSource.name(), dataSource.secret(),
-								m_dbusConnection, m_translationLocator));
+								m_dbusConnection, m_translationLocator,
+								m_storageWriter));
 				m_dataSources.insert(id, dbusDataSource);
 				m_adaptor->dataSourceAdded(
 						QDBusObjectPath(dbusDataSource->path()));
@@ -108,7 +115,7 @@ void DBusUserMetrics::syncDatabase() {
 				DBusUserDataPtr dbusUserData(
 						new DBusUserData(id, userData.username(), *this,
 								m_dbusConnection, m_dateFactory,
-								m_authentication));
+								m_authentication, m_storageWriter));
 				m_userData.insert(id, dbusUserData);
 				m_adaptor->userDataAdded(dbusUserData->username(),
 						QDBusObjectPath(dbusUserData->path()));
@@ -128,9 +135,77 @@ void DBusUserMetrics::syncDatabase() {
 QDBusObjectPath DBusUserMetrics::createDataSource(const QString &name,
 		const QString &formatString, const QString &emptyDataString,
 		const QString &textDomain, int type, const QVariantMap &options) {
+	if (calledFromDBus()) {
+		queueCall();
+		return QDBusObjectPath();
+	}
+
+	return applyCreateDataSource(m_authentication->getConfinementContext(*this),
+			name, formatString, emptyDataString, textDomain, type, options,
+			QDBusMessage());
+}
+
+void DBusUserMetrics::queueCall() {
+	// looking up the caller can be slow, so answer them when we're done
+	// rather than holding up the bus
+	setDelayedReply(true);
+
+	PendingCall call;
+	call.m_message = message();
+	call.m_credentials = m_authentication->lookupCredentials(*this);
+	m_pendingCalls << call;
+
+	connect(call.m_credentials.data(), SIGNAL(finished()), this,
+			SLOT(applyPendingCalls()), Qt::UniqueConnection);
+
+	applyPendingCalls();
+}
+
+void DBusUserMetrics::applyPendingCalls() {
+	while (!m_pendingCalls.isEmpty()
+			&& m_pendingCalls.first().m_credentials->isFinished()) {
+		const PendingCall call(m_pendingCalls.takeFirst());
+		const QDBusMessage &message(call.m_message);
+		const QVariantList arguments(message.arguments());
+
+		if (message.member() == "createDataSource") {
+			applyCreateDataSource(call.m_credentials->confinementContext(),
+					arguments.at(0).toString(), arguments.at(1).toString(),
+					arguments.at(2).toString(), arguments.at(3).toString(),
+					arguments.at(4).toInt(),
+					qdbus_cast<QVariantMap>(arguments.at(5)), message);
+		} else if (message.member() == "createUserData") {
+			applyCreateUserData(call.m_credentials->username(),
+					arguments.at(0).toString(), message);
+		} else if (message.member() == "findDataSet") {
+			applyFindDataSet(call.m_credentials->confinementContext(),
+					arguments.at(0).toString(), arguments.at(1).toString(),
+					message);
+		}
+	}
+}
+
+void DBusUserMetrics::replyWithPath(const QDBusMessage &message,
+		const QDBusObjectPath &path) const {
+	if (message.type() == QDBusMessage::MethodCallMessage) {
+		m_dbusConnection.send(message.createReply(QVariant::fromValue(path)));
+	}
+}
 
-	QString confinementContext(m_authentication->getConfinementContext(*this));
+void DBusUserMetrics::replyWithError(const QDBusMessage &message,
+		QDBusError::ErrorType type, const QString &msg) const {
+	if (message.type() == QDBusMessage::MethodCallMessage) {
+		m_dbusConnection.send(message.createErrorReply(type, msg));
+	} else {
+		m_authentication->sendErrorReply(*this, type, msg);
+	}
+}
 
+QDBusObjectPath DBusUserMetrics::applyCreateDataSource(
+		const QString &confinementContext, const QString &name,
+		const QString &formatString, const QString &emptyDataString,
+		const QString &textDomain, int type, const QVariantMap &options,
+		const QDBusMessage &message) {
 	QDjangoQuerySet<DataSource> dataSourcesQuery;
 	QDjangoQuerySet<DataSource> query(
 			dataSourcesQuery.filter(
@@ -230,7 +305,10 @@ QDBusObjectPath DBusUserMetrics::createDataSource(const QString &name,
 		}
 	}
 
-	return QDBusObjectPath((*m_dataSources.constFind(dataSource.id()))->path());
+	const QDBusObjectPath path(
+			(*m_dataSources.constFind(dataSource.id()))->path());
+	replyWithPath(message, path);
+	return path;
 }
 
 QList<QDBusObjectPath> DBusUserMetrics::userDatas() const {
@@ -242,11 +320,21 @@ QList<QDBusObjectPath> DBusUserMetrics::userDatas() const {
 }
 
 QDBusObjectPath DBusUserMetrics::createUserData(const QString &username) {
-	QString dbusUsername(m_authentication->getUsername(*this));
+	if (calledFromDBus()) {
+		queueCall();
+		return QDBusObjectPath();
+	}
+
+	return applyCreateUserData(m_authentication->getUsername(*this), username,
+			QDBusMessage());
+}
 
+QDBusObjectPath DBusUserMetrics::applyCreateUserData(
+		const QString &dbusUsername, const QString &username,
+		const QDBusMessage &message) {
 	if (!dbusUsername.isEmpty() && !username.isEmpty()
 			&& dbusUsername != username) {
-		m_authentication->sendErrorReply(*this, QDBusError::AccessDenied,
+		replyWithError(message, QDBusError::AccessDenied,
 				_("Attempt to create user data owned by another user"));
 		return QDBusObjectPath();
 	}
@@ -273,7 +361,9 @@ QDBusObjectPath DBusUserMetrics::createUserData(const QString &username) {
 		query.at(0, &userData);
 	}
 
-	return QDBusObjectPath((*m_userData.constFind(userData.id()))->path());
+	const QDBusObjectPath path((*m_userData.constFind(userData.id()))->path());
+	replyWithPath(message, path);
+	return path;
 }
 
 DBusDataSourcePtr DBusUserMetrics::dataSource(const QString &name,
@@ -290,3 +380,115 @@ DBusUserDataPtr DBusUserMetrics::userData(const QString &username) const {
 
 	return m_userData.value(userData.id());
 }
+
+QDBusObjectPath DBusUserMetrics::findDataSet(const QString &username,
+		const QString &dataSource) {
+	if (calledFromDBus()) {
+		queueCall();
+		return QDBusObjectPath();
+	}
+
+	return applyFindDataSet(m_authentication->getConfinementContext(*this),
+			username, dataSource, QDBusMessage());
+}
+
+QDBusObjectPath DBusUserMetrics::applyFindDataSet(
+		const QString &confinementContext, const QString &username,
+		const QString &dataSource, const QDBusMessage &message) const {
+	DBusDataSourcePtr source(this->dataSource(dataSource, confinementContext));
+	if (source.isNull()) {
+		source = this->dataSource(dataSource);
+	}
+
+	DBusUserDataPtr user(userData(username));
+
+	DBusDataSetPtr dataSet;
+	if (!source.isNull() && !user.isNull()) {
+		dataSet = user->findDataSetBySource(source->path());
+	}
+
+	if (dataSet.isNull()) {
+		replyWithError(message, QDBusError::InvalidArgs,
+				_("No such data set"));
+		return QDBusObjectPath();
+	}
+
+	const QDBusObjectPath path(dataSet->path());
+	replyWithPath(message, path);
+	return path;
+}
+
+QVariantMap DBusUserMetrics::snapshot(const QStringList &usernames) const {
+	QVariantMap dataSources;
+	for (DBusDataSourcePtr dataSource : m_dataSources.values()) {
+		dataSources[dataSource->path()] = dataSource->snapshot();
+	}
+
+	QVariantMap userDatas;
+	for (DBusUserDataPtr userData : m_userData.values()) {
+		if (usernames.isEmpty() || usernames.contains(userData->username())) {
+			userDatas[userData->path()] = userData->snapshot();
+		}
+	}
+
+	QVariantMap result;
+	result["dataSources"] = dataSources;
+	result["userDatas"] = userDatas;
+	return result;
+}
+
+QVariantMap DBusUserMetrics::query(const QList<QDBusObjectPath> &dataSets,
+		int fromDay, int toDay, const QStringList &aggregations) const {
+	if (fromDay < 0 || toDay < fromDay
+			|| !DBusDataSet::isValidAggregation(aggregations)) {
+		m_authentication->sendErrorReply(*this, QDBusError::InvalidArgs,
+				_("Invalid query"));
+		return QVariantMap();
+	}
+
+	const bool columnar(ColumnarStore::isEnabled());
+	const QDate today(m_dateFactory->currentDate());
+	// one pass over each data source's rows answers for all its data sets
+	QHash<QString, ColumnarStore::Aggregates> sourceAggregates;
+
+	QVariantMap result;
+	for (const QDBusObjectPath &path : dataSets) {
+		DBusDataSetPtr dataSet;
+		for (DBusUserDataPtr userData : m_userData.values()) {
+			dataSet = userData->findDataSet(path.path());
+			if (!dataSet.isNull()) {
+				break;
+			}
+		}
+
+		if (dataSet.isNull()) {
+			m_authentication->sendErrorReply(*this, QDBusError::InvalidArgs,
+					QString(_("Unknown data set: %1")).arg(path.path()));
+			return QVariantMap();
+		}
+
+		const ColumnarStore *columns(0);
+		if (columnar) {
+			for (DBusDataSourcePtr dataSource : m_dataSources.values()) {
+				if (dataSource->path() == dataSet->dataSource().path()) {
+					columns = dataSource->columns();
+					break;
+				}
+			}
+		}
+
+		if (columns && columns->column(dataSet->id()) != -1) {
+			const QString &dataSourcePath(dataSet->dataSource().path());
+			if (!sourceAggregates.contains(dataSourcePath)) {
+				columns->aggregate(today, fromDay, toDay,
+						sourceAggregates[dataSourcePath]);
+			}
+			result[path.path()] = sourceAggregates[dataSourcePath].toVariantMap(
+					columns->column(dataSet->id()), aggregations);
+		} else {
+			result[path.path()] = dataSet->internalQuery(fromDay, toDay,
+					aggregations);
+		}
+	}
+	return result;
+}
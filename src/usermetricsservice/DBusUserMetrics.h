@@ -19,12 +19,19 @@
 #ifndef USERMETRICSSERVICE_DBUSUSERMETRICS_H_
 #define USERMETRICSSERVICE_DBUSUSERMETRICS_H_
 
+#include <usermetricsservice/Authentication.h>
+#include <usermetricsservice/StorageWriter.h>
+
 #include <QtCore/QObject>
+#include <QtCore/QList>
 #include <QtCore/QMap>
 #include <QtCore/QScopedPointer>
 #include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QVariantMap>
 #include <QtDBus/QDBusConnection>
 #include <QtDBus/QDBusContext>
+#include <QtDBus/QDBusMessage>
 #include <QtDBus/QDBusObjectPath>
 
 class UserMetricsAdaptor;
@@ -37,7 +44,6 @@ namespace UserMetricsService {
 
 class DBusDataSource;
 class DBusUserData;
-class Authentication;
 class TranslationLocator;
 
 class DBusUserMetrics: public QObject, protected QDBusContext {
@@ -51,7 +57,9 @@ public:
 	DBusUserMetrics(const QDBusConnection &dbusConnection,
 			QSharedPointer<UserMetricsCommon::DateFactory> dateFactory,
 			QSharedPointer<Authentication> authentication,
-			QSharedPointer<TranslationLocator>, QObject *parent = 0);
+			QSharedPointer<TranslationLocator>,
+			StorageWriterPtr storageWriter = StorageWriterPtr(),
+			QObject *parent = 0);
 
 	virtual ~DBusUserMetrics();
 
@@ -71,7 +79,68 @@ public Q_SLOTS:
 
 	QSharedPointer<DBusUserData> userData(const QString &username) const;
 
+	/**
+	 * The path of the data set holding username's data for the named
+	 * data source, preferring the caller's own data source.
+	 */
+	QDBusObjectPath findDataSet(const QString &username,
+			const QString &dataSource);
+
+	QVariantMap snapshot(const QStringList &usernames) const;
+
+	/**
+	 * Query several data sets at once, the result maps each path to its
+	 * aggregates. See DBusDataSet::query.
+	 */
+	QVariantMap query(const QList<QDBusObjectPath> &dataSets, int fromDay,
+			int toDay, const QStringList &aggregations) const;
+
+protected Q_SLOTS:
+	/**
+	 * Answer the waiting calls whose callers we now know, in the order
+	 * they arrived.
+	 */
+	void applyPendingCalls();
+
 protected:
+	/**
+	 * A call from the bus waiting for its caller's credentials. The
+	 * arguments are read back from the message.
+	 */
+	class PendingCall {
+	public:
+		QDBusMessage m_message;
+
+		CredentialLookupPtr m_credentials;
+	};
+
+	void queueCall();
+
+	QDBusObjectPath applyCreateDataSource(const QString &confinementContext,
+			const QString &name, const QString &formatString,
+			const QString &emptyDataString, const QString &textDomain,
+			int type, const QVariantMap &options, const QDBusMessage &message);
+
+	QDBusObjectPath applyCreateUserData(const QString &dbusUsername,
+			const QString &username, const QDBusMessage &message);
+
+	QDBusObjectPath applyFindDataSet(const QString &confinementContext,
+			const QString &username, const QString &dataSource,
+			const QDBusMessage &message) const;
+
+	/**
+	 * Answer message with path if there is one.
+	 */
+	void replyWithPath(const QDBusMessage &message,
+			const QDBusObjectPath &path) const;
+
+	/**
+	 * Reply to message if there is one, otherwise to the call being
+	 * handled.
+	 */
+	void replyWithError(const QDBusMessage &message, QDBusError::ErrorType type,
+			const QString &msg) const;
+
 	void syncDatabase();
 
 	QDBusConnection m_dbusConnection;
@@ -84,9 +153,13 @@ protected:
 
 	QSharedPointer<TranslationLocator> m_translationLocator;
 
+	StorageWriterPtr m_storageWriter;
+
 	QMap<int, QSharedPointer<DBusDataSource>> m_dataSources;
 
 	QMap<int, QSharedPointer<DBusUserData>> m_userData;
+
+	QList<PendingCall> m_pendingCalls;
 };
 
 }
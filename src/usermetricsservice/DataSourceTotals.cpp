@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <usermetricsservice/DataSourceTotals.h>
+
+#include <QtCore/QDateTime>
+
+using namespace UserMetricsService;
+
+static const int MAXIMUM_DAYS(62);
+
+DataSourceTotals::DataSourceTotals() :
+		m_newest(0), m_valid(false) {
+}
+
+DataSourceTotals::~DataSourceTotals() {
+}
+
+bool DataSourceTotals::isValid() const {
+	return m_valid;
+}
+
+void DataSourceTotals::invalidate() {
+	m_valid = false;
+	m_days.clear();
+	m_newest = 0;
+}
+
+void DataSourceTotals::reset() {
+	invalidate();
+	m_valid = true;
+}
+
+void DataSourceTotals::add(const QDate &lastUpdated,
+		const QVariantList &data) {
+	apply(lastUpdated, data, true);
+}
+
+void DataSourceTotals::remove(const QDate &lastUpdated,
+		const QVariantList &data) {
+	apply(lastUpdated, data, false);
+}
+
+void DataSourceTotals::apply(const QDate &lastUpdated,
+		const QVariantList &data, bool adding) {
+	if (!lastUpdated.isValid() || data.isEmpty()) {
+		return;
+	}
+
+	const qint64 head(lastUpdated.toJulianDay());
+
+	if (adding && head > m_newest) {
+		m_newest = head;
+		// forget the days nobody can see any more
+		auto it(m_days.begin());
+		while (it != m_days.end() && it.key() <= m_newest - MAXIMUM_DAYS) {
+			it = m_days.erase(it);
+		}
+	}
+
+	qint64 day(head);
+	for (const QVariant &variant : data) {
+		if (day <= m_newest - MAXIMUM_DAYS) {
+			break;
+		}
+
+		bool ok(false);
+		const double value(variant.toDouble(&ok));
+
+		if (ok && variant.type() != QVariant::String) {
+			if (adding) {
+				Day &total(m_days[day]);
+				total.m_sum += value;
+				++total.m_count;
+			} else {
+				auto it(m_days.find(day));
+				if (it != m_days.end()) {
+					// dropping the entry also drops any rounding error
+					if (--it->m_count == 0) {
+						m_days.erase(it);
+					} else {
+						it->m_sum -= value;
+					}
+				}
+			}
+		}
+
+		--day;
+	}
+}
+
+QVariantMap DataSourceTotals::toVariantMap() const {
+	QVariantList data;
+	QVariantList users;
+	double sum(0.0);
+
+	if (!m_days.isEmpty()) {
+		const qint64 oldest(m_days.firstKey());
+		for (qint64 day(m_newest); day >= oldest; --day) {
+			auto it(m_days.constFind(day));
+			if (it == m_days.constEnd()) {
+				data << QVariant("");
+				users << 0;
+			} else {
+				data << it->m_sum;
+				users << it->m_count;
+				sum += it->m_sum;
+			}
+		}
+	}
+
+	QVariantMap result;
+	result["lastUpdated"] =
+			m_newest == 0 ?
+					uint(0) :
+					QDateTime(QDate::fromJulianDay(m_newest)).toTime_t();
+	result["data"] = data;
+	result["users"] = users;
+	result["sum"] = sum;
+	return result;
+}
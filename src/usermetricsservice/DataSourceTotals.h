@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSSERVICE_DATASOURCETOTALS_H_
+#define USERMETRICSSERVICE_DATASOURCETOTALS_H_
+
+#include <QtCore/QDate>
+#include <QtCore/QMap>
+#include <QtCore/QVariantMap>
+
+namespace UserMetricsService {
+
+/**
+ * Day by day totals of every data set belonging to a data source.
+ *
+ * Each write to a data set takes its old data out and puts its new data
+ * in, so reading the totals never has to visit the individual users.
+ */
+class DataSourceTotals {
+public:
+	DataSourceTotals();
+
+	virtual ~DataSourceTotals();
+
+	bool isValid() const;
+
+	void invalidate();
+
+	/**
+	 * Empty the totals and start counting again.
+	 */
+	void reset();
+
+	/**
+	 * Add a data set's data, newest first, ending on lastUpdated.
+	 */
+	void add(const QDate &lastUpdated, const QVariantList &data);
+
+	/**
+	 * Take away data that was previously added.
+	 */
+	void remove(const QDate &lastUpdated, const QVariantList &data);
+
+	QVariantMap toVariantMap() const;
+
+protected:
+	class Day {
+	public:
+		Day() :
+				m_sum(0.0), m_count(0) {
+		}
+
+		double m_sum;
+
+		int m_count;
+	};
+
+	void apply(const QDate &lastUpdated, const QVariantList &data,
+			bool adding);
+
+	/**
+	 * Keyed by Julian day.
+	 */
+	QMap<qint64, Day> m_days;
+
+	qint64 m_newest;
+
+	bool m_valid;
+};
+
+}
+
+#endif // USERMETRICSSERVICE_DATASOURCETOTALS_H_
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <usermetricsservice/RollingAggregates.h>
+
+#include <QtCore/QStringList>
+
+using namespace UserMetricsService;
+
+static const int MAXIMUM_WINDOW(62);
+
+RollingAggregates::Window::Window(int days) :
+		m_days(days), m_sum(0.0) {
+}
+
+void RollingAggregates::Window::push(const Entry &entry) {
+	m_values.push_back(entry);
+	m_sum += entry.m_value;
+
+	while (!m_minimum.empty() && m_minimum.back().m_value >= entry.m_value) {
+		m_minimum.pop_back();
+	}
+	m_minimum.push_back(entry);
+
+	while (!m_maximum.empty() && m_maximum.back().m_value <= entry.m_value) {
+		m_maximum.pop_back();
+	}
+	m_maximum.push_back(entry);
+}
+
+void RollingAggregates::Window::replaceNewest(double value) {
+	Entry &newest(m_values.back());
+	const double oldValue(newest.m_value);
+	newest.m_value = value;
+	m_sum += value - oldValue;
+
+	// the newest value is always at the back of both queues, so moving it
+	// towards an extreme just means popping what it now dominates. Moving
+	// it away means older values could be back in play, so we rescan.
+	if (value <= oldValue) {
+		m_minimum.pop_back();
+		while (!m_minimum.empty() && m_minimum.back().m_value >= value) {
+			m_minimum.pop_back();
+		}
+		m_minimum.push_back(newest);
+	} else {
+		rebuildMinimum();
+	}
+
+	if (value >= oldValue) {
+		m_maximum.pop_back();
+		while (!m_maximum.empty() && m_maximum.back().m_value <= value) {
+			m_maximum.pop_back();
+		}
+		m_maximum.push_back(newest);
+	} else {
+		rebuildMaximum();
+	}
+}
+
+void RollingAggregates::Window::expire(qint64 today) {
+	const qint64 first(today - m_days + 1);
+
+	while (!m_values.empty() && m_values.front().m_day < first) {
+		m_sum -= m_values.front().m_value;
+		m_values.pop_front();
+	}
+	while (!m_minimum.empty() && m_minimum.front().m_day < first) {
+		m_minimum.pop_front();
+	}
+	while (!m_maximum.empty() && m_maximum.front().m_day < first) {
+		m_maximum.pop_front();
+	}
+
+	// stop rounding errors building up
+	if (m_values.empty()) {
+		m_sum = 0.0;
+	}
+}
+
+void RollingAggregates::Window::rebuildMinimum() {
+	m_minimum.clear();
+	for (const Entry &entry : m_values) {
+		while (!m_minimum.empty() && m_minimum.back().m_value >= entry.m_value) {
+			m_minimum.pop_back();
+		}
+		m_minimum.push_back(entry);
+	}
+}
+
+void RollingAggregates::Window::rebuildMaximum() {
+	m_maximum.clear();
+	for (const Entry &entry : m_values) {
+		while (!m_maximum.empty() && m_maximum.back().m_value <= entry.m_value) {
+			m_maximum.pop_back();
+		}
+		m_maximum.push_back(entry);
+	}
+}
+
+QVariantMap RollingAggregates::Window::toVariantMap() const {
+	QVariantMap result;
+	result["days"] = m_days;
+	result["count"] = int(m_values.size());
+	result["sum"] = m_sum;
+	if (!m_values.empty()) {
+		result["mean"] = m_sum / m_values.size();
+		result["min"] = m_minimum.front().m_value;
+		result["max"] = m_maximum.front().m_value;
+	}
+	return result;
+}
+
+RollingAggregates::RollingAggregates(const QList<int> &windows) :
+		m_today(0), m_valid(false) {
+	for (int days : windows) {
+		m_windows << Window(qBound(1, days, MAXIMUM_WINDOW));
+	}
+}
+
+RollingAggregates::~RollingAggregates() {
+}
+
+QList<int> RollingAggregates::defaultWindows() {
+	QList<int> windows;
+
+	if (qEnvironmentVariableIsSet("USERMETRICS_AGGREGATE_WINDOWS")) {
+		for (const QString &window : QString::fromUtf8(
+				qgetenv("USERMETRICS_AGGREGATE_WINDOWS")).split(',',
+				QString::SkipEmptyParts)) {
+			bool ok(false);
+			int days(window.trimmed().toInt(&ok));
+			if (ok && days > 0) {
+				windows << days;
+			}
+		}
+	}
+
+	if (windows.isEmpty()) {
+		windows << 7 << 30;
+	}
+
+	return windows;
+}
+
+bool RollingAggregates::isValid() const {
+	return m_valid;
+}
+
+void RollingAggregates::invalidate() {
+	m_valid = false;
+}
+
+void RollingAggregates::reset(const QDate &lastUpdated,
+		const QVariantList &data) {
+	m_today = lastUpdated.toJulianDay();
+
+	for (Window &window : m_windows) {
+		window = Window(window.m_days);
+	}
+
+	// oldest first, so the queues come out in order
+	const int size(qMin(data.size(), MAXIMUM_WINDOW));
+	for (int i(size - 1); i >= 0; --i) {
+		const QVariant &variant(data.at(i));
+		// days without data are empty strings
+		if (variant.isNull() || variant.type() == QVariant::String) {
+			continue;
+		}
+		bool ok(false);
+		const double value(variant.toDouble(&ok));
+		if (!ok) {
+			continue;
+		}
+
+		Entry entry(m_today - i, value);
+		for (Window &window : m_windows) {
+			if (i < window.m_days) {
+				window.push(entry);
+			}
+		}
+	}
+
+	m_valid = true;
+}
+
+void RollingAggregates::advance(const QDate &today) {
+	const qint64 day(today.toJulianDay());
+	if (day <= m_today) {
+		return;
+	}
+
+	m_today = day;
+	for (Window &window : m_windows) {
+		window.expire(m_today);
+	}
+}
+
+void RollingAggregates::setHead(const QDate &today, double value) {
+	advance(today);
+
+	for (Window &window : m_windows) {
+		if (!window.m_values.empty()
+				&& window.m_values.back().m_day == m_today) {
+			window.replaceNewest(value);
+		} else {
+			window.push(Entry(m_today, value));
+		}
+	}
+}
+
+QVariantMap RollingAggregates::toVariantMap() const {
+	QVariantMap result;
+	for (const Window &window : m_windows) {
+		result[QString::number(window.m_days)] = window.toVariantMap();
+	}
+	return result;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSSERVICE_ROLLINGAGGREGATES_H_
+#define USERMETRICSSERVICE_ROLLINGAGGREGATES_H_
+
+#include <QtCore/QDate>
+#include <QtCore/QList>
+#include <QtCore/QVariantMap>
+#include <QtCore/QVector>
+
+#include <deque>
+
+namespace UserMetricsService {
+
+/**
+ * Sum, mean, minimum and maximum of a data set over the last N days, for
+ * a number of different N.
+ *
+ * Days drop out of the windows as the date moves on, and today's value
+ * can be changed, without looking at the rest of the data.
+ */
+class RollingAggregates {
+public:
+	explicit RollingAggregates(const QList<int> &windows = defaultWindows());
+
+	virtual ~RollingAggregates();
+
+	/**
+	 * The window lengths, in days. Can be overridden with a comma
+	 * separated list in USERMETRICS_AGGREGATE_WINDOWS.
+	 */
+	static QList<int> defaultWindows();
+
+	bool isValid() const;
+
+	void invalidate();
+
+	/**
+	 * Start again from the data, newest first, ending on lastUpdated.
+	 */
+	void reset(const QDate &lastUpdated, const QVariantList &data);
+
+	/**
+	 * Drop any days that have fallen out of the windows by today.
+	 */
+	void advance(const QDate &today);
+
+	/**
+	 * Today's value is now value.
+	 */
+	void setHead(const QDate &today, double value);
+
+	QVariantMap toVariantMap() const;
+
+protected:
+	class Entry {
+	public:
+		Entry(qint64 day, double value) :
+				m_day(day), m_value(value) {
+		}
+
+		qint64 m_day;
+
+		double m_value;
+	};
+
+	class Window {
+	public:
+		explicit Window(int days = 0);
+
+		void push(const Entry &entry);
+
+		void replaceNewest(double value);
+
+		void expire(qint64 today);
+
+		void rebuildMinimum();
+
+		void rebuildMaximum();
+
+		QVariantMap toVariantMap() const;
+
+		int m_days;
+
+		double m_sum;
+
+		std::deque<Entry> m_values;
+
+		/**
+		 * Increasing values, so the minimum is at the front.
+		 */
+		std::deque<Entry> m_minimum;
+
+		/**
+		 * Decreasing values, so the maximum is at the front.
+		 */
+		std::deque<Entry> m_maximum;
+	};
+
+	QVector<Window> m_windows;
+
+	qint64 m_today;
+
+	bool m_valid;
+};
+
+}
+
+#endif // USERMETRICSSERVICE_ROLLINGAGGREGATES_H_
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <usermetricsservice/database/DataSet.h>
+#include <usermetricsservice/StorageWriter.h>
+#include <libusermetricscommon/Localisation.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QVariantMap>
+
+#include <QDjangoQuerySet.h>
+
+using namespace UserMetricsService;
+
+StorageWorker::StorageWorker(const QDBusConnection &dbusConnection,
+		QObject *parent) :
+		QObject(parent), m_dbusConnection(dbusConnection) {
+}
+
+StorageWorker::~StorageWorker() {
+}
+
+void StorageWorker::write(int id, const QDate &lastUpdated,
+		const QByteArray &data, const QDBusMessage &message) {
+	// QDjango gives this thread a connection of its own
+	QVariantMap fields;
+	fields["lastUpdated"] = lastUpdated;
+	fields["data"] = data;
+
+	const bool saved(
+			QDjangoQuerySet<DataSet>().filter(
+					QDjangoWhere("id", QDjangoWhere::Equals, id)).update(fields)
+					== 1);
+
+	if (!saved) {
+		qWarning() << _("Could not save data set") << ": [" << id << "]";
+	}
+	Q_EMIT written(id, saved);
+
+	if (message.type() != QDBusMessage::MethodCallMessage) {
+		return;
+	}
+
+	if (saved) {
+		m_dbusConnection.send(message.createReply());
+	} else {
+		m_dbusConnection.send(
+				message.createErrorReply(QDBusError::InternalError,
+						_("Could not save data set")));
+	}
+}
+
+void StorageWorker::flush() {
+}
+
+StorageWriter::PendingWrite::PendingWrite() :
+		m_count(0), m_failed(false) {
+}
+
+StorageWriter::StorageWriter(const QDBusConnection &dbusConnection,
+		QObject *parent) :
+		QObject(parent), m_worker(new StorageWorker(dbusConnection)) {
+	qRegisterMetaType<QDBusMessage>();
+
+	m_worker->moveToThread(&m_thread);
+	connect(&m_thread, SIGNAL(finished()), m_worker, SLOT(deleteLater()));
+
+	connect(this,
+			SIGNAL(queueWrite(int, const QDate &, const QByteArray &, const QDBusMessage &)),
+			m_worker,
+			SLOT(write(int, const QDate &, const QByteArray &, const QDBusMessage &)),
+			Qt::QueuedConnection);
+	connect(m_worker, SIGNAL(written(int, bool)), this,
+			SLOT(written(int, bool)), Qt::QueuedConnection);
+
+	m_thread.start();
+}
+
+StorageWriter::~StorageWriter() {
+	// don't lose anything that hasn't been saved yet
+	flush();
+
+	m_thread.quit();
+	m_thread.wait();
+}
+
+void StorageWriter::flush() {
+	if (m_thread.isRunning()) {
+		QMetaObject::invokeMethod(m_worker, "flush",
+				Qt::BlockingQueuedConnection);
+	}
+}
+
+void StorageWriter::write(int id, const QDate &lastUpdated,
+		const QByteArray &data, const QDBusMessage &message, QObject *owner) {
+	PendingWrite &pending(m_pending[id]);
+	++pending.m_count;
+	pending.m_lastUpdated = lastUpdated;
+	pending.m_data = data;
+	pending.m_owner = owner;
+
+	Q_EMIT queueWrite(id, lastUpdated, data, message);
+}
+
+bool StorageWriter::unsaved(int id, QDate &lastUpdated,
+		QByteArray &data) const {
+	QHash<int, PendingWrite>::const_iterator pending(m_pending.constFind(id));
+	if (pending == m_pending.constEnd()) {
+		return false;
+	}
+	lastUpdated = pending->m_lastUpdated;
+	data = pending->m_data;
+	return true;
+}
+
+void StorageWriter::written(int id, bool saved) {
+	QHash<int, PendingWrite>::iterator pending(m_pending.find(id));
+	if (pending == m_pending.end()) {
+		return;
+	}
+
+	if (!saved) {
+		pending->m_failed = true;
+	}
+	if (--pending->m_count > 0) {
+		// anything written after the failure was built on top of it, so
+		// wait for it to land before going back to what the disk has
+		return;
+	}
+
+	const bool failed(pending->m_failed);
+	QPointer<QObject> owner(pending->m_owner);
+	m_pending.erase(pending);
+
+	if (failed && owner) {
+		QMetaObject::invokeMethod(owner, "writeFailed");
+	}
+}
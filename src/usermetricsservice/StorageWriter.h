@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef USERMETRICSSERVICE_STORAGEWRITER_H_
+#define USERMETRICSSERVICE_STORAGEWRITER_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDate>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QThread>
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
+
+namespace UserMetricsService {
+
+class StorageWriter;
+
+typedef QSharedPointer<StorageWriter> StorageWriterPtr;
+
+/**
+ * Saves data sets on the storage thread, using that thread's own
+ * database connection.
+ */
+class StorageWorker: public QObject {
+Q_OBJECT
+
+public:
+	StorageWorker(const QDBusConnection &dbusConnection, QObject *parent = 0);
+
+	virtual ~StorageWorker();
+
+public Q_SLOTS:
+	/**
+	 * Save the data set, then answer message if there is one.
+	 */
+	void write(int id, const QDate &lastUpdated, const QByteArray &data,
+			const QDBusMessage &message);
+
+	/**
+	 * Does nothing, but by the time it runs everything queued before it
+	 * has been saved.
+	 */
+	void flush();
+
+Q_SIGNALS:
+	/**
+	 * The write for the data set with this id is finished with, saved
+	 * or not.
+	 */
+	void written(int id, bool saved);
+
+protected:
+	QDBusConnection m_dbusConnection;
+};
+
+/**
+ * Hands data set writes to a StorageWorker running on its own thread, so
+ * the bus isn't held up waiting for the disk. Writes are saved in the
+ * order they are made.
+ */
+class StorageWriter: public QObject {
+Q_OBJECT
+
+public:
+	explicit StorageWriter(const QDBusConnection &dbusConnection,
+			QObject *parent = 0);
+
+	virtual ~StorageWriter();
+
+	/**
+	 * Queue a write. The reply to message, if it is a method call, is sent
+	 * once the data is on disk. If the write can't be saved, owner has its
+	 * writeFailed() slot called once the data set's other writes are done.
+	 */
+	void write(int id, const QDate &lastUpdated, const QByteArray &data,
+			const QDBusMessage &message, QObject *owner);
+
+	/**
+	 * The newest data for the data set with this id that is still on its
+	 * way to disk. Returns false if there isn't any.
+	 */
+	bool unsaved(int id, QDate &lastUpdated, QByteArray &data) const;
+
+	/**
+	 * Wait until every write made so far has been saved. This holds up
+	 * the calling thread, so is only for shutting down.
+	 */
+	void flush();
+
+Q_SIGNALS:
+	void queueWrite(int id, const QDate &lastUpdated, const QByteArray &data,
+			const QDBusMessage &message);
+
+protected Q_SLOTS:
+	void written(int id, bool saved);
+
+protected:
+	class PendingWrite {
+	public:
+		PendingWrite();
+
+		int m_count;
+
+		bool m_failed;
+
+		QDate m_lastUpdated;
+
+		QByteArray m_data;
+
+		QPointer<QObject> m_owner;
+	};
+
+	QHash<int, PendingWrite> m_pending;
+
+protected:
+	QThread m_thread;
+
+	StorageWorker *m_worker;
+};
+
+}
+
+#endif // USERMETRICSSERVICE_STORAGEWRITER_H_
@@ -28,8 +28,16 @@
 
 namespace UserMetricsService {
 
-namespace {
-QString pkgdir(const QString& id) {
+TranslationLocatorImpl::TranslationLocatorImpl() {
+	connect(&m_watcher, SIGNAL(directoryChanged(const QString &)), this,
+			SLOT(invalidate()));
+}
+
+bool TranslationLocatorImpl::readDatabase() {
+	if (!m_db.isNull()) {
+		return true;
+	}
+
 	QSharedPointer<ClickDB> db(click_db_new(), &g_object_unref);
 
 	GError *error = nullptr;
@@ -37,11 +45,39 @@ QString pkgdir(const QString& id) {
 	if (error != nullptr) {
 		qWarning() << error->message;
 		g_error_free(error);
+		return false;
+	}
+
+	// new packages appear as new directories in the database roots
+	QStringList roots;
+	for (int i = 0; i < click_db_get_size(db.data()); ++i) {
+		ClickSingleDB *single = click_db_get(db.data(), i);
+		roots << QString::fromUtf8(click_single_db_get_root(single));
+		g_object_unref(single);
+	}
+	if (!roots.isEmpty()) {
+		m_watcher.addPaths(roots);
+	}
+
+	m_db = db;
+	return true;
+}
+
+void TranslationLocatorImpl::invalidate() {
+	m_paths.clear();
+	m_db.reset();
+	if (!m_watcher.directories().isEmpty()) {
+		m_watcher.removePaths(m_watcher.directories());
+	}
+}
+
+QString TranslationLocatorImpl::pkgdir(const QString& id) {
+	if (!readDatabase()) {
 		return QString();
 	}
 
-	error = nullptr;
-	char *path = click_db_get_path(db.data(), id.toUtf8().constData(), "current", &error);
+	GError *error = nullptr;
+	char *path = click_db_get_path(m_db.data(), id.toUtf8().constData(), "current", &error);
 	if (error != nullptr) {
 		qWarning() << error->message;
 		g_error_free(error);
@@ -51,17 +87,29 @@ QString pkgdir(const QString& id) {
 	QString result = QString::fromUtf8(path);
 	g_free(path);
 
-	return result;
-}
-}
+	// upgrades move the package's "current" link
+	QDir packageDir(result);
+	if (packageDir.cdUp()) {
+		m_watcher.addPath(packageDir.path());
+	}
 
-TranslationLocatorImpl::TranslationLocatorImpl() {
+	return result;
 }
 
 QString TranslationLocatorImpl::locate(const QString& id) {
 	QString translationPath = "/usr/share/locale-langpack";
 	if (id != "unconfined") {
-		translationPath = QDir(pkgdir(id)).filePath("share/locale");
+		auto it = m_paths.constFind(id);
+		if (it != m_paths.constEnd()) {
+			return *it;
+		}
+
+		const QString dir = pkgdir(id);
+		translationPath = QDir(dir).filePath("share/locale");
+		// failures are tried again next time
+		if (!dir.isEmpty()) {
+			m_paths.insert(id, translationPath);
+		}
 	}
 	return translationPath;
 }
@@ -20,15 +20,49 @@
 
 #include <usermetricsservice/TranslationLocator.h>
 
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+
+typedef struct _ClickDB ClickDB;
+
 namespace UserMetricsService {
 
-class TranslationLocatorImpl: public TranslationLocator {
+class TranslationLocatorImpl: public QObject, public TranslationLocator {
+Q_OBJECT
+
 public:
 	TranslationLocatorImpl();
 
 	~TranslationLocatorImpl() = default;
 
 	QString locate(const QString& id) override;
+
+protected Q_SLOTS:
+	void invalidate();
+
+protected:
+	/**
+	 * Where click installed the package, empty if it can't say. Watches
+	 * the package so an upgrade invalidates the cache.
+	 */
+	virtual QString pkgdir(const QString& id);
+
+	bool readDatabase();
+
+	/**
+	 * Kept between calls, reading it means reading every database
+	 * directory from disk.
+	 */
+	QSharedPointer<ClickDB> m_db;
+
+	/**
+	 * Translation paths by package, until the click database changes.
+	 */
+	QHash<QString, QString> m_paths;
+
+	QFileSystemWatcher m_watcher;
 };
 
 }
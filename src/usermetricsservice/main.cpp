@@ -18,6 +18,7 @@
 
 #include <usermetricsservice/Authentication.h>
 #include <usermetricsservice/DBusUserMetrics.h>
+#include <usermetricsservice/StorageWriter.h>
 #include <usermetricsservice/TranslationLocatorImpl.h>
 #include <libusermetricscommon/DateFactoryImpl.h>
 #include <libusermetricscommon/DBusPaths.h>
@@ -75,7 +76,14 @@ int main(int argc, char *argv[]) {
 	QSharedPointer<Authentication> authentication(new Authentication());
 	QSharedPointer<TranslationLocator> translationLocator(new TranslationLocatorImpl());
 
-	DBusUserMetrics userMetrics(connection, dateFactory, authentication, translationLocator);
+	// an in-memory database can't be shared with the storage thread
+	StorageWriterPtr storageWriter;
+	if (databaseName != ":memory:") {
+		storageWriter.reset(new StorageWriter(connection));
+	}
+
+	DBusUserMetrics userMetrics(connection, dateFactory, authentication,
+			translationLocator, storageWriter);
 	if (!connection.registerService(DBusPaths::serviceName())) {
 		qWarning() << _("Unable to register user metrics service on DBus");
 		return 1;
@@ -90,6 +98,9 @@ int main(int argc, char *argv[]) {
 	} catch (std::logic_error &e) {
 		qWarning() << "User metrics service error:" << e.what();
 	}
+	if (storageWriter) {
+		storageWriter->flush();
+	}
 	if (!connection.unregisterService(DBusPaths::serviceName())) {
 		qWarning() << _("Unable to unregister user metrics service on DBus");
 	}
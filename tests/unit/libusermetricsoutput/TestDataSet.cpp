@@ -109,5 +109,36 @@ INSTANTIATE_TEST_CASE_P(TurnsZeroRangeInto0Point5sMoreValues, TestDataSet,
 				TestDataSetParamData(QVariantList( {150.0, 150.0, 150.0}),
 						QVariantList( {0.5, 0.5, 0.5}), QVariant(150.0))));
 
+INSTANTIATE_TEST_CASE_P(ScalesAllNegativeData, TestDataSet,
+		Values(
+				TestDataSetParamData(QVariantList( {-10.0, -30.0, -50.0}),
+						QVariantList( {1.0, 0.5, 0.0}), QVariant(-10.0))));
+
+TEST(TestDataSetHead, RescalesWhenOnlyTheHeadChanges) {
+	DataSourcePtr dataSource(new DataSource());
+	DataSet dataSet(dataSource);
+
+	dataSet.setData(QVariantList( {10.0, 5.0, 0.0, 20.0}));
+	EXPECT_EQ(QVariantList( {0.5, 0.25, 0.0, 1.0}), dataSet.data());
+
+	// inside the existing range
+	dataSet.setData(QVariantList( {12.0, 5.0, 0.0, 20.0}));
+	EXPECT_EQ(QVariantList( {0.6, 0.25, 0.0, 1.0}), dataSet.data());
+	EXPECT_EQ(QVariant(12.0), dataSet.head());
+
+	// stretching the range
+	dataSet.setData(QVariantList( {40.0, 5.0, 0.0, 20.0}));
+	EXPECT_EQ(QVariantList( {1.0, 0.125, 0.0, 0.5}), dataSet.data());
+
+	// and shrinking it back again
+	dataSet.setData(QVariantList( {10.0, 5.0, 0.0, 20.0}));
+	EXPECT_EQ(QVariantList( {0.5, 0.25, 0.0, 1.0}), dataSet.data());
+
+	// no data for today
+	dataSet.setData(QVariantList( {"", 5.0, 0.0, 20.0}));
+	EXPECT_EQ(QVariantList( {QVariant(), 0.25, 0.0, 1.0}), dataSet.data());
+	EXPECT_EQ(QVariant(), dataSet.head());
+}
+
 }
 // namespace
@@ -19,6 +19,8 @@
 #include <libusermetricsoutput/GSettingsColorThemeProvider.h>
 
 #include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
@@ -121,4 +123,56 @@ TEST_F(TestGSettingsColorThemeProvider, HandlesInvalidXml) {
 	EXPECT_EQ(themeA, provider.getColorTheme("b"));
 }
 
+TEST_F(TestGSettingsColorThemeProvider, CompilesThemesIntoTheCache) {
+	QTemporaryDir temporaryDir;
+	QDir themes(temporaryDir.path());
+	ASSERT_TRUE(themes.mkpath("libusermetrics/themes"));
+	ASSERT_TRUE(themes.cd("libusermetrics/themes"));
+	for (const QString &file : QStringList() << "color-theme.xsd"
+			<< "default.xml") {
+		ASSERT_TRUE(
+				QFile::copy(QDir(DATA_DIR).filePath("libusermetrics/themes/" + file),
+						themes.filePath(file)));
+	}
+	qputenv("XDG_DATA_DIRS", temporaryDir.path().toUtf8());
+
+	SnapshotCachePtr cache(
+			new SnapshotCache(QDir(temporaryDir.path()).filePath("cache")));
+
+	{
+		GSettingsColorThemeProvider provider(cache);
+		EXPECT_EQ(QColor("#e54c19"), provider.getColorTheme("a").first->start());
+	}
+
+	QVariantMap files(cache->section("colorThemeFiles"));
+	const QString path(themes.filePath("default.xml"));
+	ASSERT_TRUE(files.contains(path));
+	ASSERT_EQ(4, files[path].toMap()["themes"].toList().size());
+
+	// while the file is unchanged, the compiled themes are all we look at
+	{
+		QVariantMap compiled(files[path].toMap());
+		compiled["themes"] = QVariantList() << (QStringList() << "#010101"
+				<< "#020202" << "#030303" << "#040404" << "#050505"
+				<< "#060606");
+		files[path] = compiled;
+		cache->setSection("colorThemeFiles", files);
+
+		GSettingsColorThemeProvider provider(cache);
+		EXPECT_EQ(QColor("#010101"), provider.getColorTheme("a").first->start());
+		EXPECT_EQ(QColor("#060606"), provider.getColorTheme("a").second->end());
+	}
+
+	// changing the file makes us read it again
+	{
+		QFile file(path);
+		ASSERT_TRUE(file.open(QIODevice::Append));
+		file.write("\n");
+	}
+	{
+		GSettingsColorThemeProvider provider(cache);
+		EXPECT_EQ(QColor("#e54c19"), provider.getColorTheme("a").first->start());
+	}
+}
+
 } // namespace
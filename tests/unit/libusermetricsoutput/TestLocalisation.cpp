@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricscommon/Localisation.h>
+#include <testutils/QStringPrinter.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace testing;
+
+namespace {
+
+class LocalisationTest: public Test {
+protected:
+	LocalisationTest() :
+			language(qgetenv("LANGUAGE")) {
+		qputenv("LANGUAGE", "en_FAKELANG");
+	}
+
+	virtual ~LocalisationTest() {
+		qputenv("LANGUAGE", language);
+	}
+
+	QByteArray language;
+
+	Gettext gettext;
+};
+
+TEST_F(LocalisationTest, TranslatesFromTheCatalog) {
+	EXPECT_EQ(QString("%1 translated messages received"),
+			gettext.tr("foo", "%1 untranslated messages received",
+					TEST_LOCALEDIR));
+	EXPECT_EQ(QString("no translated messages today"),
+			gettext.tr("foo", "no untranslated messages today",
+					TEST_LOCALEDIR));
+}
+
+TEST_F(LocalisationTest, FallsBackToTheMessage) {
+	EXPECT_EQ(QString("not in the catalog"),
+			gettext.tr("foo", "not in the catalog", TEST_LOCALEDIR));
+	EXPECT_EQ(QString("%1 untranslated messages received"),
+			gettext.tr("no-such-domain", "%1 untranslated messages received",
+					TEST_LOCALEDIR));
+	EXPECT_EQ(QString("%1 untranslated messages received"),
+			gettext.tr("", "%1 untranslated messages received",
+					TEST_LOCALEDIR));
+}
+
+TEST_F(LocalisationTest, FollowsTheLanguage) {
+	EXPECT_EQ(QString("%1 translated messages received"),
+			gettext.tr("foo", "%1 untranslated messages received",
+					TEST_LOCALEDIR));
+
+	qputenv("LANGUAGE", "fr_FR");
+	EXPECT_EQ(QString("%1 untranslated messages received"),
+			gettext.tr("foo", "%1 untranslated messages received",
+					TEST_LOCALEDIR));
+}
+
+TEST_F(LocalisationTest, TriesLessSpecificLanguages) {
+	qputenv("LANGUAGE", "en_GB.UTF-8@euro:de");
+	EXPECT_EQ(QStringList() << "en_GB.UTF-8@euro" << "en_GB@euro" << "en_GB"
+			<< "en@euro" << "en" << "de", Gettext::languages().mid(0, 6));
+}
+
+TEST_F(LocalisationTest, IgnoresBrokenCatalogs) {
+	QTemporaryDir temporaryDir;
+	QDir dir(temporaryDir.path());
+	ASSERT_TRUE(dir.mkpath("en_FAKELANG/LC_MESSAGES"));
+
+	QFile file(dir.filePath("en_FAKELANG/LC_MESSAGES/foo.mo"));
+	ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+	file.write("this is not a message catalog");
+	file.close();
+
+	EXPECT_EQ(QString("no untranslated messages today"),
+			gettext.tr("foo", "no untranslated messages today",
+					temporaryDir.path()));
+}
+
+TEST_F(LocalisationTest, FindsCatalogsInstalledLater) {
+	QTemporaryDir temporaryDir;
+	QDir dir(temporaryDir.path());
+
+	// look again for missing catalogs every time
+	Gettext impatient(0);
+	EXPECT_EQ(QString("%1 untranslated messages received"),
+			impatient.tr("foo", "%1 untranslated messages received",
+					temporaryDir.path()));
+	EXPECT_EQ(QString("%1 untranslated messages received"),
+			gettext.tr("foo", "%1 untranslated messages received",
+					temporaryDir.path()));
+
+	ASSERT_TRUE(dir.mkpath("en_FAKELANG/LC_MESSAGES"));
+	ASSERT_TRUE(
+			QFile::copy(
+					QString(TEST_LOCALEDIR)
+							+ "/en_FAKELANG/LC_MESSAGES/foo.mo",
+					dir.filePath("en_FAKELANG/LC_MESSAGES/foo.mo")));
+
+	EXPECT_EQ(QString("%1 translated messages received"),
+			impatient.tr("foo", "%1 untranslated messages received",
+					temporaryDir.path()));
+
+	// the miss is still remembered for a while
+	EXPECT_EQ(QString("%1 untranslated messages received"),
+			gettext.tr("foo", "%1 untranslated messages received",
+					temporaryDir.path()));
+}
+
+TEST_F(LocalisationTest, NoticesUpgradedCatalogs) {
+	QTemporaryDir temporaryDir;
+	QDir dir(temporaryDir.path());
+	ASSERT_TRUE(dir.mkpath("en_FAKELANG/LC_MESSAGES"));
+	const QString path(dir.filePath("en_FAKELANG/LC_MESSAGES/foo.mo"));
+	ASSERT_TRUE(
+			QFile::copy(
+					QString(TEST_LOCALEDIR)
+							+ "/en_FAKELANG/LC_MESSAGES/foo.mo", path));
+
+	// check the catalogs every time
+	Gettext impatient(0);
+	EXPECT_EQ(QString("%1 translated messages received"),
+			impatient.tr("foo", "%1 untranslated messages received",
+					temporaryDir.path()));
+	EXPECT_EQ(QString("%1 translated messages received"),
+			gettext.tr("foo", "%1 untranslated messages received",
+					temporaryDir.path()));
+
+	// the new version has nothing we can use
+	QFile file(path);
+	ASSERT_TRUE(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+	file.write("this is not a message catalog");
+	file.close();
+
+	EXPECT_EQ(QString("%1 untranslated messages received"),
+			impatient.tr("foo", "%1 untranslated messages received",
+					temporaryDir.path()));
+
+	// the old catalog is still trusted for a while
+	EXPECT_EQ(QString("%1 translated messages received"),
+			gettext.tr("foo", "%1 untranslated messages received",
+					temporaryDir.path()));
+}
+
+} // namespace
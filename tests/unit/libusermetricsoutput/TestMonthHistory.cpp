@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricsoutput/MonthHistory.h>
+
+#include <QtCore/QCoreApplication>
+#include <QSignalSpy>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace UserMetricsCommon;
+using namespace UserMetricsOutput;
+using namespace testing;
+
+namespace {
+
+class MockDateFactory: public DateFactory {
+public:
+	MOCK_CONST_METHOD0(currentDate, QDate());
+};
+
+/**
+ * Counts the ranges asked for, and fails the first few of them.
+ */
+class ScriptedDataSet: public DataSet {
+public:
+	ScriptedDataSet() :
+			DataSet(DataSourcePtr(new DataSource())), requests(0), failures(0) {
+	}
+
+	virtual void requestRange(int fromDay, int toDay, const QDate &today) {
+		++requests;
+		if (failures > 0) {
+			--failures;
+			rangeFailed(fromDay, toDay);
+		} else {
+			DataSet::requestRange(fromDay, toDay, today);
+		}
+	}
+
+	int requests;
+
+	int failures;
+};
+
+class MonthHistoryTest: public Test {
+protected:
+	MonthHistoryTest() :
+			dateFactory(new NiceMock<MockDateFactory>()), scriptedDataSet(
+					new ScriptedDataSet()), dataSet(scriptedDataSet) {
+		ON_CALL(*dateFactory, currentDate()).WillByDefault(
+				Return(QDate(2001, 03, 05)));
+
+		// 40 days of history, back to the 25th of January
+		QVariantList data;
+		for (int i(0); i < 40; ++i) {
+			data << "";
+		}
+		data[0] = 1.0;
+		data[5] = 2.0;
+		dataSet->setLastUpdated(QDate(2001, 03, 05));
+		dataSet->setData(data);
+	}
+
+	virtual ~MonthHistoryTest() {
+	}
+
+	QSharedPointer<MockDateFactory> dateFactory;
+
+	ScriptedDataSet *scriptedDataSet;
+
+	DataSetPtr dataSet;
+};
+
+TEST_F(MonthHistoryTest, FetchesMonthsOnDemand) {
+	MonthHistory model(dateFactory, dataSet);
+	EXPECT_EQ(0, model.rowCount());
+	ASSERT_TRUE(model.canFetchMore(QModelIndex()));
+
+	// the current month, with the one before it prefetched
+	model.fetchMore(QModelIndex());
+	QCoreApplication::processEvents();
+	QCoreApplication::processEvents();
+	ASSERT_EQ(1, model.rowCount());
+	EXPECT_EQ(QVariant(QDate(2001, 03, 01)),
+			model.data(model.index(0), MonthHistory::MonthRole));
+	{
+		QVariantList values(
+				model.data(model.index(0), MonthHistory::ValuesRole).toList());
+		ASSERT_EQ(31, values.size());
+		EXPECT_EQ(QVariant(0.0), values.at(4));
+		EXPECT_EQ(QVariant(), values.at(0));
+		EXPECT_EQ(QVariant(), values.at(5));
+	}
+
+	// the prefetched month appears straight away
+	model.fetchMore(QModelIndex());
+	ASSERT_EQ(2, model.rowCount());
+	{
+		QVariantList values(
+				model.data(model.index(1), MonthHistory::ValuesRole).toList());
+		ASSERT_EQ(28, values.size());
+		EXPECT_EQ(QVariant(1.0), values.at(27));
+		EXPECT_EQ(QVariant(), values.at(0));
+	}
+
+	// the history runs out part way through January
+	QCoreApplication::processEvents();
+	ASSERT_EQ(3, model.rowCount());
+	EXPECT_TRUE(
+			model.data(model.index(2), MonthHistory::LoadedRole).toBool());
+	EXPECT_FALSE(model.canFetchMore(QModelIndex()));
+}
+
+TEST_F(MonthHistoryTest, RefetchesMonthsDroppedFromTheCache) {
+	MonthHistory model(dateFactory, dataSet);
+	model.fetchMore(QModelIndex());
+	QCoreApplication::processEvents();
+	QCoreApplication::processEvents();
+	model.fetchMore(QModelIndex());
+	QCoreApplication::processEvents();
+	ASSERT_EQ(3, model.rowCount());
+
+	model.setCacheSize(2);
+	EXPECT_FALSE(
+			model.data(model.index(0), MonthHistory::LoadedRole).toBool());
+
+	QSignalSpy dataChangedSpy(&model,
+			SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &, const QVector<int> &)));
+
+	EXPECT_EQ(QVariant(),
+			model.data(model.index(0), MonthHistory::ValuesRole));
+	QCoreApplication::processEvents();
+
+	ASSERT_FALSE(dataChangedSpy.empty());
+	EXPECT_EQ(0, dataChangedSpy.first().at(0).value<QModelIndex>().row());
+	EXPECT_TRUE(
+			model.data(model.index(0), MonthHistory::LoadedRole).toBool());
+}
+
+TEST_F(MonthHistoryTest, AsksAgainForAMonthThatFailed) {
+	scriptedDataSet->failures = 1;
+
+	MonthHistory model(dateFactory, dataSet);
+	model.fetchMore(QModelIndex());
+	QCoreApplication::processEvents();
+	QCoreApplication::processEvents();
+
+	// a failure isn't the end of the history
+	EXPECT_EQ(0, model.rowCount());
+	ASSERT_TRUE(model.canFetchMore(QModelIndex()));
+
+	model.fetchMore(QModelIndex());
+	QCoreApplication::processEvents();
+	QCoreApplication::processEvents();
+	EXPECT_EQ(1, model.rowCount());
+	EXPECT_TRUE(model.canFetchMore(QModelIndex()));
+}
+
+TEST_F(MonthHistoryTest, UpdatesThisMonthWithoutFetchingIt) {
+	MonthHistory model(dateFactory, dataSet);
+	model.fetchMore(QModelIndex());
+	QCoreApplication::processEvents();
+	QCoreApplication::processEvents();
+	ASSERT_EQ(1, model.rowCount());
+	const int requests(scriptedDataSet->requests);
+
+	QVariantList data(dataSet->range(0, 39, QDate(2001, 03, 05)));
+	data[0] = 3.0;
+	dataSet->setData(data);
+
+	QVariantList values(
+			model.data(model.index(0), MonthHistory::ValuesRole).toList());
+	ASSERT_EQ(31, values.size());
+	EXPECT_EQ(QVariant(1.0), values.at(4));
+	EXPECT_EQ(requests, scriptedDataSet->requests);
+}
+
+} // namespace
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricsoutput/MonthModel.h>
+
+#include <QtCore/qnumeric.h>
+#include <QSignalSpy>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace UserMetricsOutput;
+using namespace testing;
+
+namespace {
+
+class MonthModelTest: public Test {
+protected:
+	MonthModelTest() {
+	}
+
+	virtual ~MonthModelTest() {
+	}
+};
+
+TEST_F(MonthModelTest, IsEmptyToStartWith) {
+	MonthModel model;
+
+	EXPECT_EQ(0, model.rowCount());
+}
+
+TEST_F(MonthModelTest, FillsBackwardsFromTheDayOfTheMonth) {
+	MonthModel model;
+
+	QVector<double> data;
+	data << 3.0 << qQNaN() << 1.0 << 0.5;
+	QVector<double>::const_iterator index(data.constBegin());
+	QVector<double>::const_iterator end(data.constEnd());
+
+	model.update(QDate(2001, 2, 17), 3, index, end);
+
+	// one value is left over for the month before
+	EXPECT_EQ(0.5, *index);
+
+	ASSERT_EQ(28, model.rowCount());
+	EXPECT_EQ(QDate(2001, 2, 1), model.month());
+
+	EXPECT_EQ(QVariant(1.0), model.data(model.index(0)));
+	EXPECT_EQ(QVariant(), model.data(model.index(1)));
+	EXPECT_EQ(QVariant(3.0), model.data(model.index(2)));
+	for (int i(3); i < 28; ++i) {
+		EXPECT_EQ(QVariant(), model.data(model.index(i)));
+	}
+
+	EXPECT_FALSE(model.isNull(0));
+	EXPECT_TRUE(model.isNull(1));
+	EXPECT_EQ(3.0, model.value(2));
+}
+
+TEST_F(MonthModelTest, HasTypedRoles) {
+	MonthModel model;
+
+	QVector<double> data;
+	data << 0.25;
+	QVector<double>::const_iterator index(data.constBegin());
+	QVector<double>::const_iterator end(data.constEnd());
+
+	model.update(QDate(2001, 1, 2), 2, index, end);
+
+	QHash<int, QByteArray> roles(model.roleNames());
+	EXPECT_EQ(QByteArray("modelData"), roles[Qt::DisplayRole]);
+	EXPECT_EQ(QByteArray("value"), roles[MonthModel::ValueRole]);
+	EXPECT_EQ(QByteArray("isNull"), roles[MonthModel::IsNullRole]);
+	EXPECT_EQ(QByteArray("date"), roles[MonthModel::DateRole]);
+
+	EXPECT_EQ(QVariant(0.25),
+			model.data(model.index(1), MonthModel::ValueRole));
+	EXPECT_EQ(QVariant(false),
+			model.data(model.index(1), MonthModel::IsNullRole));
+	EXPECT_EQ(QVariant(true),
+			model.data(model.index(0), MonthModel::IsNullRole));
+	EXPECT_EQ(QVariant(QDate(2001, 1, 2)),
+			model.data(model.index(1), MonthModel::DateRole));
+}
+
+TEST_F(MonthModelTest, SignalsOnlyTheDaysThatChanged) {
+	MonthModel model;
+
+	QSignalSpy resetSpy(&model, SIGNAL(modelReset()));
+	QSignalSpy dataChangedSpy(&model,
+			SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)));
+	QSignalSpy insertedSpy(&model,
+			SIGNAL(rowsInserted(const QModelIndex &, int, int)));
+	QSignalSpy removedSpy(&model,
+			SIGNAL(rowsRemoved(const QModelIndex &, int, int)));
+
+	QVector<double> data;
+	data << 1.0 << 2.0;
+
+	{
+		QVector<double>::const_iterator index(data.constBegin());
+		model.update(QDate(2001, 1, 5), 5, index, data.constEnd());
+	}
+	EXPECT_EQ(1, insertedSpy.size());
+	EXPECT_EQ(0, dataChangedSpy.size());
+
+	// only today's value is different
+	data[0] = 3.0;
+	{
+		QVector<double>::const_iterator index(data.constBegin());
+		model.update(QDate(2001, 1, 5), 5, index, data.constEnd());
+	}
+	ASSERT_EQ(1, dataChangedSpy.size());
+	EXPECT_EQ(4, dataChangedSpy.at(0).at(0).value<QModelIndex>().row());
+	EXPECT_EQ(4, dataChangedSpy.at(0).at(1).value<QModelIndex>().row());
+
+	// a shorter month loses rows from the end, and all the dates change
+	{
+		QVector<double>::const_iterator index(data.constBegin());
+		model.update(QDate(2001, 2, 5), 5, index, data.constEnd());
+	}
+	ASSERT_EQ(1, removedSpy.size());
+	EXPECT_EQ(28, removedSpy.at(0).at(1).toInt());
+	EXPECT_EQ(30, removedSpy.at(0).at(2).toInt());
+	ASSERT_EQ(2, dataChangedSpy.size());
+	EXPECT_EQ(0, dataChangedSpy.at(1).at(0).value<QModelIndex>().row());
+	EXPECT_EQ(27, dataChangedSpy.at(1).at(1).value<QModelIndex>().row());
+
+	EXPECT_EQ(0, resetSpy.size());
+}
+
+} // namespace
@@ -20,6 +20,7 @@
 
 #include <unit/libusermetricsoutput/QModelListener.h>
 
+#include <QSignalSpy>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
@@ -176,5 +177,57 @@ TEST_P(TestQVariantListModelRowsAboutToBeInserted, RowsInserted) {
 	model->insertRows(row, count);
 }
 
+TEST(TestQVariantListModelSetVariantList, SignalsOnlyTheChangedRanges) {
+	QVariantListModel model(QVariantList( { 1.0, 2.0, 3.0, 4.0, 5.0 }));
+
+	QSignalSpy resetSpy(&model, SIGNAL(modelReset()));
+	QSignalSpy dataChangedSpy(&model,
+			SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)));
+
+	model.setVariantList(QVariantList( { 1.0, 7.0, 8.0, 4.0, QVariant() }));
+
+	EXPECT_EQ(0, resetSpy.size());
+	ASSERT_EQ(2, dataChangedSpy.size());
+	EXPECT_EQ(1, dataChangedSpy.at(0).at(0).value<QModelIndex>().row());
+	EXPECT_EQ(2, dataChangedSpy.at(0).at(1).value<QModelIndex>().row());
+	EXPECT_EQ(4, dataChangedSpy.at(1).at(0).value<QModelIndex>().row());
+	EXPECT_EQ(4, dataChangedSpy.at(1).at(1).value<QModelIndex>().row());
+	EXPECT_EQ(QVariantList( { 1.0, 7.0, 8.0, 4.0, QVariant() }),
+			model.variantList());
+
+	// setting the same contents again says nothing at all
+	model.setVariantList(QVariantList( { 1.0, 7.0, 8.0, 4.0, QVariant() }));
+	EXPECT_EQ(2, dataChangedSpy.size());
+}
+
+TEST(TestQVariantListModelSetVariantList, GrowsAndShrinksAtTheEnd) {
+	QVariantListModel model(QVariantList( { 1.0, 2.0 }));
+
+	QSignalSpy resetSpy(&model, SIGNAL(modelReset()));
+	QSignalSpy dataChangedSpy(&model,
+			SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)));
+	QSignalSpy insertedSpy(&model,
+			SIGNAL(rowsInserted(const QModelIndex &, int, int)));
+	QSignalSpy removedSpy(&model,
+			SIGNAL(rowsRemoved(const QModelIndex &, int, int)));
+
+	model.setVariantList(QVariantList( { 1.0, 2.0, 3.0, 4.0 }));
+	ASSERT_EQ(1, insertedSpy.size());
+	EXPECT_EQ(2, insertedSpy.at(0).at(1).toInt());
+	EXPECT_EQ(3, insertedSpy.at(0).at(2).toInt());
+	EXPECT_EQ(0, dataChangedSpy.size());
+	EXPECT_EQ(4, model.rowCount());
+
+	model.setVariantList(QVariantList( { 9.0 }));
+	ASSERT_EQ(1, removedSpy.size());
+	EXPECT_EQ(1, removedSpy.at(0).at(1).toInt());
+	EXPECT_EQ(3, removedSpy.at(0).at(2).toInt());
+	ASSERT_EQ(1, dataChangedSpy.size());
+	EXPECT_EQ(0, dataChangedSpy.at(0).at(0).value<QModelIndex>().row());
+	EXPECT_EQ(QVariantList( { 9.0 }), model.variantList());
+
+	EXPECT_EQ(0, resetSpy.size());
+}
+
 }
 
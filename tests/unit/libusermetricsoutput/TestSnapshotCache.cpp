@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <libusermetricsoutput/SnapshotCache.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace UserMetricsOutput;
+using namespace testing;
+
+namespace {
+
+class SnapshotCacheTest: public Test {
+protected:
+	SnapshotCacheTest() :
+			path(QDir(temporaryDir.path()).filePath("cache/snapshot.cache")) {
+	}
+
+	virtual ~SnapshotCacheTest() {
+	}
+
+	QTemporaryDir temporaryDir;
+
+	QString path;
+};
+
+TEST_F(SnapshotCacheTest, IsEmptyWithoutAFile) {
+	SnapshotCache cache(path);
+
+	EXPECT_TRUE(cache.section("store").isEmpty());
+}
+
+TEST_F(SnapshotCacheTest, RoundTripsSections) {
+	{
+		QVariantList data;
+		data << 1.0 << QVariant() << 3.0;
+
+		QVariantMap store;
+		store["data"] = data;
+		store["residentUsers"] = QStringList() << "alice" << "bob";
+
+		SnapshotCache cache(path);
+		cache.setSection("store", store);
+		cache.save();
+	}
+
+	SnapshotCache cache(path);
+	QVariantMap store(cache.section("store"));
+
+	QVariantList data(store["data"].toList());
+	ASSERT_EQ(3, data.size());
+	EXPECT_EQ(1.0, data.at(0).toDouble());
+	EXPECT_TRUE(data.at(1).isNull());
+	EXPECT_EQ(3.0, data.at(2).toDouble());
+	EXPECT_EQ(QStringList() << "alice" << "bob",
+			store["residentUsers"].toStringList());
+	EXPECT_TRUE(cache.section("colorThemes").isEmpty());
+}
+
+TEST_F(SnapshotCacheTest, SavesPendingChangesOnDestruction) {
+	{
+		QVariantMap colorThemes;
+		colorThemes["theme"] = "default";
+
+		SnapshotCache cache(path);
+		cache.setSection("colorThemes", colorThemes);
+	}
+
+	SnapshotCache cache(path);
+	EXPECT_EQ(QString("default"),
+			cache.section("colorThemes")["theme"].toString());
+}
+
+TEST_F(SnapshotCacheTest, IgnoresCorruptFile) {
+	QDir().mkpath(QDir(temporaryDir.path()).filePath("cache"));
+	QFile file(path);
+	ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+	file.write("this is not a cache file");
+	file.close();
+
+	SnapshotCache cache(path);
+
+	EXPECT_TRUE(cache.section("store").isEmpty());
+}
+
+} // namespace
@@ -16,8 +16,11 @@
  * Author: Pete Woods <pete.woods@canonical.com>
  */
 
+#include <libusermetricsoutput/SnapshotCache.h>
 #include <libusermetricsoutput/SyncedUserMetricsStore.h>
 #include <libusermetricsoutput/SyncedUserData.h>
+#include <libusermetricsoutput/UserMetricsImpl.h>
+#include <libusermetricscommon/DateFactoryImpl.h>
 #include <libusermetricscommon/UserMetricsInterface.h>
 #include <libusermetricscommon/UserDataInterface.h>
 #include <libusermetricscommon/DataSetInterface.h>
@@ -29,14 +32,19 @@
 #include <testutils/QVariantPrinter.h>
 #include <testutils/QVariantListPrinter.h>
 
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QTemporaryDir>
 #include <QtTest/QSignalSpy>
 
 #include <gtest/gtest.h>
+#include <gmock/gmock.h>
 
 using namespace std;
 using namespace UserMetricsCommon;
 using namespace UserMetricsOutput;
 using namespace UserMetricsTestUtils;
+using namespace testing;
 
 #define WAIT_FOR_STRINGS_TO_CHANGE() {\
 if (dataSource->formatString().isEmpty()) { \
@@ -53,8 +61,19 @@ if (dataSource->textDomain().isEmpty()) { \
 } \
 }
 
+#define REQUEST_USER_DATA(username) {\
+QSignalSpy userDataAddedSpy(&store, SIGNAL(userDataAdded(const QString &, UserDataPtr))); \
+store.requestUserData(username); \
+ASSERT_TRUE(userDataAddedSpy.wait()); \
+}
+
 namespace {
 
+class MockColorThemeProvider: public ColorThemeProvider {
+public:
+	MOCK_METHOD1(getColorTheme, ColorThemePtrPair(const QString &));
+};
+
 class TestSyncedUserMetricsStore: public DBusTest {
 protected:
 	TestSyncedUserMetricsStore() {
@@ -134,8 +153,7 @@ TEST_F(TestSyncedUserMetricsStore, SyncsNewDataSources) {
 		ASSERT_TRUE(dataSource.isNull());
 	}
 
-	QSignalSpy spy(&userMetricsInterface,
-			SIGNAL(dataSourceAdded(const QDBusObjectPath &)));
+	QSignalSpy spy(&store, SIGNAL(dataSourceAdded(const QString &)));
 
 	QDBusObjectPath dataSourcePath2(
 			userMetricsInterface.createDataSource("data-source-two",
@@ -183,6 +201,9 @@ TEST_F(TestSyncedUserMetricsStore, LoadsUserDataAtStartup) {
 			SIGNAL(connectionEstablished()));
 	connectionEstablishedSpy.wait();
 
+	REQUEST_USER_DATA("username1");
+	REQUEST_USER_DATA("username2");
+
 	{
 		UserMetricsStore::const_iterator it(store.constFind("username1"));
 		ASSERT_NE(it, store.constEnd());
@@ -209,6 +230,9 @@ TEST_F(TestSyncedUserMetricsStore, SyncsNewUserData) {
 			SIGNAL(connectionEstablished()));
 	connectionEstablishedSpy.wait();
 
+	REQUEST_USER_DATA("username1");
+	store.requestUserData("username2");
+
 	{
 		UserMetricsStore::const_iterator it(store.constFind("username1"));
 		ASSERT_NE(it, store.constEnd());
@@ -220,8 +244,8 @@ TEST_F(TestSyncedUserMetricsStore, SyncsNewUserData) {
 		ASSERT_EQ(it, store.constEnd());
 	}
 
-	QSignalSpy spy(&userMetricsInterface,
-			SIGNAL(userDataAdded(const QString &, const QDBusObjectPath &)));
+	QSignalSpy spy(&store,
+			SIGNAL(userDataAdded(const QString &, UserDataPtr)));
 
 	QDBusObjectPath userDataPath2(
 			userMetricsInterface.createUserData("username2"));
@@ -275,6 +299,8 @@ TEST_F(TestSyncedUserMetricsStore, LoadsDataSetsAtStartup) {
 			SIGNAL(connectionEstablished()));
 	connectionEstablishedSpy.wait();
 
+	REQUEST_USER_DATA("username");
+
 	UserMetricsStore::const_iterator userDataIterator(
 			store.constFind("username"));
 	ASSERT_NE(userDataIterator, store.constEnd());
@@ -320,6 +346,8 @@ TEST_F(TestSyncedUserMetricsStore, SyncsNewDataSets) {
 			SIGNAL(connectionEstablished()));
 	connectionEstablishedSpy.wait();
 
+	REQUEST_USER_DATA("username");
+
 	UserMetricsStore::const_iterator userDataIterator(
 			store.constFind("username"));
 	ASSERT_NE(userDataIterator, store.constEnd());
@@ -418,6 +446,8 @@ TEST_F(TestSyncedUserMetricsStore, MergesSystemDataAtStartup) {
 			SIGNAL(connectionEstablished()));
 	connectionEstablishedSpy.wait();
 
+	REQUEST_USER_DATA("username");
+
 	UserMetricsStore::const_iterator userDataIterator(
 			store.constFind("username"));
 	ASSERT_NE(userDataIterator, store.constEnd());
@@ -443,4 +473,251 @@ TEST_F(TestSyncedUserMetricsStore, MergesSystemDataAtStartup) {
 	}
 }
 
+TEST_F(TestSyncedUserMetricsStore, EvictsLeastRecentlyUsedUserData) {
+	com::canonical::UserMetrics userMetricsInterface(DBusPaths::serviceName(),
+			DBusPaths::userMetrics(), systemConnection());
+
+	userMetricsInterface.createUserData("username1");
+	userMetricsInterface.createUserData("username2");
+	userMetricsInterface.createUserData("username3");
+
+	SyncedUserMetricsStore store(systemConnection());
+	store.setMaximumResidentUsers(2);
+	QSignalSpy connectionEstablishedSpy(&store,
+			SIGNAL(connectionEstablished()));
+	connectionEstablishedSpy.wait();
+
+	// nobody is loaded until they are asked for
+	EXPECT_EQ(store.constFind("username1"), store.constEnd());
+	EXPECT_EQ(store.constFind("username2"), store.constEnd());
+	EXPECT_EQ(store.constFind("username3"), store.constEnd());
+
+	REQUEST_USER_DATA("username1");
+	REQUEST_USER_DATA("username2");
+
+	// touch username1 so that username2 is the oldest
+	store.requestUserData("username1");
+
+	REQUEST_USER_DATA("username3");
+
+	EXPECT_NE(store.constFind("username1"), store.constEnd());
+	EXPECT_EQ(store.constFind("username2"), store.constEnd());
+	EXPECT_NE(store.constFind("username3"), store.constEnd());
+}
+
+TEST_F(TestSyncedUserMetricsStore, KeepsRetainedUserData) {
+	com::canonical::UserMetrics userMetricsInterface(DBusPaths::serviceName(),
+			DBusPaths::userMetrics(), systemConnection());
+
+	userMetricsInterface.createUserData("username1");
+	userMetricsInterface.createUserData("username2");
+
+	SyncedUserMetricsStore store(systemConnection());
+	store.setMaximumResidentUsers(1);
+	QSignalSpy connectionEstablishedSpy(&store,
+			SIGNAL(connectionEstablished()));
+	connectionEstablishedSpy.wait();
+
+	// one view is showing username1
+	{
+		QSignalSpy userDataAddedSpy(&store,
+				SIGNAL(userDataAdded(const QString &, UserDataPtr)));
+		store.retainUserData("username1");
+		ASSERT_TRUE(userDataAddedSpy.wait());
+	}
+
+	// while another asks for username2
+	REQUEST_USER_DATA("username2");
+	EXPECT_NE(store.constFind("username1"), store.constEnd());
+	EXPECT_NE(store.constFind("username2"), store.constEnd());
+
+	// once the first view lets go, username1 can be evicted
+	store.releaseUserData("username1");
+	EXPECT_EQ(store.constFind("username1"), store.constEnd());
+	EXPECT_NE(store.constFind("username2"), store.constEnd());
+}
+
+TEST_F(TestSyncedUserMetricsStore, FetchesRemovedUserDataAgain) {
+	com::canonical::UserMetrics userMetricsInterface(DBusPaths::serviceName(),
+			DBusPaths::userMetrics(), systemConnection());
+
+	QDBusObjectPath userDataPath(
+			userMetricsInterface.createUserData("username"));
+
+	SyncedUserMetricsStore store(systemConnection());
+	QSignalSpy connectionEstablishedSpy(&store,
+			SIGNAL(connectionEstablished()));
+	connectionEstablishedSpy.wait();
+
+	REQUEST_USER_DATA("username");
+
+	store.removeUserData("username", userDataPath);
+	EXPECT_EQ(store.constFind("username"), store.constEnd());
+
+	REQUEST_USER_DATA("username");
+	EXPECT_NE(store.constFind("username"), store.constEnd());
+}
+
+TEST_F(TestSyncedUserMetricsStore, ForgetsCachedDataTheServiceNoLongerHas) {
+	com::canonical::UserMetrics userMetricsInterface(DBusPaths::serviceName(),
+			DBusPaths::userMetrics(), systemConnection());
+
+	QDBusObjectPath dataSourcePath(
+			userMetricsInterface.createDataSource("data-source-one",
+					"format string one %1", "empty data string one",
+					"text domain one", MetricType::USER, QVariantMap()));
+
+	QTemporaryDir temporaryDir;
+	SnapshotCachePtr cache(
+			new SnapshotCache(QDir(temporaryDir.path()).filePath("cache")));
+
+	// left over from before the service's database was reset
+	const QString stalePath(DBusPaths::dataSource(99));
+	QVariantMap staleSource;
+	staleSource["formatString"] = "stale format string %1";
+	QVariantMap dataSources;
+	dataSources[stalePath] = staleSource;
+
+	QVariantMap staleUser;
+	staleUser["username"] = "username";
+	staleUser["dataSets"] = QVariantMap();
+	QVariantMap userDatas;
+	userDatas[DBusPaths::userData(99)] = staleUser;
+
+	QVariantMap cached;
+	cached["dataSources"] = dataSources;
+	cached["userDatas"] = userDatas;
+	cached["residentUsers"] = QStringList() << "username";
+	cache->setSection("store", cached);
+
+	{
+		SyncedUserMetricsStore store(systemConnection(), cache);
+		EXPECT_FALSE(store.dataSource(stalePath).isNull());
+		EXPECT_NE(store.constFind("username"), store.constEnd());
+
+		QSignalSpy connectionEstablishedSpy(&store,
+				SIGNAL(connectionEstablished()));
+		ASSERT_TRUE(connectionEstablishedSpy.wait());
+
+		EXPECT_TRUE(store.dataSource(stalePath).isNull());
+		EXPECT_FALSE(store.dataSource(dataSourcePath.path()).isNull());
+		EXPECT_EQ(store.constFind("username"), store.constEnd());
+	}
+
+	// and they aren't written back
+	const QVariantMap saved(cache->section("store"));
+	EXPECT_FALSE(saved["dataSources"].toMap().contains(stalePath));
+	EXPECT_TRUE(saved["dataSources"].toMap().contains(dataSourcePath.path()));
+	EXPECT_FALSE(
+			saved["userDatas"].toMap().contains(DBusPaths::userData(99)));
+}
+
+TEST_F(TestSyncedUserMetricsStore, SharesSystemDataBetweenUsers) {
+	com::canonical::UserMetrics userMetricsInterface(DBusPaths::serviceName(),
+			DBusPaths::userMetrics(), systemConnection());
+
+	QDBusObjectPath batteryPath(
+			userMetricsInterface.createDataSource("battery",
+					"battery level format string", "", "", MetricType::SYSTEM,
+					QVariantMap()));
+	ASSERT_EQ(DBusPaths::dataSource(1), batteryPath.path());
+
+	userMetricsInterface.createUserData("username1");
+	userMetricsInterface.createUserData("username2");
+	QDBusObjectPath systemDataPath(userMetricsInterface.createUserData(""));
+	ASSERT_EQ(DBusPaths::userData(3), systemDataPath.path());
+
+	com::canonical::usermetrics::UserData systemDataInterface(
+			DBusPaths::serviceName(), DBusPaths::userData(3),
+			systemConnection());
+	systemDataInterface.createDataSet("battery");
+
+	SyncedUserMetricsStore store(systemConnection());
+	QSignalSpy connectionEstablishedSpy(&store,
+			SIGNAL(connectionEstablished()));
+	connectionEstablishedSpy.wait();
+
+	REQUEST_USER_DATA("username1");
+	REQUEST_USER_DATA("username2");
+
+	UserDataPtr userData1(*store.constFind("username1"));
+	UserDataPtr userData2(*store.constFind("username2"));
+
+	UserData::const_iterator battery1(
+			userData1->constFind(DBusPaths::dataSource(1)));
+	ASSERT_NE(battery1, userData1->constEnd());
+	UserData::const_iterator battery2(
+			userData2->constFind(DBusPaths::dataSource(1)));
+	ASSERT_NE(battery2, userData2->constEnd());
+
+	// both users see the very same data set
+	EXPECT_EQ(battery1->data(), battery2->data());
+}
+
+TEST_F(TestSyncedUserMetricsStore, MovesOnWhenSystemDataOnShowIsRemoved) {
+	com::canonical::UserMetrics userMetricsInterface(DBusPaths::serviceName(),
+			DBusPaths::userMetrics(), systemConnection());
+
+	userMetricsInterface.createDataSource("twitter", "twitter %1", "", "",
+			MetricType::USER, QVariantMap());
+	userMetricsInterface.createDataSource("battery", "battery %1", "", "",
+			MetricType::SYSTEM, QVariantMap());
+
+	QDBusObjectPath userDataPath(
+			userMetricsInterface.createUserData("username"));
+	QDBusObjectPath systemDataPath(userMetricsInterface.createUserData(""));
+
+	com::canonical::usermetrics::UserData userDataInterface(
+			DBusPaths::serviceName(), userDataPath.path(), systemConnection());
+	com::canonical::usermetrics::DataSet twitterDataSetInterface(
+			DBusPaths::serviceName(),
+			userDataInterface.createDataSet("twitter").value().path(),
+			systemConnection());
+	twitterDataSetInterface.update(QVariantList() << 1.0);
+
+	com::canonical::usermetrics::UserData systemDataInterface(
+			DBusPaths::serviceName(), systemDataPath.path(),
+			systemConnection());
+	com::canonical::usermetrics::DataSet batteryDataSetInterface(
+			DBusPaths::serviceName(),
+			systemDataInterface.createDataSet("battery").value().path(),
+			systemConnection());
+	batteryDataSetInterface.update(QVariantList() << 2.0);
+
+	QSharedPointer<SyncedUserMetricsStore> storePtr(
+			new SyncedUserMetricsStore(systemConnection()));
+	SyncedUserMetricsStore &store(*storePtr);
+	QSignalSpy connectionEstablishedSpy(&store,
+			SIGNAL(connectionEstablished()));
+	connectionEstablishedSpy.wait();
+
+	REQUEST_USER_DATA("username");
+
+	QSharedPointer<ColorThemeProvider> colorThemeProvider(
+			new NiceMock<MockColorThemeProvider>());
+	UserMetricsImpl model(QSharedPointer<DateFactory>(new DateFactoryImpl()),
+			storePtr, colorThemeProvider);
+	model.setUsername("username");
+	model.readyForDataChangeSlot();
+	EXPECT_EQ(QString("twitter 1"), model.label());
+
+	// rotate on to the system data set
+	model.nextDataSourceSlot();
+	model.readyForDataChangeSlot();
+	EXPECT_EQ(QString("battery 2"), model.label());
+
+	// and have the system data go away while it is on show
+	QSignalSpy dataAboutToChangeSpy(&model, SIGNAL(dataAboutToChange()));
+	store.removeUserData("", systemDataPath);
+	QCoreApplication::processEvents();
+	ASSERT_EQ(1, dataAboutToChangeSpy.size());
+
+	model.readyForDataChangeSlot();
+	EXPECT_EQ(QString("twitter 1"), model.label());
+
+	model.nextDataSourceSlot();
+	model.readyForDataChangeSlot();
+	EXPECT_EQ(QString("twitter 1"), model.label());
+}
+
 } // namespace
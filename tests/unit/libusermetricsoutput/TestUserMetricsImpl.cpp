@@ -18,6 +18,7 @@
 
 #include <QSignalSpy>
 #include <QDebug>
+#include <QtCore/QCoreApplication>
 
 #include <libusermetricsoutput/ColorThemeProvider.h>
 #include <libusermetricsoutput/UserMetricsImpl.h>
@@ -217,7 +218,7 @@ TEST_F(UserMetricsImplTest, HasEmptyDataForNonExistentUserThenAppearsWhenAdded)
 	dataSet->setLastUpdated(QDate(2001, 01, 07));
 	dataSet->setData(data);
 
-	ASSERT_TRUE(formatStringChangedSpy.wait());
+	ASSERT_FALSE(formatStringChangedSpy.empty());
 	EXPECT_EQ(QString("test format string 1").toStdString(),
 			model->label().toStdString());
 
@@ -312,7 +313,7 @@ TEST_F(UserMetricsImplTest, AddDataForToday) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(formatStringChangedSpy.wait());
+	ASSERT_FALSE(formatStringChangedSpy.empty());
 	EXPECT_EQ(QString("test format string 100"), model->label());
 
 	// assertions about first month's data
@@ -375,7 +376,7 @@ TEST_F(UserMetricsImplTest, FollowsCurrentDataSource) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(formatStringChangedSpy.wait());
+	ASSERT_FALSE(formatStringChangedSpy.empty());
 	EXPECT_EQ(QString("test format string 100"), model->label());
 
 	// assertions about first month's data
@@ -451,8 +452,7 @@ TEST_F(UserMetricsImplTest, AddTranslatedData) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(formatStringChangedSpy.wait());
-	ASSERT_TRUE(formatStringChangedSpy.wait());
+	ASSERT_EQ(2, formatStringChangedSpy.size());
 	EXPECT_EQ(QString("100 translated messages received").toStdString(),
 			model->label().toStdString());
 
@@ -496,8 +496,7 @@ TEST_F(UserMetricsImplTest, AddTranslatedEmptyData) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(emptyDataStringChangedSpy.wait());
-	ASSERT_TRUE(emptyDataStringChangedSpy.wait());
+	ASSERT_EQ(2, emptyDataStringChangedSpy.size());
 	EXPECT_EQ(QString("no translated messages today").toStdString(),
 			model->label().toStdString());
 
@@ -549,7 +548,7 @@ TEST_F(UserMetricsImplTest, AddOldDataUpdatedThisMonth) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(emptyDataStringChangedSpy.wait());
+	ASSERT_FALSE(emptyDataStringChangedSpy.empty());
 	EXPECT_EQ(QString("no data source two").toStdString(), model->label().toStdString());
 
 	// assertions about first month's data
@@ -621,7 +620,7 @@ TEST_F(UserMetricsImplTest, AddOldDataUpdatedLastMonth) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(emptyDataStringChangedSpy.wait());
+	ASSERT_FALSE(emptyDataStringChangedSpy.empty());
 	EXPECT_EQ(QString("there's no data"), model->label());
 
 	// assertions about first month's data
@@ -688,7 +687,7 @@ TEST_F(UserMetricsImplTest, AddDataUpdatedThisMonthButNotEnoughToFillTheMonth) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(formatStringChangedSpy.wait());
+	ASSERT_FALSE(formatStringChangedSpy.empty());
 	EXPECT_EQ(QString("No data for today (data-source-id)"), model->label());
 
 	// assertions about first month's data
@@ -742,7 +741,7 @@ TEST_F(UserMetricsImplTest, AddDataMultipleDataForSingleUser) {
 		dataSet->setLastUpdated(QDate(2001, 1, 4));
 		dataSet->setData(data);
 
-		ASSERT_TRUE(emptyDataStringChangedSpy.wait());
+		ASSERT_FALSE(emptyDataStringChangedSpy.empty());
 	}
 
 	// second data set
@@ -763,7 +762,7 @@ TEST_F(UserMetricsImplTest, AddDataMultipleDataForSingleUser) {
 		dataSet->setLastUpdated(QDate(2001, 1, 7));
 		dataSet->setData(data);
 
-		ASSERT_TRUE(emptyDataStringChangedSpy.wait());
+		ASSERT_FALSE(emptyDataStringChangedSpy.empty());
 	}
 
 	QSharedPointer<ColorTheme> blankColorTheme(
@@ -867,7 +866,7 @@ TEST_F(UserMetricsImplTest, AddDataMultipleDataForMultipleUsers) {
 			dataSet->setLastUpdated(QDate(2001, 1, 7));
 			dataSet->setData(data);
 
-			ASSERT_TRUE(formatStringChangedSpy.wait());
+			ASSERT_FALSE(formatStringChangedSpy.empty());
 		}
 
 		// second data set
@@ -887,7 +886,7 @@ TEST_F(UserMetricsImplTest, AddDataMultipleDataForMultipleUsers) {
 			dataSet->setLastUpdated(QDate(2001, 1, 7));
 			dataSet->setData(data);
 
-			ASSERT_TRUE(formatStringChangedSpy.wait());
+			ASSERT_FALSE(formatStringChangedSpy.empty());
 		}
 	}
 
@@ -916,7 +915,7 @@ TEST_F(UserMetricsImplTest, AddDataMultipleDataForMultipleUsers) {
 			dataSet->setLastUpdated(QDate(2001, 1, 7));
 			dataSet->setData(data);
 
-			ASSERT_TRUE(formatStringChangedSpy.wait());
+			ASSERT_FALSE(formatStringChangedSpy.empty());
 		}
 
 		// fifth data set
@@ -937,7 +936,7 @@ TEST_F(UserMetricsImplTest, AddDataMultipleDataForMultipleUsers) {
 			dataSet->setLastUpdated(QDate(2001, 1, 7));
 			dataSet->setData(data);
 
-			ASSERT_TRUE(formatStringChangedSpy.wait());
+			ASSERT_FALSE(formatStringChangedSpy.empty());
 		}
 	}
 
@@ -1227,7 +1226,7 @@ TEST_F(UserMetricsImplTest, AddSourceWithMinimum) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(formatStringChangedSpy.wait());
+	ASSERT_FALSE(formatStringChangedSpy.empty());
 	EXPECT_EQ(QString("test format string 100"), model->label());
 
 	// assertions about first month's data
@@ -1281,7 +1280,7 @@ TEST_F(UserMetricsImplTest, AddSourceWithMaximum) {
 	model->setUsername("username");
 	model->readyForDataChangeSlot();
 
-	ASSERT_TRUE(formatStringChangedSpy.wait());
+	ASSERT_FALSE(formatStringChangedSpy.empty());
 	EXPECT_EQ(QString("test format string 0"), model->label());
 
 	// assertions about first month's data
@@ -1300,4 +1299,220 @@ TEST_F(UserMetricsImplTest, AddSourceWithMaximum) {
 	}
 }
 
+TEST_F(UserMetricsImplTest, PreparesTheNextDataSetBeforeTheSwap) {
+	ColorThemePtr blankColorTheme(
+			new ColorThemeImpl(QColor(), QColor(), QColor()));
+	ColorThemePtrPair emptyPair(blankColorTheme, blankColorTheme);
+	EXPECT_CALL(*colorThemeProvider, getColorTheme(_)).WillRepeatedly(
+			Return(emptyPair));
+
+	DataSourcePtr dataSourceOne(new DataSource());
+	userDataStore->insert("data-source-one", dataSourceOne);
+	DataSourcePtr dataSourceTwo(new DataSource());
+	userDataStore->insert("data-source-two", dataSourceTwo);
+
+	UserMetricsStore::iterator userDataIterator(
+			userDataStore->insert("username",
+					UserDataPtr(new UserData(*userDataStore))));
+	UserDataPtr userData(*userDataIterator);
+
+	{
+		DataSetPtr dataSet(
+				*userData->insert("data-source-one",
+						DataSetPtr(new DataSet(dataSourceOne))));
+		dataSet->setLastUpdated(QDate(2001, 01, 07));
+		dataSet->setData(QVariantList() << 10.0 << 0.0);
+	}
+	{
+		DataSetPtr dataSet(
+				*userData->insert("data-source-two",
+						DataSetPtr(new DataSet(dataSourceTwo))));
+		dataSet->setLastUpdated(QDate(2001, 01, 07));
+		dataSet->setData(QVariantList() << 0.0 << 10.0);
+	}
+
+	model->setUsername("username");
+	model->readyForDataChangeSlot();
+
+	QAbstractItemModel *firstMonth(model->firstMonth());
+	EXPECT_EQ(QVariant(1.0), firstMonth->data(firstMonth->index(6, 0)));
+
+	QSignalSpy firstMonthChangedSpy(model.data(),
+			SIGNAL(firstMonthChanged(QAbstractItemModel *)));
+	QSignalSpy secondMonthChangedSpy(model.data(),
+			SIGNAL(secondMonthChanged(QAbstractItemModel *)));
+
+	// the UI keeps showing the current data while it animates
+	model->nextDataSourceSlot();
+	EXPECT_EQ(firstMonth, model->firstMonth());
+	EXPECT_EQ(QVariant(1.0), firstMonth->data(firstMonth->index(6, 0)));
+	EXPECT_EQ(0, firstMonthChangedSpy.size());
+
+	// then the prepared months are swapped in
+	model->readyForDataChangeSlot();
+	EXPECT_NE(firstMonth, model->firstMonth());
+	EXPECT_EQ(QVariant(0.0),
+			model->firstMonth()->data(model->firstMonth()->index(6, 0)));
+	EXPECT_EQ(1, firstMonthChangedSpy.size());
+	EXPECT_EQ(1, secondMonthChangedSpy.size());
+}
+
+TEST_F(UserMetricsImplTest, MovesOnWhenTheDataSetOnShowIsRemoved) {
+	DataSourcePtr twitter(new DataSource());
+	twitter->setFormatString("twitter %1");
+	userDataStore->insert("twitter", twitter);
+
+	DataSourcePtr facebook(new DataSource());
+	facebook->setFormatString("facebook %1");
+	userDataStore->insert("facebook", facebook);
+
+	UserDataPtr userData(
+			*userDataStore->insert("username",
+					UserDataPtr(new UserData(*userDataStore))));
+	DataSetPtr facebookData(
+			*userData->insert("facebook", DataSetPtr(new DataSet(facebook))));
+	facebookData->setLastUpdated(QDate(2001, 01, 07));
+	facebookData->setData(QVariantList() << 1.0);
+	DataSetPtr twitterData(
+			*userData->insert("twitter", DataSetPtr(new DataSet(twitter))));
+	twitterData->setLastUpdated(QDate(2001, 01, 07));
+	twitterData->setData(QVariantList() << 2.0);
+
+	model->setUsername("username");
+	model->readyForDataChangeSlot();
+	EXPECT_EQ(QString("facebook 1"), model->label());
+
+	QSignalSpy dataAboutToChangeSpy(model.data(), SIGNAL(dataAboutToChange()));
+
+	userData->remove("facebook");
+	QCoreApplication::processEvents();
+	ASSERT_EQ(1, dataAboutToChangeSpy.size());
+
+	model->readyForDataChangeSlot();
+	EXPECT_EQ(QString("twitter 2"), model->label());
+
+	// the rotation carries on from the data set that's left
+	model->nextDataSourceSlot();
+	model->readyForDataChangeSlot();
+	EXPECT_EQ(QString("twitter 2"), model->label());
+}
+
+TEST_F(UserMetricsImplTest, ListsEveryDataSetLazily) {
+	DataSourcePtr twitter(new DataSource());
+	twitter->setFormatString("twitter %1");
+	userDataStore->insert("twitter", twitter);
+
+	DataSourcePtr facebook(new DataSource());
+	facebook->setFormatString("facebook %1");
+	userDataStore->insert("facebook", facebook);
+
+	UserDataPtr userData(
+			*userDataStore->insert("username",
+					UserDataPtr(new UserData(*userDataStore))));
+	DataSetPtr twitterData(
+			*userData->insert("twitter", DataSetPtr(new DataSet(twitter))));
+	twitterData->setLastUpdated(QDate(2001, 01, 07));
+	twitterData->setData(QVariantList() << 1.0);
+	DataSetPtr facebookData(
+			*userData->insert("facebook", DataSetPtr(new DataSet(facebook))));
+	facebookData->setLastUpdated(QDate(2001, 01, 07));
+	facebookData->setData(QVariantList() << 2.0);
+
+	ColorThemePtr blankColorTheme(
+			new ColorThemeImpl(QColor(), QColor(), QColor()));
+	ColorThemePtrPair emptyPair(blankColorTheme, blankColorTheme);
+	// the rotation asks for the colours of whatever it is showing
+	EXPECT_CALL(*colorThemeProvider, getColorTheme(_)).WillRepeatedly(
+			Return(emptyPair));
+
+	model->setUsername("username");
+
+	QAbstractItemModel *dataSets(model->dataSets());
+	ASSERT_EQ(2, dataSets->rowCount());
+	EXPECT_TRUE(dataSets->findChildren<MonthModel *>().isEmpty());
+	EXPECT_EQ(QVariant("facebook"),
+			dataSets->data(dataSets->index(0, 0),
+					UserMetricsListModel::DataSourceRole));
+	EXPECT_EQ(QVariant("twitter"),
+			dataSets->data(dataSets->index(1, 0),
+					UserMetricsListModel::DataSourceRole));
+
+	// only the row we look at is built
+	EXPECT_EQ(QVariant("twitter 1"),
+			dataSets->data(dataSets->index(1, 0),
+					UserMetricsListModel::LabelRole));
+	EXPECT_EQ(2, dataSets->findChildren<MonthModel *>().size());
+	{
+		const QAbstractItemModel *month(
+				dataSets->data(dataSets->index(1, 0),
+						UserMetricsListModel::FirstMonthRole).value<
+						QAbstractItemModel *>());
+		ASSERT_TRUE(month);
+		EXPECT_EQ(QVariant(0.5), month->data(month->index(6, 0)));
+	}
+
+	QSignalSpy dataChangedSpy(dataSets,
+			SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &, const QVector<int> &)));
+
+	twitterData->setData(QVariantList() << 3.0);
+	ASSERT_EQ(1, dataChangedSpy.size());
+	EXPECT_EQ(1, dataChangedSpy.at(0).at(0).value<QModelIndex>().row());
+	EXPECT_EQ(QVariant("twitter 3"),
+			dataSets->data(dataSets->index(1, 0),
+					UserMetricsListModel::LabelRole));
+
+	// rows nobody has looked at are left alone
+	facebookData->setData(QVariantList() << 4.0);
+	EXPECT_EQ(1, dataChangedSpy.size());
+
+	userData->remove("facebook");
+	EXPECT_EQ(1, dataSets->rowCount());
+}
+
+TEST_F(UserMetricsImplTest, PreparesTheNextDataSetAhead) {
+	DataSourcePtr twitter(new DataSource());
+	twitter->setFormatString("twitter %1");
+	userDataStore->insert("twitter", twitter);
+
+	DataSourcePtr facebook(new DataSource());
+	facebook->setFormatString("facebook %1");
+	userDataStore->insert("facebook", facebook);
+
+	UserDataPtr userData(
+			*userDataStore->insert("username",
+					UserDataPtr(new UserData(*userDataStore))));
+	DataSetPtr facebookData(
+			*userData->insert("facebook", DataSetPtr(new DataSet(facebook))));
+	facebookData->setLastUpdated(QDate(2001, 01, 07));
+	facebookData->setData(QVariantList() << 1.0);
+	DataSetPtr twitterData(
+			*userData->insert("twitter", DataSetPtr(new DataSet(twitter))));
+	twitterData->setLastUpdated(QDate(2001, 01, 07));
+	twitterData->setData(QVariantList() << 2.0);
+
+	ColorThemePtr blankColorTheme(
+			new ColorThemeImpl(QColor(), QColor(), QColor()));
+	ColorThemePtrPair emptyPair(blankColorTheme, blankColorTheme);
+	ON_CALL(*colorThemeProvider, getColorTheme(_)).WillByDefault(
+			Return(emptyPair));
+
+	model->setUsername("username");
+	model->readyForDataChangeSlot();
+	EXPECT_EQ(QString("facebook 1"), model->label());
+
+	// the frame for twitter is built while nothing else is happening
+	QCoreApplication::processEvents();
+
+	// and kept up to date
+	twitterData->setData(QVariantList() << 5.0);
+
+	// so moving on to it doesn't need to look anything up
+	EXPECT_CALL(*colorThemeProvider, getColorTheme(_)).Times(0);
+	model->nextDataSourceSlot();
+	model->readyForDataChangeSlot();
+	EXPECT_EQ(QString("twitter 5"), model->label());
+	EXPECT_EQ(QVariant(0.5),
+			model->firstMonth()->data(model->firstMonth()->index(6, 0)));
+}
+
 } // namespace
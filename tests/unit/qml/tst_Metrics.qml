@@ -37,8 +37,13 @@ TestCase {
         minimum: originalMinimum
     }
 
+    MetricHistory {
+        id: history
+    }
+
     function test_metric() {
         // Make sure the metric properties have been set properly
+        metric.flush();
         var info = dbusQuery.queryMetricInfo(1);
         compare(info.name, originalName, "Metric name was not set properly");
         compare(info.format, originalFormat, "Metric format was not set properly");
@@ -49,20 +54,26 @@ TestCase {
         
         metric.minimum = 0.0
         metric.maximum = 10.0
+        metric.flush();
         info = dbusQuery.queryMetricInfo(1);
         fuzzyCompare(info.minimum, 0.0, 0.01, "Metric minimum was not set properly");
         fuzzyCompare(info.maximum, 10.0, 0.01, "Metric maximum was not set properly");
 
         // Test update and increment with integers and floating point data
         metric.update(0);
+        metric.flush();
         fuzzyCompare(dbusQuery.queryCurrentValue(1), 0, 0.01, "Data not updated successfully")
         metric.increment();
+        metric.flush();
         compare(dbusQuery.queryCurrentValue(1), 1, 0.01, "Data not incremented successfully")
         metric.increment(7776);
+        metric.flush();
         fuzzyCompare(dbusQuery.queryCurrentValue(1), 7777, 0.01, "Data not incremented successfully")
         metric.increment(0.999);
+        metric.flush();
         fuzzyCompare(dbusQuery.queryCurrentValue(1), 7777.999, 0.01, "Data not incremented successfully")
         metric.update(5.5);
+        metric.flush();
         fuzzyCompare(dbusQuery.queryCurrentValue(1), 5.5, 0.01, "Data not updated successfully")
 
         // Check that when changing the metric format or emptyFormat nothing else changes and
@@ -73,6 +84,7 @@ TestCase {
         metric.format = newFormat;
         metric.emptyFormat = newEmptyFormat;
         metric.domain = newDomain;
+        metric.flush();
         info = dbusQuery.queryMetricInfo(1);
         compare(info.name, originalName, "Metric name was changed without requesting it");
         compare(info.format, newFormat, "Metric format was not changed properly");
@@ -84,6 +96,7 @@ TestCase {
         // Check that when changing the metric name a new metric is created with the new name
         var newName = "another_test";
         metric.name = newName;
+        metric.flush();
         info = dbusQuery.queryMetricInfo(1);
         compare(info.name, originalName, "Metric 1 name was changed instead of creating new metric");
         info = dbusQuery.queryMetricInfo(2);
@@ -93,9 +106,11 @@ TestCase {
         // Check that now the "metric" object points to the newly created metric and changes to it don't
         // affect the old metric
         metric.update(0);
+        metric.flush();
         fuzzyCompare(dbusQuery.queryCurrentValue(1), 5.5, 0.01, "Metric 1 data was changed while metric 2 was in use");
         fuzzyCompare(dbusQuery.queryCurrentValue(2), 0, 0.01, "Metric 2 data was not updated correctly");
         metric.increment(1.5);
+        metric.flush();
         fuzzyCompare(dbusQuery.queryCurrentValue(1), 5.5, 0.01, "Metric 1 data was changed while metric 2 was in use");
         fuzzyCompare(dbusQuery.queryCurrentValue(2), 1.5, 0.01, "Metric 2 data was not incremented correctly");
 
@@ -103,9 +118,56 @@ TestCase {
         // original name works fine and has no side effects.
         metric.name = originalName;
         metric.update(0);
+        metric.flush();
         fuzzyCompare(dbusQuery.queryCurrentValue(1), 0, 0.01, "Metric 1 data was not changed when pointing to it");
         fuzzyCompare(dbusQuery.queryCurrentValue(2), 1.5, 0.01, "Metric 2 data was changed when pointing to metric 1");
         info = dbusQuery.queryMetricInfo(3);
         compare(info, null, "A new metric shouldn't have been created when pointing back to metric 1");
     }
+
+    function test_metricHistory() {
+        // Runs after test_metric, which leaves today's value at 0
+        history.name = originalName;
+        tryCompare(history, "ready", true);
+        tryCompare(history, "count", 1);
+        var row = history.get(0);
+        compare(row.day, 0, "First row is not today");
+        fuzzyCompare(row.value, 0, 0.01, "History does not match the metric");
+
+        // Updates to the data set are followed without fetching it again
+        metric.update(3.5);
+        metric.flush();
+        for (var i = 0; i < 50 && history.get(0).value !== 3.5; ++i) {
+            wait(50);
+        }
+        fuzzyCompare(history.get(0).value, 3.5, 0.01, "History was not updated");
+        compare(history.count, 1, "Rows were added by an update");
+    }
+
+    function test_metricIncrementsAccumulate() {
+        // Runs after test_metricHistory, so only depends on its own updates
+        metric.update(10);
+        metric.flush();
+
+        // Several increments are sent together as their sum
+        metric.increment(1);
+        metric.increment(2.5);
+        metric.increment(0.5);
+        metric.flush();
+        fuzzyCompare(dbusQuery.queryCurrentValue(1), 14, 0.01, "Increments were not summed");
+
+        // An update throws away the increments made before it
+        metric.increment(3);
+        metric.increment(4);
+        metric.update(2);
+        metric.flush();
+        fuzzyCompare(dbusQuery.queryCurrentValue(1), 2, 0.01, "Increments before an update were kept");
+
+        // Increments made after an update are added on top of it
+        metric.update(5);
+        metric.increment(1);
+        metric.increment(1.5);
+        metric.flush();
+        fuzzyCompare(dbusQuery.queryCurrentValue(1), 7.5, 0.01, "Increments after an update were lost");
+    }
 }
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#ifndef TESTS_UNIT_USERMETRICSSERVICE_SERVICEMOCKS_H_
+#define TESTS_UNIT_USERMETRICSSERVICE_SERVICEMOCKS_H_
+
+#include <usermetricsservice/TranslationLocator.h>
+#include <libusermetricscommon/DateFactory.h>
+
+#include <QtCore/QDate>
+#include <QtCore/QString>
+
+#include <gmock/gmock.h>
+
+namespace TestsUnitUserMetricsService {
+
+class MockTranslationLocator: public UserMetricsService::TranslationLocator {
+public:
+	MOCK_METHOD1(locate, QString(const QString&));
+};
+
+class MockDateFactory: public UserMetricsCommon::DateFactory {
+public:
+	MOCK_CONST_METHOD0(currentDate, QDate());
+};
+
+}
+
+#endif // TESTS_UNIT_USERMETRICSSERVICE_SERVICEMOCKS_H_
@@ -20,6 +20,8 @@
 
 #include <usermetricsservice/Authentication.h>
 
+#include <QtCore/QCoreApplication>
+
 #include <gtest/gtest.h>
 
 using namespace testing;
@@ -29,12 +31,23 @@ namespace {
 
 class TestAuthentication: public Test {
 protected:
-	TestAuthentication() {
+	TestAuthentication() :
+			hadNoAuth(qEnvironmentVariableIsSet("USERMETRICS_NO_AUTH")), noAuth(
+					qgetenv("USERMETRICS_NO_AUTH")) {
 	}
 
 	virtual ~TestAuthentication() {
 	}
 
+	virtual void TearDown() {
+		// put the environment back even if the test bailed out early
+		if (hadNoAuth) {
+			qputenv("USERMETRICS_NO_AUTH", noAuth);
+		} else {
+			qunsetenv("USERMETRICS_NO_AUTH");
+		}
+	}
+
 	void checkCanoncialize(const QString &expected,
 			const QString &confinementContext) {
 		QString input(confinementContext);
@@ -43,6 +56,10 @@ protected:
 	}
 
 	Authentication auth;
+
+	bool hadNoAuth;
+
+	QByteArray noAuth;
 };
 
 TEST_F(TestAuthentication, CanonicalizesContexts) {
@@ -58,5 +75,20 @@ TEST_F(TestAuthentication, IgnoresNormalNames) {
 	checkCanoncialize("my_cool_app", "my_cool_app");
 }
 
+TEST_F(TestAuthentication, FinishesLookupsOnTheCallingThread) {
+	qputenv("USERMETRICS_NO_AUTH", "1");
+
+	CredentialLookup lookup(auth, QDBusConnection("no-connection"), ":1.42");
+	lookup.run();
+
+	// the pool thread hands the result back through the event loop
+	EXPECT_FALSE(lookup.isFinished());
+	QCoreApplication::processEvents();
+	EXPECT_TRUE(lookup.isFinished());
+
+	EXPECT_EQ(QString(), lookup.username());
+	EXPECT_EQ(QString("unconfined"), lookup.confinementContext());
+}
+
 } // namespace
 
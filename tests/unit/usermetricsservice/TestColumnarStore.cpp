@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <usermetricsservice/ColumnarStore.h>
+#include <testutils/QVariantListPrinter.h>
+
+#include <QtCore/QDateTime>
+#include <QtCore/qnumeric.h>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace testing;
+using namespace UserMetricsService;
+
+namespace {
+
+class TestColumnarStore: public Test {
+protected:
+	TestColumnarStore() {
+	}
+
+	virtual ~TestColumnarStore() {
+	}
+
+	QVariantMap aggregate(int column, int fromDay, int toDay,
+			const QDate &today = QDate(2001, 03, 5)) const {
+		ColumnarStore::Aggregates aggregates;
+		store.aggregate(today, fromDay, toDay, aggregates);
+		return aggregates.toVariantMap(column, QStringList( { "sum", "mean",
+				"min", "max", "count" }));
+	}
+
+	ColumnarStore store;
+};
+
+TEST_F(TestColumnarStore, StartsEmpty) {
+	EXPECT_EQ(0, store.columnCount());
+	EXPECT_FALSE(store.lastUpdated().isValid());
+	EXPECT_EQ(QVariantList(), store.toVariantMap()["data"].toList());
+}
+
+TEST_F(TestColumnarStore, LinesUpColumnsByDay) {
+	store.setColumn(10, QDate(2001, 03, 5), QVariantList( { 1.0, 2.0 }));
+	store.setColumn(20, QDate(2001, 03, 4), QVariantList( { 3.0, "", 5.0 }));
+	store.setColumn(30, QDate(2001, 03, 5), QVariantList( { -1.0 }));
+
+	EXPECT_EQ(3, store.columnCount());
+	EXPECT_EQ(QDate(2001, 03, 5), store.lastUpdated());
+	EXPECT_EQ(1, store.column(20));
+	EXPECT_EQ(-1, store.column(40));
+
+	QVariantMap exported(store.toVariantMap());
+	EXPECT_EQ(3, exported["columns"].toInt());
+	EXPECT_EQ(QDateTime(QDate(2001, 03, 5)).toTime_t(),
+			exported["lastUpdated"].toUInt());
+	EXPECT_EQ(QVariantList( { 1.0, "", -1.0, 2.0, 3.0, "", "", "", "", "",
+			5.0, "" }), exported["data"].toList());
+}
+
+TEST_F(TestColumnarStore, MovesEveryColumnOnANewDay) {
+	store.setColumn(10, QDate(2001, 03, 4), QVariantList( { 1.0, 2.0 }));
+	store.setColumn(20, QDate(2001, 03, 5), QVariantList( { 3.0 }));
+
+	EXPECT_EQ(2.0, store.value(0, 2));
+	EXPECT_EQ(3.0, store.value(1, 0));
+
+	store.setColumn(20, QDate(2001, 03, 7), QVariantList( { 4.0, "", 3.0 }));
+
+	EXPECT_EQ(QDate(2001, 03, 7), store.lastUpdated());
+	EXPECT_EQ(1.0, store.value(0, 3));
+	EXPECT_EQ(2.0, store.value(0, 4));
+	EXPECT_EQ(4.0, store.value(1, 0));
+	EXPECT_TRUE(qIsNaN(store.value(0, 0)));
+
+	// a whole window later nothing is left
+	store.setColumn(20, QDate(2001, 06, 1), QVariantList( { 1.0 }));
+	EXPECT_TRUE(qIsNaN(store.value(0, 3)));
+	EXPECT_EQ(QVariantList( { "", 1.0 }),
+			store.toVariantMap()["data"].toList());
+}
+
+TEST_F(TestColumnarStore, AggregatesEveryColumn) {
+	store.setColumn(10, QDate(2001, 03, 5), QVariantList( { 1.0, "", 4.0,
+			2.0 }));
+	store.setColumn(20, QDate(2001, 03, 5), QVariantList( { 10.0, 20.0 }));
+	store.setColumn(30, QDate(2001, 03, 5), QVariantList( { -3.0 }));
+
+	QVariantMap first(aggregate(0, 0, 2));
+	EXPECT_EQ(5.0, first["sum"].toDouble());
+	EXPECT_EQ(2, first["count"].toInt());
+	EXPECT_EQ(2.5, first["mean"].toDouble());
+	EXPECT_EQ(1.0, first["min"].toDouble());
+	EXPECT_EQ(4.0, first["max"].toDouble());
+
+	QVariantMap second(aggregate(1, 0, 2));
+	EXPECT_EQ(30.0, second["sum"].toDouble());
+	EXPECT_EQ(2, second["count"].toInt());
+
+	QVariantMap third(aggregate(2, 0, 2));
+	EXPECT_EQ(-3.0, third["min"].toDouble());
+	EXPECT_EQ(-3.0, third["max"].toDouble());
+
+	// two days on, only the oldest of the days we asked for are left
+	QVariantMap later(aggregate(0, 0, 2, QDate(2001, 03, 7)));
+	EXPECT_EQ(1.0, later["sum"].toDouble());
+	EXPECT_EQ(1, later["count"].toInt());
+
+	QVariantMap none(aggregate(2, 1, 5));
+	EXPECT_EQ(0.0, none["sum"].toDouble());
+	EXPECT_EQ(0, none["count"].toInt());
+	EXPECT_FALSE(none.contains("mean"));
+}
+
+TEST_F(TestColumnarStore, RemovesColumns) {
+	store.setColumn(10, QDate(2001, 03, 5), QVariantList( { 1.0 }));
+	store.setColumn(20, QDate(2001, 03, 5), QVariantList( { 2.0 }));
+	store.setColumn(30, QDate(2001, 03, 5), QVariantList( { 3.0 }));
+
+	store.removeColumn(10);
+
+	EXPECT_EQ(2, store.columnCount());
+	EXPECT_EQ(-1, store.column(10));
+	EXPECT_EQ(0, store.column(30));
+	EXPECT_EQ(1, store.column(20));
+	EXPECT_EQ(3.0, store.value(0, 0));
+	EXPECT_EQ(2.0, store.value(1, 0));
+	EXPECT_EQ(QVariantList( { 3.0, 2.0 }),
+			store.toVariantMap()["data"].toList());
+}
+
+} // namespace
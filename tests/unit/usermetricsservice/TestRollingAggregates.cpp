@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <usermetricsservice/RollingAggregates.h>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace testing;
+using namespace UserMetricsService;
+
+namespace {
+
+class TestRollingAggregates: public Test {
+protected:
+	TestRollingAggregates() :
+			aggregates(QList<int>() << 3) {
+	}
+
+	virtual ~TestRollingAggregates() {
+	}
+
+	QVariantMap window() const {
+		return aggregates.toVariantMap()["3"].toMap();
+	}
+
+	RollingAggregates aggregates;
+};
+
+TEST_F(TestRollingAggregates, IsEmptyToStartWith) {
+	EXPECT_FALSE(aggregates.isValid());
+	EXPECT_EQ(0, window()["count"].toInt());
+	EXPECT_EQ(0.0, window()["sum"].toDouble());
+	EXPECT_FALSE(window().contains("mean"));
+}
+
+TEST_F(TestRollingAggregates, OnlyCountsTheDaysInTheWindow) {
+	aggregates.reset(QDate(2001, 01, 07),
+			QVariantList( { 4.0, "", 2.0, 100.0, 100.0 }));
+
+	EXPECT_TRUE(aggregates.isValid());
+	EXPECT_EQ(3, window()["days"].toInt());
+	EXPECT_EQ(2, window()["count"].toInt());
+	EXPECT_EQ(6.0, window()["sum"].toDouble());
+	EXPECT_EQ(3.0, window()["mean"].toDouble());
+	EXPECT_EQ(2.0, window()["min"].toDouble());
+	EXPECT_EQ(4.0, window()["max"].toDouble());
+}
+
+TEST_F(TestRollingAggregates, FollowsTodaysValue) {
+	aggregates.reset(QDate(2001, 01, 07), QVariantList( { 4.0, 3.0, 2.0 }));
+
+	aggregates.setHead(QDate(2001, 01, 07), 5.0);
+	EXPECT_EQ(10.0, window()["sum"].toDouble());
+	EXPECT_EQ(5.0, window()["max"].toDouble());
+	EXPECT_EQ(2.0, window()["min"].toDouble());
+
+	aggregates.setHead(QDate(2001, 01, 07), 1.0);
+	EXPECT_EQ(6.0, window()["sum"].toDouble());
+	EXPECT_EQ(3.0, window()["max"].toDouble());
+	EXPECT_EQ(1.0, window()["min"].toDouble());
+
+	aggregates.setHead(QDate(2001, 01, 07), 2.5);
+	EXPECT_EQ(7.5, window()["sum"].toDouble());
+	EXPECT_EQ(3.0, window()["max"].toDouble());
+	EXPECT_EQ(2.0, window()["min"].toDouble());
+}
+
+TEST_F(TestRollingAggregates, DropsDaysAsTheDateMovesOn) {
+	aggregates.reset(QDate(2001, 01, 07), QVariantList( { 4.0, 3.0, 2.0 }));
+
+	aggregates.advance(QDate(2001, 01, 8));
+	EXPECT_EQ(2, window()["count"].toInt());
+	EXPECT_EQ(7.0, window()["sum"].toDouble());
+	EXPECT_EQ(3.0, window()["min"].toDouble());
+
+	aggregates.setHead(QDate(2001, 01, 9), 1.0);
+	EXPECT_EQ(2, window()["count"].toInt());
+	EXPECT_EQ(5.0, window()["sum"].toDouble());
+	EXPECT_EQ(1.0, window()["min"].toDouble());
+	EXPECT_EQ(4.0, window()["max"].toDouble());
+
+	aggregates.advance(QDate(2001, 02, 1));
+	EXPECT_EQ(0, window()["count"].toInt());
+	EXPECT_EQ(0.0, window()["sum"].toDouble());
+	EXPECT_FALSE(window().contains("max"));
+}
+
+} // namespace
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <stdexcept>
+
+#include <usermetricsservice/database/DataSet.h>
+#include <usermetricsservice/Authentication.h>
+#include <usermetricsservice/DBusUserMetrics.h>
+#include <usermetricsservice/DBusDataSource.h>
+#include <usermetricsservice/DBusUserData.h>
+#include <usermetricsservice/DBusDataSet.h>
+#include <usermetricsservice/StorageWriter.h>
+
+#include <testutils/DBusTest.h>
+#include <testutils/QStringPrinter.h>
+#include <testutils/QVariantListPrinter.h>
+#include <unit/usermetricsservice/ServiceMocks.h>
+
+#include <QDjango.h>
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QVariantList>
+#include <QtDBus/QDBusPendingCall>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace testing;
+using namespace UserMetricsCommon;
+using namespace UserMetricsService;
+using namespace UserMetricsTestUtils;
+using namespace TestsUnitUserMetricsService;
+
+namespace {
+
+class TestStorageWriter: public DBusTest {
+protected:
+	TestStorageWriter() :
+			db(QSqlDatabase::addDatabase("QSQLITE", "test-storage-writer")), dateFactory(
+					new NiceMock<MockDateFactory>()), authentication(
+					new Authentication()), translationLocator(
+					new NiceMock<MockTranslationLocator>()) {
+		if (!temporaryDir.isValid()) {
+			throw logic_error("Could not create temporary directory");
+		}
+
+		// the storage thread opens a connection of its own, so this
+		// has to be a real file rather than a memory database
+		db.setDatabaseName(temporaryDir.path() + "/usermetrics.db");
+		// give up on a locked database straight away
+		db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=1");
+		if (!db.open()) {
+			throw logic_error("Could not open temporary database");
+		}
+
+		ON_CALL(*dateFactory, currentDate()).WillByDefault(
+				Return(QDate(2001, 01, 07)));
+
+		ON_CALL(*translationLocator, locate(
+						_)).WillByDefault(Return(QString()));
+
+		QDjango::setDatabase(db);
+	}
+
+	virtual ~TestStorageWriter() {
+		QDjango::dropTables();
+		db.close();
+		QSqlDatabase::removeDatabase("test-storage-writer");
+	}
+
+	virtual void SetUp() {
+		DBusTest::SetUp();
+		storageWriter.reset(new StorageWriter(systemConnection()));
+	}
+
+	virtual void TearDown() {
+		storageWriter.reset();
+		DBusTest::TearDown();
+	}
+
+	/**
+	 * What the database has, as opposed to what the service remembers.
+	 */
+	QVariantList storedData(int id) {
+		DataSet dataSet;
+		DataSet::findById(id, &dataSet);
+
+		QVariantList data;
+		DBusDataSet::getData(dataSet, data);
+		return data;
+	}
+
+	QTemporaryDir temporaryDir;
+
+	QSqlDatabase db;
+
+	QSharedPointer<MockDateFactory> dateFactory;
+
+	QSharedPointer<Authentication> authentication;
+
+	QSharedPointer<MockTranslationLocator> translationLocator;
+
+	StorageWriterPtr storageWriter;
+};
+
+TEST_F(TestStorageWriter, SavesOnTheStorageThread) {
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator, storageWriter);
+	userMetrics.createDataSource("twitter", "foo", "", "", 0, QVariantMap());
+
+	userMetrics.createUserData("bob");
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+	bob->createDataSet("twitter");
+	DBusDataSetPtr twitter(bob->dataSet("twitter"));
+
+	QVariantList data( { 1.0, 2.0 });
+	twitter->update(data);
+
+	// the service sees the new data before it is on disk
+	EXPECT_EQ(data, twitter->data());
+
+	storageWriter->flush();
+	EXPECT_EQ(data, storedData(twitter->id()));
+}
+
+TEST_F(TestStorageWriter, CountsWritesNotYetSaved) {
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator, storageWriter);
+	userMetrics.createDataSource("twitter", "foo", "", "", 0, QVariantMap());
+	DBusDataSourcePtr twitter(userMetrics.dataSource("twitter"));
+
+	userMetrics.createUserData("bob");
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+	bob->createDataSet("twitter");
+	DBusDataSetPtr bobTwitter(bob->dataSet("twitter"));
+
+	userMetrics.createUserData("alice");
+	DBusUserDataPtr alice(userMetrics.userData("alice"));
+	alice->createDataSet("twitter");
+	DBusDataSetPtr aliceTwitter(alice->dataSet("twitter"));
+
+	// keep the storage thread from writing
+	QSqlQuery lock(db);
+	ASSERT_TRUE(lock.exec("BEGIN IMMEDIATE"));
+
+	bobTwitter->update(QVariantList( { 1.0, 2.0 }));
+	aliceTwitter->update(QVariantList( { 3.0, "", 5.0 }));
+	for (int i(0); i < 10; ++i) {
+		bobTwitter->increment(1.0);
+	}
+
+	// the totals are read from the database, which hasn't got any of
+	// this yet
+	QVariantMap totals(twitter->totals());
+	EXPECT_EQ(QVariantList( { 14.0, 2.0, 5.0 }), totals["data"].toList());
+	EXPECT_EQ(21.0, totals["sum"].toDouble());
+
+	twitter->invalidateCaches();
+	EXPECT_EQ(QVariantList( { 14.0, 2.0, 5.0 }),
+			twitter->totals()["data"].toList());
+
+	ASSERT_TRUE(lock.exec("ROLLBACK"));
+}
+
+TEST_F(TestStorageWriter, RepliesOnceTheDataIsSaved) {
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator, storageWriter);
+	userMetrics.createDataSource("twitter", "foo", "", "", 0, QVariantMap());
+
+	userMetrics.createUserData("bob");
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+	bob->createDataSet("twitter");
+	DBusDataSetPtr twitter(bob->dataSet("twitter"));
+
+	// a connection of its own, so the call really goes over the bus
+	QDBusConnection client(
+			QDBusConnection::connectToBus(QDBusConnection::SystemBus,
+					"test-storage-writer-client"));
+	ASSERT_TRUE(client.isConnected());
+
+	QDBusMessage message(
+			QDBusMessage::createMethodCall(systemConnection().baseService(),
+					twitter->path(), "com.canonical.usermetrics.DataSet",
+					"increment"));
+	message << 2.0;
+
+	QDBusPendingCall reply(client.asyncCall(message));
+	while (!reply.isFinished()) {
+		QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+	}
+
+	EXPECT_FALSE(reply.isError()) << reply.error().message().toStdString();
+
+	// nothing was flushed, the reply only came once the data was saved
+	EXPECT_EQ(QVariantList( { 2.0 }), storedData(twitter->id()));
+
+	QDBusConnection::disconnectFromBus("test-storage-writer-client");
+}
+
+TEST_F(TestStorageWriter, TakesBackWritesThatFail) {
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator, storageWriter);
+	userMetrics.createDataSource("twitter", "foo", "", "", 0, QVariantMap());
+
+	userMetrics.createUserData("bob");
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+	bob->createDataSet("twitter");
+	DBusDataSetPtr twitter(bob->dataSet("twitter"));
+
+	twitter->update(QVariantList( { 1.0 }));
+	storageWriter->flush();
+
+	// keep the storage thread from writing
+	QSqlQuery lock(db);
+	ASSERT_TRUE(lock.exec("BEGIN IMMEDIATE"));
+
+	twitter->increment(2.0);
+	EXPECT_EQ(QVariantList( { 3.0 }), twitter->data());
+
+	storageWriter->flush();
+	ASSERT_TRUE(lock.exec("ROLLBACK"));
+
+	// hear about the failure
+	QCoreApplication::processEvents();
+
+	EXPECT_EQ(QVariantList( { 1.0 }), twitter->data());
+	EXPECT_EQ(QVariantList( { 1.0 }), storedData(twitter->id()));
+	EXPECT_EQ(1.0, twitter->aggregates()["7"].toMap()["sum"].toDouble());
+}
+
+} // namespace
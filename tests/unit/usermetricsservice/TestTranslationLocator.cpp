@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2013 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Pete Woods <pete.woods@canonical.com>
+ */
+
+#include <usermetricsservice/TranslationLocatorImpl.h>
+#include <testutils/QStringPrinter.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QTemporaryDir>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace testing;
+using namespace UserMetricsService;
+
+namespace {
+
+/**
+ * Installs every package in a temporary directory rather than asking
+ * click, and counts how often it is asked.
+ */
+class FakeTranslationLocator: public TranslationLocatorImpl {
+public:
+	explicit FakeTranslationLocator(const QString &directory) :
+			root(directory), lookups(0), installed(true) {
+	}
+
+	int cachedPaths() const {
+		return m_paths.size();
+	}
+
+	QString root;
+
+	int lookups;
+
+	bool installed;
+
+protected:
+	QString pkgdir(const QString& id) override {
+		++lookups;
+		if (!installed) {
+			return QString();
+		}
+		m_watcher.addPath(root);
+		return QDir(root).filePath(id + "/current");
+	}
+};
+
+class TestTranslationLocator: public Test {
+protected:
+	TestTranslationLocator() :
+			locator(temporaryDir.path()) {
+	}
+
+	virtual ~TestTranslationLocator() {
+	}
+
+	QTemporaryDir temporaryDir;
+
+	FakeTranslationLocator locator;
+};
+
+TEST_F(TestTranslationLocator, UsesTheLangpackForUnconfinedCallers) {
+	EXPECT_EQ(QString("/usr/share/locale-langpack"),
+			locator.locate("unconfined"));
+	EXPECT_EQ(0, locator.lookups);
+}
+
+TEST_F(TestTranslationLocator, RemembersPackagePaths) {
+	const QString expected(
+			QDir(temporaryDir.path()).filePath(
+					"com.ubuntu.foo/current/share/locale"));
+
+	EXPECT_EQ(expected, locator.locate("com.ubuntu.foo"));
+	EXPECT_EQ(expected, locator.locate("com.ubuntu.foo"));
+	EXPECT_EQ(1, locator.lookups);
+	EXPECT_EQ(1, locator.cachedPaths());
+}
+
+TEST_F(TestTranslationLocator, AsksAgainAfterAFailure) {
+	locator.installed = false;
+	locator.locate("com.ubuntu.foo");
+	locator.locate("com.ubuntu.foo");
+	EXPECT_EQ(2, locator.lookups);
+	EXPECT_EQ(0, locator.cachedPaths());
+}
+
+TEST_F(TestTranslationLocator, ForgetsPathsWhenPackagesChange) {
+	locator.locate("com.ubuntu.foo");
+	ASSERT_EQ(1, locator.cachedPaths());
+
+	// an install or upgrade changes the watched directory
+	ASSERT_TRUE(QDir(temporaryDir.path()).mkdir("com.ubuntu.bar"));
+	for (int i(0); i < 50 && locator.cachedPaths() > 0; ++i) {
+		QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+	}
+	EXPECT_EQ(0, locator.cachedPaths());
+
+	locator.locate("com.ubuntu.foo");
+	EXPECT_EQ(2, locator.lookups);
+}
+
+} // namespace
@@ -23,18 +23,19 @@
 #include <usermetricsservice/DBusDataSource.h>
 #include <usermetricsservice/DBusUserData.h>
 #include <usermetricsservice/DBusDataSet.h>
-#include <usermetricsservice/TranslationLocator.h>
-#include <libusermetricscommon/DateFactory.h>
 #include <libusermetricscommon/DBusPaths.h>
 
 #include <testutils/DBusTest.h>
 #include <testutils/QStringPrinter.h>
 #include <testutils/QVariantListPrinter.h>
+#include <unit/usermetricsservice/ServiceMocks.h>
 
 #include <QDjango.h>
 
 #include <QSqlDatabase>
+#include <QtCore/QCoreApplication>
 #include <QtCore/QVariantList>
+#include <QtDBus/QDBusPendingCall>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
@@ -44,6 +45,7 @@ using namespace testing;
 using namespace UserMetricsCommon;
 using namespace UserMetricsService;
 using namespace UserMetricsTestUtils;
+using namespace TestsUnitUserMetricsService;
 
 namespace {
 
@@ -56,14 +58,23 @@ public:
 	MOCK_CONST_METHOD3(sendErrorReply, void(const QDBusContext&, QDBusError::ErrorType, const QString &));
 };
 
-class MockTranslationLocator: public TranslationLocator {
+/**
+ * Remembers every lookup it hands out.
+ */
+class CountingAuthentication: public Authentication {
 public:
-	MOCK_METHOD1(locate, QString(const QString&));
-};
+	virtual CredentialLookupPtr lookupCredentials(
+			const QDBusContext &context) const {
+		CredentialLookupPtr lookup(Authentication::lookupCredentials(context));
+		lookups << lookup;
+		return lookup;
+	}
 
-class MockDateFactory: public DateFactory {
-public:
-	MOCK_CONST_METHOD0(currentDate, QDate());
+	int remembered() const {
+		return m_lookups.size();
+	}
+
+	mutable QList<CredentialLookupPtr> lookups;
 };
 
 class TestUserMetricsService: public DBusTest {
@@ -108,6 +119,16 @@ protected:
 	QSharedPointer<MockTranslationLocator> translationLocator;
 };
 
+/**
+ * Keep the event loop going, so the service in this process can answer.
+ */
+static QDBusMessage waitForReply(const QDBusPendingCall &call) {
+	while (!call.isFinished()) {
+		QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+	}
+	return call.reply();
+}
+
 TEST_F(TestUserMetricsService, PersistsDataSourcesBetweenRestart) {
 	{
 		DBusUserMetrics userMetrics(systemConnection(), dateFactory,
@@ -488,6 +509,74 @@ TEST_F(TestUserMetricsService, MultipleUsers) {
 	EXPECT_EQ(DBusPaths::dataSet(2), bobDataSets.first().path());
 }
 
+TEST_F(TestUserMetricsService, Snapshot) {
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 01, 5)));
+	ON_CALL(*translationLocator, locate(
+					_)).WillByDefault(Return(QString("/tmp/locale")));
+
+	QVariantMap options;
+	options["maximum"] = 10.0;
+
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator);
+	userMetrics.createDataSource("twitter", "%1 tweets", "no tweets",
+			"twitter-domain", 0, options);
+
+	ON_CALL(*authentication, getUsername(
+					_)).WillByDefault(Return(QString("alice")));
+	userMetrics.createUserData("alice");
+	DBusUserDataPtr alice(userMetrics.userData("alice"));
+	alice->createDataSet("twitter");
+	DBusDataSetPtr aliceTwitter(alice->dataSet("twitter"));
+	QVariantList aliceData( { 3.0, "", 1.0 });
+	aliceTwitter->update(aliceData);
+
+	ON_CALL(*authentication, getUsername(
+					_)).WillByDefault(Return(QString("bob")));
+	userMetrics.createUserData("bob");
+
+	{
+		QVariantMap snapshot(userMetrics.snapshot(QStringList()));
+
+		QVariantMap dataSources(snapshot["dataSources"].toMap());
+		ASSERT_EQ(1, dataSources.size());
+		QVariantMap twitter(dataSources[DBusPaths::dataSource(1)].toMap());
+		EXPECT_EQ(QString("twitter"), twitter["name"].toString());
+		EXPECT_EQ(QString("%1 tweets"), twitter["formatString"].toString());
+		EXPECT_EQ(QString("no tweets"), twitter["emptyDataString"].toString());
+		EXPECT_EQ(QString("twitter-domain"), twitter["textDomain"].toString());
+		EXPECT_EQ(0u, twitter["metricType"].toUInt());
+		EXPECT_EQ(options, twitter["options"].toMap());
+		EXPECT_EQ(QString("/tmp/locale"), twitter["translationPath"].toString());
+
+		QVariantMap userDatas(snapshot["userDatas"].toMap());
+		ASSERT_EQ(2, userDatas.size());
+		EXPECT_EQ(QString("alice"),
+				userDatas[DBusPaths::userData(1)].toMap()["username"].toString());
+		EXPECT_EQ(QString("bob"),
+				userDatas[DBusPaths::userData(2)].toMap()["username"].toString());
+	}
+
+	{
+		QVariantMap snapshot(userMetrics.snapshot(QStringList() << "alice"));
+
+		QVariantMap userDatas(snapshot["userDatas"].toMap());
+		ASSERT_EQ(1, userDatas.size());
+		QVariantMap aliceMap(userDatas[DBusPaths::userData(1)].toMap());
+		EXPECT_EQ(QString("alice"), aliceMap["username"].toString());
+
+		QVariantMap dataSets(aliceMap["dataSets"].toMap());
+		ASSERT_EQ(1, dataSets.size());
+		QVariantMap dataSet(dataSets[DBusPaths::dataSet(1)].toMap());
+		EXPECT_EQ(DBusPaths::dataSource(1),
+				dataSet["dataSource"].value<QDBusObjectPath>().path());
+		EXPECT_EQ(QDateTime(QDate(2001, 01, 5)).toTime_t(),
+				dataSet["lastUpdated"].toUInt());
+		EXPECT_EQ(aliceData, dataSet["data"].toList());
+	}
+}
+
 TEST_F(TestUserMetricsService, IncrementOverSeveralDays) {
 	ON_CALL(*authentication, getUsername(
 					_)).WillByDefault(Return(QString("bob")));
@@ -528,6 +617,230 @@ TEST_F(TestUserMetricsService, IncrementOverSeveralDays) {
 	EXPECT_EQ(QDate(2001, 03, 3), twitter->lastUpdatedDate());
 }
 
+TEST_F(TestUserMetricsService, MaintainsRollingAggregates) {
+	ON_CALL(*authentication, getUsername(
+					_)).WillByDefault(Return(QString("bob")));
+
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 03, 1)));
+
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator);
+	userMetrics.createDataSource("twitter", "foo", "", "", 0, QVariantMap());
+
+	userMetrics.createUserData("bob");
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+
+	bob->createDataSet("twitter");
+	DBusDataSetPtr twitter(bob->dataSet("twitter"));
+
+	twitter->update(QVariantList( { 3.0, "", 5.0 }));
+	{
+		QVariantMap week(twitter->aggregates()["7"].toMap());
+		EXPECT_EQ(2, week["count"].toInt());
+		EXPECT_EQ(8.0, week["sum"].toDouble());
+		EXPECT_EQ(4.0, week["mean"].toDouble());
+		EXPECT_EQ(3.0, week["min"].toDouble());
+		EXPECT_EQ(5.0, week["max"].toDouble());
+	}
+
+	twitter->increment(4.0);
+	{
+		QVariantMap week(twitter->aggregates()["7"].toMap());
+		EXPECT_EQ(12.0, week["sum"].toDouble());
+		EXPECT_EQ(7.0, week["max"].toDouble());
+	}
+
+	// a week later only today's value is left in the week
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 03, 8)));
+	twitter->increment(1.0);
+	{
+		QVariantMap week(twitter->aggregates()["7"].toMap());
+		EXPECT_EQ(1, week["count"].toInt());
+		EXPECT_EQ(1.0, week["sum"].toDouble());
+
+		QVariantMap month(twitter->aggregates()["30"].toMap());
+		EXPECT_EQ(3, month["count"].toInt());
+		EXPECT_EQ(13.0, month["sum"].toDouble());
+	}
+}
+
+TEST_F(TestUserMetricsService, QueriesAggregates) {
+	ON_CALL(*authentication, getUsername(
+					_)).WillByDefault(Return(QString("bob")));
+
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 03, 1)));
+
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator);
+	userMetrics.createDataSource("twitter", "foo", "", "", 0, QVariantMap());
+	userMetrics.createDataSource("facebook", "bar", "", "", 0, QVariantMap());
+
+	userMetrics.createUserData("bob");
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+
+	bob->createDataSet("twitter");
+	DBusDataSetPtr twitter(bob->dataSet("twitter"));
+	twitter->update(QVariantList( { 1.0, "", 4.0, 2.0 }));
+
+	bob->createDataSet("facebook");
+	DBusDataSetPtr facebook(bob->dataSet("facebook"));
+	facebook->update(QVariantList( { 10.0 }));
+
+	QStringList aggregations( { "sum", "mean", "min", "max", "count" });
+
+	{
+		QVariantMap result(twitter->query(0, 2, aggregations));
+		EXPECT_EQ(5.0, result["sum"].toDouble());
+		EXPECT_EQ(2.5, result["mean"].toDouble());
+		EXPECT_EQ(1.0, result["min"].toDouble());
+		EXPECT_EQ(4.0, result["max"].toDouble());
+		EXPECT_EQ(2, result["count"].toInt());
+	}
+
+	// the days are counted back from today, not the last update
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 03, 3)));
+	{
+		QVariantMap result(twitter->query(0, 2, aggregations));
+		EXPECT_EQ(1.0, result["sum"].toDouble());
+		EXPECT_EQ(1, result["count"].toInt());
+
+		result = twitter->query(0, 1, aggregations);
+		EXPECT_EQ(0.0, result["sum"].toDouble());
+		EXPECT_EQ(0, result["count"].toInt());
+		EXPECT_FALSE(result.contains("mean"));
+	}
+
+	{
+		QVariantMap result(
+				userMetrics.query(
+						QList<QDBusObjectPath>()
+								<< QDBusObjectPath(twitter->path())
+								<< QDBusObjectPath(facebook->path()), 0, 5,
+						QStringList() << "sum"));
+		ASSERT_EQ(2, result.size());
+		EXPECT_EQ(7.0, result[twitter->path()].toMap()["sum"].toDouble());
+		EXPECT_EQ(10.0, result[facebook->path()].toMap()["sum"].toDouble());
+	}
+
+	EXPECT_CALL(*authentication,
+			sendErrorReply(_, QDBusError::InvalidArgs, _)).Times(3);
+	EXPECT_TRUE(twitter->query(0, 2, QStringList() << "median").isEmpty());
+	EXPECT_TRUE(twitter->query(2, 0, aggregations).isEmpty());
+	EXPECT_TRUE(
+			userMetrics.query(
+					QList<QDBusObjectPath>()
+							<< QDBusObjectPath(twitter->path()), 2, 0,
+					aggregations).isEmpty());
+}
+
+TEST_F(TestUserMetricsService, FindsDataSetAndReadsRanges) {
+	ON_CALL(*authentication, getUsername(
+					_)).WillByDefault(Return(QString("bob")));
+
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 03, 1)));
+
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator);
+	userMetrics.createDataSource("twitter", "foo", "", "", 0, QVariantMap());
+
+	userMetrics.createUserData("bob");
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+
+	bob->createDataSet("twitter");
+	DBusDataSetPtr twitter(bob->dataSet("twitter"));
+	twitter->update(QVariantList( { 1.0, "", 4.0, 2.0 }));
+
+	EXPECT_EQ(twitter->path(), userMetrics.findDataSet("bob", "twitter").path());
+
+	EXPECT_EQ(QVariantList( { 1.0, "" }), twitter->dataRange(0, 1));
+	EXPECT_EQ(QVariantList( { 4.0, 2.0 }), twitter->dataRange(2, 10));
+	EXPECT_TRUE(twitter->dataRange(4, 10).isEmpty());
+
+	// the range is counted back from today, not the last update
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 03, 3)));
+	EXPECT_EQ(QVariantList( { "", "", 1.0, "" }), twitter->dataRange(0, 3));
+
+	EXPECT_CALL(*authentication,
+			sendErrorReply(_, QDBusError::InvalidArgs, _)).Times(3);
+	EXPECT_TRUE(userMetrics.findDataSet("bob", "facebook").path().isEmpty());
+	EXPECT_TRUE(userMetrics.findDataSet("alice", "twitter").path().isEmpty());
+	EXPECT_TRUE(twitter->dataRange(2, 1).isEmpty());
+}
+
+TEST_F(TestUserMetricsService, MaintainsTotalsAcrossUsers) {
+	ON_CALL(*authentication, getUsername(_)).WillByDefault(Return(QString()));
+
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 03, 1)));
+
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator);
+	userMetrics.createDataSource("twitter", "foo", "", "", 0, QVariantMap());
+	DBusDataSourcePtr twitter(userMetrics.dataSource("twitter"));
+
+	userMetrics.createUserData("bob");
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+	bob->createDataSet("twitter");
+	DBusDataSetPtr bobTwitter(bob->dataSet("twitter"));
+
+	userMetrics.createUserData("alice");
+	DBusUserDataPtr alice(userMetrics.userData("alice"));
+	alice->createDataSet("twitter");
+	DBusDataSetPtr aliceTwitter(alice->dataSet("twitter"));
+
+	EXPECT_EQ(QVariantList(), twitter->totals()["data"].toList());
+	EXPECT_EQ(0.0, twitter->totals()["sum"].toDouble());
+
+	bobTwitter->update(QVariantList( { 1.0, 2.0 }));
+	aliceTwitter->update(QVariantList( { 3.0, "", 5.0 }));
+	{
+		QVariantMap totals(twitter->totals());
+		EXPECT_EQ(QVariantList( { 4.0, 2.0, 5.0 }), totals["data"].toList());
+		EXPECT_EQ(QVariantList( { 2, 1, 1 }), totals["users"].toList());
+		EXPECT_EQ(11.0, totals["sum"].toDouble());
+		EXPECT_EQ(QDateTime(QDate(2001, 03, 1)).toTime_t(),
+				totals["lastUpdated"].toUInt());
+	}
+
+	bobTwitter->increment(2.0);
+	EXPECT_EQ(QVariantList( { 6.0, 2.0, 5.0 }),
+			twitter->totals()["data"].toList());
+
+	EXPECT_CALL(*dateFactory, currentDate()).WillRepeatedly(
+			Return(QDate(2001, 03, 2)));
+	aliceTwitter->increment(1.0);
+	{
+		QVariantMap totals(twitter->totals());
+		EXPECT_EQ(QVariantList( { 1.0, 6.0, 2.0, 5.0 }),
+				totals["data"].toList());
+		EXPECT_EQ(QVariantList( { 1, 2, 1, 1 }), totals["users"].toList());
+		EXPECT_EQ(14.0, totals["sum"].toDouble());
+	}
+
+	// working it out again from the database gives the same answer
+	twitter->invalidateCaches();
+	EXPECT_EQ(QVariantList( { 1.0, 6.0, 2.0, 5.0 }),
+			twitter->totals()["data"].toList());
+
+	// and everybody's data can be fetched in one go
+	QVariantMap exported(twitter->exportData());
+	EXPECT_EQ(2, exported["columns"].toInt());
+	QVariantList exportedDataSets(exported["dataSets"].toList());
+	ASSERT_EQ(2, exportedDataSets.size());
+	EXPECT_EQ(bobTwitter->path(),
+			exportedDataSets.first().value<QDBusObjectPath>().path());
+	EXPECT_EQ(aliceTwitter->path(),
+			exportedDataSets.last().value<QDBusObjectPath>().path());
+	EXPECT_EQ(QVariantList( { "", 1.0, 3.0, 3.0, 2.0, "", "", 5.0 }),
+			exported["data"].toList());
+}
+
 TEST_F(TestUserMetricsService, StoreMaximumOf62Days) {
 	ON_CALL(*authentication, getUsername(
 					_)).WillByDefault(Return(QString("bob")));
@@ -816,4 +1129,140 @@ TEST_F(TestUserMetricsService, SharedDataSourceIdWrangling) {
 					QVariantMap()));
 }
 
+TEST_F(TestUserMetricsService, AnswersBusCallsOnceTheCallerIsKnown) {
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			authentication, translationLocator);
+	const QString service(systemConnection().baseService());
+
+	// a connection of its own, so the calls really go over the bus
+	QDBusConnection client(
+			QDBusConnection::connectToBus(QDBusConnection::SystemBus,
+					"test-user-metrics-client"));
+	ASSERT_TRUE(client.isConnected());
+
+	QDBusMessage createDataSource(
+			QDBusMessage::createMethodCall(service, DBusPaths::userMetrics(),
+					"com.canonical.UserMetrics", "createDataSource"));
+	createDataSource << QString("twitter") << QString("foo") << QString()
+			<< QString() << uint(0) << QVariantMap();
+	QDBusMessage reply(waitForReply(client.asyncCall(createDataSource)));
+	ASSERT_EQ(QDBusMessage::ReplyMessage, reply.type());
+	EXPECT_EQ(DBusPaths::dataSource(1),
+			reply.arguments().first().value<QDBusObjectPath>().path());
+
+	QDBusMessage createUserData(
+			QDBusMessage::createMethodCall(service, DBusPaths::userMetrics(),
+					"com.canonical.UserMetrics", "createUserData"));
+	createUserData << QString("bob");
+	reply = waitForReply(client.asyncCall(createUserData));
+	ASSERT_EQ(QDBusMessage::ReplyMessage, reply.type());
+	DBusUserDataPtr bob(userMetrics.userData("bob"));
+	ASSERT_FALSE(bob.isNull());
+	EXPECT_EQ(bob->path(),
+			reply.arguments().first().value<QDBusObjectPath>().path());
+
+	QDBusMessage createDataSet(
+			QDBusMessage::createMethodCall(service, bob->path(),
+					"com.canonical.usermetrics.UserData", "createDataSet"));
+	createDataSet << QString("twitter");
+	reply = waitForReply(client.asyncCall(createDataSet));
+	ASSERT_EQ(QDBusMessage::ReplyMessage, reply.type());
+	DBusDataSetPtr twitter(bob->dataSet("twitter"));
+	ASSERT_FALSE(twitter.isNull());
+	EXPECT_EQ(twitter->path(),
+			reply.arguments().first().value<QDBusObjectPath>().path());
+
+	QDBusMessage findDataSet(
+			QDBusMessage::createMethodCall(service, DBusPaths::userMetrics(),
+					"com.canonical.UserMetrics", "findDataSet"));
+	findDataSet << QString("bob") << QString("twitter");
+	reply = waitForReply(client.asyncCall(findDataSet));
+	ASSERT_EQ(QDBusMessage::ReplyMessage, reply.type());
+	EXPECT_EQ(twitter->path(),
+			reply.arguments().first().value<QDBusObjectPath>().path());
+
+	// errors are sent to the waiting caller too
+	QDBusMessage findMissing(
+			QDBusMessage::createMethodCall(service, DBusPaths::userMetrics(),
+					"com.canonical.UserMetrics", "findDataSet"));
+	findMissing << QString("alice") << QString("twitter");
+	reply = waitForReply(client.asyncCall(findMissing));
+	EXPECT_EQ(QDBusMessage::ErrorMessage, reply.type());
+	EXPECT_EQ(QDBusError::errorString(QDBusError::InvalidArgs),
+			reply.errorName());
+
+	QDBusConnection::disconnectFromBus("test-user-metrics-client");
+}
+
+TEST_F(TestUserMetricsService, SharesLookupsForTheSameCaller) {
+	QSharedPointer<CountingAuthentication> countingAuthentication(
+			new CountingAuthentication());
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			countingAuthentication, translationLocator);
+
+	QDBusConnection client(
+			QDBusConnection::connectToBus(QDBusConnection::SystemBus,
+					"test-user-metrics-client"));
+	ASSERT_TRUE(client.isConnected());
+	QDBusConnection otherClient(
+			QDBusConnection::connectToBus(QDBusConnection::SystemBus,
+					"test-user-metrics-other-client"));
+	ASSERT_TRUE(otherClient.isConnected());
+
+	QDBusMessage createUserData(
+			QDBusMessage::createMethodCall(systemConnection().baseService(),
+					DBusPaths::userMetrics(), "com.canonical.UserMetrics",
+					"createUserData"));
+	createUserData << QString("bob");
+
+	// both calls are in flight together
+	QDBusPendingCall first(client.asyncCall(createUserData));
+	QDBusPendingCall second(client.asyncCall(createUserData));
+	EXPECT_EQ(QDBusMessage::ReplyMessage, waitForReply(first).type());
+	EXPECT_EQ(QDBusMessage::ReplyMessage, waitForReply(second).type());
+
+	ASSERT_EQ(2, countingAuthentication->lookups.size());
+	EXPECT_EQ(countingAuthentication->lookups.at(0),
+			countingAuthentication->lookups.at(1));
+
+	// somebody else is looked up separately
+	EXPECT_EQ(QDBusMessage::ReplyMessage,
+			waitForReply(otherClient.asyncCall(createUserData)).type());
+	ASSERT_EQ(3, countingAuthentication->lookups.size());
+	EXPECT_NE(countingAuthentication->lookups.at(0),
+			countingAuthentication->lookups.at(2));
+
+	QDBusConnection::disconnectFromBus("test-user-metrics-client");
+	QDBusConnection::disconnectFromBus("test-user-metrics-other-client");
+}
+
+TEST_F(TestUserMetricsService, ForgetsCallersThatLeaveTheBus) {
+	QSharedPointer<CountingAuthentication> countingAuthentication(
+			new CountingAuthentication());
+	DBusUserMetrics userMetrics(systemConnection(), dateFactory,
+			countingAuthentication, translationLocator);
+
+	QDBusConnection client(
+			QDBusConnection::connectToBus(QDBusConnection::SystemBus,
+					"test-user-metrics-client"));
+	ASSERT_TRUE(client.isConnected());
+
+	QDBusMessage createUserData(
+			QDBusMessage::createMethodCall(systemConnection().baseService(),
+					DBusPaths::userMetrics(), "com.canonical.UserMetrics",
+					"createUserData"));
+	createUserData << QString("bob");
+	EXPECT_EQ(QDBusMessage::ReplyMessage,
+			waitForReply(client.asyncCall(createUserData)).type());
+	EXPECT_EQ(1, countingAuthentication->remembered());
+
+	QDBusConnection::disconnectFromBus("test-user-metrics-client");
+
+	// hear about it from the bus
+	for (int i(0); i < 50 && countingAuthentication->remembered() > 0; ++i) {
+		QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+	}
+	EXPECT_EQ(0, countingAuthentication->remembered());
+}
+
 } // namespace